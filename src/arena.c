@@ -0,0 +1,154 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <mpi.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "common.h"
+#include "device.h"
+
+/* Size of the huge pages mappings are rounded up to. */
+#define HUGEPAGE_SIZE (2UL << 20)
+
+struct arena g_arena;
+
+static const char *kind_names[] = {
+    [ARENA_HEAP] = "heap",
+    [ARENA_HUGEPAGES] = "hugepages",
+    [ARENA_MPI] = "mpi",
+#ifdef HAVE_CUDA
+    [ARENA_DEVICE] = "device",
+#endif
+};
+
+/* Returns the arena kind known by @name, or -1 if there is none.
+ * @name: Name of the kind, as given on the command line
+ */
+int arena_parse_kind(const char *name)
+{
+    for (size_t i = 0; i < sizeof kind_names / sizeof *kind_names; i++) {
+        if (!strcmp(name, kind_names[i]))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Sets up an arena of at least @size bytes. Huge pages are asked for
+ * explicitly first, and transparent huge pages are hinted at otherwise, so
+ * that the TLB covers large buffers with few entries. Memory from
+ * MPI_Alloc_mem may be pinned for RDMA once and for all, instead of on
+ * every transfer.
+ * @arena: Arena to be set up
+ * @size: Bytes the arena must be able to hand out
+ * @kind: Where the memory comes from
+ */
+void arena_init(struct arena *arena, size_t size, enum arena_kind kind)
+{
+    memset(arena, 0, sizeof *arena);
+    arena->kind = kind;
+    arena->size = ARENA_ROUND(size ? size : 1);
+
+    switch (kind) {
+    case ARENA_HEAP:
+        arena->mem_len = arena->size;
+        if (posix_memalign(&arena->mem, ARENA_ALIGN, arena->mem_len))
+            arena->mem = NULL;
+        break;
+    case ARENA_HUGEPAGES:
+        arena->mem_len
+            = (arena->size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+        arena->mem = mmap(NULL, arena->mem_len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena->mem == MAP_FAILED) {
+            arena->mem = mmap(NULL, arena->mem_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (arena->mem != MAP_FAILED)
+                madvise(arena->mem, arena->mem_len, MADV_HUGEPAGE);
+#endif
+        }
+        if (arena->mem == MAP_FAILED)
+            arena->mem = NULL;
+        break;
+    case ARENA_MPI:
+        /* MPI makes no promise about alignment. */
+        arena->mem_len = arena->size + ARENA_ALIGN;
+        MPI_Check(MPI_Alloc_mem(
+            (MPI_Aint)arena->mem_len, MPI_INFO_NULL, &arena->mem));
+        break;
+    case ARENA_DEVICE:
+        /* Only ever handed to device kernels and CUDA-aware MPI. */
+#ifdef HAVE_CUDA
+        arena->mem_len = arena->size;
+        arena->mem = device_alloc(arena->mem_len);
+#endif
+        break;
+    }
+    if (!arena->mem)
+        fail(ERR_NO_MEM, "out of memory");
+
+    arena->base = (char *)arena->mem
+        + ARENA_ROUND((uintptr_t)arena->mem) - (uintptr_t)arena->mem;
+}
+
+/* Hands out @size bytes of an arena, aligned to ARENA_ALIGN. Arenas are
+ * sized up front, so running out of space is a bug.
+ * @arena: Arena
+ * @size: Number of bytes
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size = ARENA_ROUND(size ? size : 1);
+    if (size > arena->size - arena->used)
+        fail(ERR_NO_MEM, "arena exhausted (%zu bytes asked for, %zu left)",
+            size, arena->size - arena->used);
+    void *p = arena->base + arena->used;
+    arena->used += size;
+    return p;
+}
+
+/* Releases the memory of an arena set up by arena_init().
+ * @arena: Arena
+ */
+void arena_free(struct arena *arena)
+{
+    if (!arena->mem)
+        return;
+    switch (arena->kind) {
+    case ARENA_HEAP:
+        free(arena->mem);
+        break;
+    case ARENA_HUGEPAGES:
+        munmap(arena->mem, arena->mem_len);
+        break;
+    case ARENA_MPI:
+        MPI_Check(MPI_Free_mem(arena->mem));
+        break;
+    case ARENA_DEVICE:
+#ifdef HAVE_CUDA
+        device_free(arena->mem);
+#endif
+        break;
+    }
+    memset(arena, 0, sizeof *arena);
+}
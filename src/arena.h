@@ -0,0 +1,69 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_ARENA_H
+#define MPI_HYPERCUBE_ARENA_H
+
+#include <stddef.h>
+
+/* Alignment of every allocation made from an arena, one cache line. */
+#define ARENA_ALIGN 64
+
+/* Bytes taken from an arena by an allocation of @size bytes. */
+#define ARENA_ROUND(size)                                                     \
+    (((size_t)(size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Where the memory of an arena comes from. */
+enum arena_kind {
+    ARENA_HEAP, /* the C library */
+    ARENA_HUGEPAGES, /* anonymous mapping backed by huge pages if possible */
+    ARENA_MPI, /* MPI_Alloc_mem, registered with the network if it can */
+    ARENA_DEVICE, /* CUDA device memory, if built with it, see device.h */
+};
+
+/* Bump allocator over a single block of memory, set up once and released
+ * as a whole. Scratch space is handed back with arena_release() to the mark
+ * taken before allocating it. */
+struct arena {
+    enum arena_kind kind;
+    void *mem; /* block as returned by the allocator, or NULL */
+    size_t mem_len;
+    char *base; /* first aligned byte of @mem */
+    size_t size, used;
+};
+
+/* Arena of this process, set up by the workers before reducing. */
+extern struct arena g_arena;
+
+int arena_parse_kind(const char *name);
+void arena_init(struct arena *arena, size_t size, enum arena_kind kind);
+void *arena_alloc(struct arena *arena, size_t size);
+void arena_free(struct arena *arena);
+
+/* Returns the current position of an arena, for arena_release(). */
+static inline size_t arena_mark(const struct arena *arena)
+{
+    return arena->used;
+}
+
+/* Hands back everything allocated from an arena since @mark was taken. */
+static inline void arena_release(struct arena *arena, size_t mark)
+{
+    arena->used = mark;
+}
+
+#endif /* MPI_HYPERCUBE_ARENA_H */
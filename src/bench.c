@@ -0,0 +1,223 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "common.h"
+#include "dtype.h"
+#include "hypercube.h"
+
+static const char *const format_names[] = {
+    [BENCH_CSV] = "csv",
+    [BENCH_JSON] = "json",
+};
+
+/* Returns the report format known by @name, or -1 if there is none.
+ * @name: Name of the format, as given on the command line
+ */
+int bench_parse_format(const char *name)
+{
+    for (size_t i = 0; i < sizeof format_names / sizeof *format_names; i++) {
+        if (!strcmp(name, format_names[i]))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Fills a buffer with pseudo-random values of an element type, in [-1, 1)
+ * for floating-point types and in [-1000, 1000) for integers. Every process
+ * seeds the generator differently.
+ * @dtype: Element type
+ * @vals: Receives the values
+ * @n: Number of values
+ * @seed: Seed of the generator
+ */
+static void fill_values(enum dtype dtype, void *vals, size_t n, uint64_t seed)
+{
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        double v = (double)(seed >> 11) * 0x1p-52 - 1.0;
+        switch (dtype) {
+        case DTYPE_F64:
+            ((double *)vals)[i] = v;
+            break;
+        case DTYPE_F32:
+            ((float *)vals)[i] = (float)v;
+            break;
+        case DTYPE_I32:
+            ((int32_t *)vals)[i] = (int32_t)(v * 1000);
+            break;
+        case DTYPE_I64:
+            ((int64_t *)vals)[i] = (int64_t)(v * 1000);
+            break;
+        }
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Measures the reduction of @count values of one operator with one backend,
+ * through libhypercube. Every timed reduction starts from the same values,
+ * right after a barrier, and takes as long as its slowest process; it
+ * includes turning the values into partials and copying the result out.
+ * Returns the duration of every timed reduction in seconds, sorted, on the
+ * first process; NULL on the others
+ * @comm: Communicator of the processes taking part
+ * @config: Benchmark settings
+ * @hc_config: Settings of the reduction, but for the operator and count
+ * @op: Operator
+ * @name: Operator, as given to --op
+ * @count: Number of values per process
+ */
+static double *measure(MPI_Comm comm, const struct bench_config *config,
+    const struct hc_config *hc_config, const struct op *op, const char *name,
+    int count)
+{
+    int rank, total = config->warmup + config->iterations;
+    MPI_Check(MPI_Comm_rank(comm, &rank));
+
+    /* Set everything up ahead of the timed loop. */
+    struct hc_config settings = *hc_config;
+    settings.op = name;
+    settings.dtype = (enum hc_dtype)op->dtype;
+    settings.count = count;
+    struct hc_ctx *ctx = hc_init(comm, &settings);
+    if (!ctx)
+        fatal("could not set up the reduction of %s: %s", name,
+            hc_last_error());
+    double *times = malloc((size_t)total * sizeof *times);
+    void *vals = malloc((size_t)count * dtype_size(op->dtype));
+    void *out = malloc((size_t)count * op->size);
+    if (!times || !vals || !out)
+        fatal("out of memory");
+    fill_values(op->dtype, vals, (size_t)count, 1 + (uint64_t)rank);
+
+    for (int i = 0; i < total; i++) {
+        MPI_Check(MPI_Barrier(comm));
+        double start = MPI_Wtime();
+        if (hc_reduce(ctx, vals, out, count))
+            fatal("%s", hc_last_error());
+        times[i] = MPI_Wtime() - start;
+    }
+    if (hc_free(ctx))
+        fatal("%s", hc_last_error());
+    free(out);
+    free(vals);
+
+    double *result = NULL;
+    if (rank == 0 && !(result = malloc((size_t)total * sizeof *result)))
+        fatal("out of memory");
+    MPI_Check(MPI_Reduce(times, result, total, MPI_DOUBLE, MPI_MAX, 0, comm));
+    free(times);
+    if (result) {
+        memmove(result, result + config->warmup,
+            (size_t)config->iterations * sizeof *result);
+        qsort(result, (size_t)config->iterations, sizeof *result,
+            compare_double);
+    }
+    return result;
+}
+
+/* Runs every measurement of a benchmark and writes a report on the first
+ * process. Sizes double from the smallest to the largest one, and every
+ * size is rounded to a whole number of partials. Latencies are given in
+ * microseconds, and the algorithm bandwidth, the bytes of partials per
+ * process over the median latency, in GB/s.
+ * @comm: Communicator of the processes taking part
+ * @config: Benchmark settings
+ * @fp: Stream the report is written to
+ */
+void bench_run(MPI_Comm comm, const struct bench_config *config, FILE *fp)
+{
+    int rank, size, records = 0;
+    MPI_Check(MPI_Comm_rank(comm, &rank));
+    MPI_Check(MPI_Comm_size(comm, &size));
+
+    if (rank == 0 && config->format == BENCH_CSV) {
+        fprintf(fp, "backend,op,dtype,processes,bytes,count,iterations,"
+                    "min_us,median_us,p99_us,algbw_gbps\n");
+    } else if (rank == 0) {
+        fprintf(fp, "[");
+    }
+
+    for (int b = 0; b < config->num_backends; b++) {
+        /* Codecs only apply to the hypercube backend. */
+        struct hc_config hc_config = config->hc;
+        hc_config.backend = (enum hc_backend)config->backends[b];
+        if (hc_config.backend != HC_BACKEND_HYPERCUBE)
+            hc_config.codec = HC_CODEC_NONE;
+        for (int o = 0; o < config->num_ops; o++) {
+            const struct op *op = &config->ops[o];
+            char name[32];
+            if (op->kind == OP_TOPK)
+                snprintf(name, sizeof name, "topk:%d", op->k);
+            else
+                snprintf(name, sizeof name, "%s", op_name(op));
+            size_t last = 0;
+            for (size_t bytes = config->min_size; bytes <= config->max_size;
+                 bytes *= 2) {
+                /* Sizes below one partial all come down to one. */
+                size_t count = bytes / op->size ? bytes / op->size : 1;
+                if (count > INT32_MAX)
+                    break;
+                if (count == last)
+                    continue;
+                last = count;
+                double *times = measure(
+                    comm, config, &hc_config, op, name, (int)count);
+                if (rank != 0)
+                    continue;
+
+                int n = config->iterations;
+                double min = times[0], median = times[n / 2];
+                double p99 = times[(size_t)(0.99 * (n - 1) + 0.5)];
+                double algbw = (double)(count * op->size) / median / 1e9;
+                const char *backend = cube_backend_name(config->backends[b]);
+                const char *dtype = dtype_name(op->dtype);
+                if (config->format == BENCH_CSV) {
+                    fprintf(fp, "%s,%s,%s,%d,%zu,%zu,%d,%.3f,%.3f,%.3f,%.4f\n",
+                        backend, name, dtype, size, count * op->size, count,
+                        n, min * 1e6, median * 1e6, p99 * 1e6, algbw);
+                } else {
+                    fprintf(fp,
+                        "%s\n  {\"backend\": \"%s\", \"op\": \"%s\", "
+                        "\"dtype\": \"%s\", \"processes\": %d, "
+                        "\"bytes\": %zu, \"count\": %zu, "
+                        "\"iterations\": %d, \"min_us\": %.3f, "
+                        "\"median_us\": %.3f, \"p99_us\": %.3f, "
+                        "\"algbw_gbps\": %.4f}",
+                        records ? "," : "", backend, name, dtype, size,
+                        count * op->size, count, n, min * 1e6, median * 1e6,
+                        p99 * 1e6, algbw);
+                }
+                records++;
+                fflush(fp);
+                free(times);
+            }
+        }
+    }
+
+    if (rank == 0 && config->format == BENCH_JSON)
+        fprintf(fp, "\n]\n");
+}
@@ -0,0 +1,52 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_BENCH_H
+#define MPI_HYPERCUBE_BENCH_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cube.h"
+#include "hypercube.h"
+#include "ops.h"
+
+/* Formats of the benchmark report. */
+enum bench_format {
+    BENCH_CSV,
+    BENCH_JSON,
+};
+
+/* What a benchmark run sweeps over. Every combination of backend, operator
+ * and size is measured on synthetic data. */
+struct bench_config {
+    enum bench_format format;
+    size_t min_size, max_size; /* bytes of partials per process */
+    int warmup, iterations; /* untimed and timed reductions per size */
+    const struct op *ops; /* operators, set up with op_init() */
+    int num_ops;
+    const enum cube_backend *backends;
+    int num_backends;
+    struct hc_config hc; /* settings of the reductions, but for the
+                          * backend, the operator and the count */
+};
+
+int bench_parse_format(const char *name);
+void bench_run(MPI_Comm comm, const struct bench_config *config, FILE *fp);
+
+#endif /* MPI_HYPERCUBE_BENCH_H */
@@ -0,0 +1,173 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binfile.h"
+#include "common.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_ENDIANNESS BINFILE_BIG_ENDIAN
+#else
+#define HOST_ENDIANNESS BINFILE_LITTLE_ENDIAN
+#endif
+
+/* Reads and validates the header of a binary input file. This function does
+ * not return on failure.
+ * @fd: File descriptor of the file
+ * @path: Path to the file, for error messages
+ * @hdr: Receives the parsed header
+ */
+static void read_header(int fd, const char *path, struct binfile_header *hdr)
+{
+    uint8_t raw[BINFILE_HEADER_SIZE];
+    struct stat st;
+
+    if (pread(fd, raw, sizeof raw, 0) != sizeof raw || fstat(fd, &st) < 0)
+        fatal("could not read header of `%s'", path);
+    if (memcmp(raw, BINFILE_MAGIC, 4))
+        fatal("`%s' is not a binary input file", path);
+
+    hdr->version = raw[4];
+    hdr->dtype = raw[5];
+    hdr->endianness = raw[6];
+    hdr->count = 0;
+    for (int i = 7; i >= 0; i--)
+        hdr->count = hdr->count << 8 | raw[8 + i];
+
+    if (hdr->version != BINFILE_VERSION)
+        fatal("`%s': unsupported format version %u", path, hdr->version);
+    if (hdr->dtype >= DTYPE_COUNT)
+        fatal("`%s': unsupported data type %u", path, hdr->dtype);
+    if (hdr->endianness > BINFILE_BIG_ENDIAN)
+        fatal("`%s': invalid byte order %u", path, hdr->endianness);
+    if (hdr->count > ((uint64_t)st.st_size - BINFILE_HEADER_SIZE)
+            / dtype_size(hdr->dtype))
+        fatal("`%s': truncated file (%llu values expected)", path,
+            (unsigned long long)hdr->count);
+}
+
+/* Returns 1 if the given file starts with the magic of a binary input file,
+ * 0 otherwise (including when the file cannot be read). The header of binary
+ * input files is validated, and this function does not return if it is
+ * invalid.
+ * @path: Path to the file
+ * @hdr: Receives the header of binary input files, may be NULL
+ */
+int binfile_probe(const char *path, struct binfile_header *hdr)
+{
+    char magic[4];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    ssize_t n = pread(fd, magic, sizeof magic, 0);
+    int found = n == sizeof magic && !memcmp(magic, BINFILE_MAGIC, 4);
+    if (found && hdr)
+        read_header(fd, path, hdr);
+    close(fd);
+    return found;
+}
+
+/* Maps the slice of a binary input file that belongs to one of several
+ * processes into memory. Values are used in place when their byte order
+ * matches the host's, otherwise they are copied and swapped. This function
+ * does not return on failure.
+ * @path: Path to the file
+ * @part: Index of the process, in [0, parts)
+ * @parts: Number of processes sharing the file
+ * @slice: Receives the mapped slice
+ */
+void binfile_map_slice(
+    const char *path, size_t part, size_t parts, struct binfile_slice *slice)
+{
+    errno = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        fatal("could not open file `%s' for reading: %s", path,
+            strerror(errno));
+
+    struct binfile_header hdr;
+    read_header(fd, path, &hdr);
+
+    size_t first, size = dtype_size(hdr.dtype);
+    memset(slice, 0, sizeof *slice);
+    slice->dtype = hdr.dtype;
+    block_range(hdr.count, parts, part, &first, &slice->count);
+    if (slice->count == 0) {
+        close(fd);
+        return;
+    }
+
+    /* Mappings must start on a page boundary. */
+    size_t offset = BINFILE_HEADER_SIZE + first * size;
+    size_t page_offset = offset % (size_t)sysconf(_SC_PAGESIZE);
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    slice->map_len = page_offset + slice->count * size;
+    slice->map = mmap(NULL, slice->map_len, PROT_READ, flags, fd,
+        (off_t)(offset - page_offset));
+    close(fd);
+    if (slice->map == MAP_FAILED)
+        fatal("could not map `%s': %s", path, strerror(errno));
+    madvise(slice->map, slice->map_len, MADV_SEQUENTIAL);
+    slice->data = (char *)slice->map + page_offset;
+
+    if (hdr.endianness != HOST_ENDIANNESS) {
+        char *src = slice->data, *swapped = malloc(slice->count * size);
+        if (!swapped)
+            fatal("out of memory");
+        for (size_t i = 0; i < slice->count * size; i += size) {
+            if (size == sizeof(uint64_t)) {
+                uint64_t bits;
+                memcpy(&bits, src + i, sizeof bits);
+                bits = __builtin_bswap64(bits);
+                memcpy(swapped + i, &bits, sizeof bits);
+            } else {
+                uint32_t bits;
+                memcpy(&bits, src + i, sizeof bits);
+                bits = __builtin_bswap32(bits);
+                memcpy(swapped + i, &bits, sizeof bits);
+            }
+        }
+        munmap(slice->map, slice->map_len);
+        slice->map = NULL;
+        slice->data = swapped;
+        slice->owned = 1;
+    }
+}
+
+/* Releases a slice mapped by binfile_map_slice().
+ * @slice: Slice to be released
+ */
+void binfile_unmap_slice(struct binfile_slice *slice)
+{
+    if (slice->owned)
+        free(slice->data);
+    else if (slice->map)
+        munmap(slice->map, slice->map_len);
+    memset(slice, 0, sizeof *slice);
+}
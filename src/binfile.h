@@ -0,0 +1,69 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_BINFILE_H
+#define MPI_HYPERCUBE_BINFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dtype.h"
+
+/* Binary input container. Files start with a fixed 32-byte header followed
+ * by the raw values, so that every process can map its own slice of the
+ * file without any parsing step:
+ *
+ *   offset  size  field
+ *        0     4  magic ("HCUB")
+ *        4     1  format version (BINFILE_VERSION)
+ *        5     1  data type of the values (enum dtype)
+ *        6     1  byte order of the values (enum binfile_endianness)
+ *        7     1  reserved, zero
+ *        8     8  number of values, little-endian
+ *       16    16  reserved, zero
+ *       32     -  values
+ */
+#define BINFILE_MAGIC "HCUB"
+#define BINFILE_VERSION 1
+#define BINFILE_HEADER_SIZE 32
+
+enum binfile_endianness {
+    BINFILE_LITTLE_ENDIAN = 0,
+    BINFILE_BIG_ENDIAN = 1,
+};
+
+struct binfile_header {
+    uint8_t version, dtype, endianness;
+    uint64_t count;
+};
+
+/* Slice of the values of a binary input file mapped into memory. */
+struct binfile_slice {
+    void *map; /* start of the mapping, or NULL */
+    size_t map_len;
+    void *data; /* values of the slice */
+    size_t count;
+    enum dtype dtype;
+    int owned; /* @data was allocated because the values needed swapping */
+};
+
+int binfile_probe(const char *path, struct binfile_header *hdr);
+void binfile_map_slice(
+    const char *path, size_t part, size_t parts, struct binfile_slice *slice);
+void binfile_unmap_slice(struct binfile_slice *slice);
+
+#endif /* MPI_HYPERCUBE_BINFILE_H */
@@ -0,0 +1,390 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "codec.h"
+#include "common.h"
+
+static const char *codec_names[] = {
+    [CODEC_NONE] = "none",
+    [CODEC_XOR] = "xor",
+#ifdef HAVE_LZ4
+    [CODEC_LZ4] = "lz4",
+#endif
+    [CODEC_F16] = "f16",
+    [CODEC_BF16] = "bf16",
+};
+
+/* Returns the codec known by @name, or -1 if there is none or it was left
+ * out of the build.
+ * @name: Name of the codec, as given on the command line
+ */
+int codec_parse(const char *name)
+{
+    for (size_t i = 0; i < sizeof codec_names / sizeof *codec_names; i++) {
+        if (codec_names[i] && !strcmp(name, codec_names[i]))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Tells whether a codec can encode the partials of @op. Lossy codecs only
+ * encode floating-point values, and so only apply to the operators whose
+ * partials are values themselves; lz4 needs a build with it.
+ * @kind: Codec
+ * @op: Operator
+ */
+int codec_supports(enum codec_kind kind, const struct op *op)
+{
+#ifndef HAVE_LZ4
+    if (kind == CODEC_LZ4)
+        return 0;
+#endif
+    if (kind != CODEC_F16 && kind != CODEC_BF16)
+        return 1;
+    return op->kind <= OP_PROD
+        && (op->dtype == DTYPE_F32 || op->dtype == DTYPE_F64);
+}
+
+/* Returns the largest number of bytes codec_encode() may write for @count
+ * partials of @op, with any codec.
+ * @op: Operator
+ * @count: Number of partials
+ */
+size_t codec_bound(const struct op *op, size_t count)
+{
+    size_t n = count * op->size;
+    return 1 + n + n / 4 + 16;
+}
+
+/* Size of the words partials are split into by the lossless codecs: the
+ * fields of every partial are 8 bytes wide, unless its values are four. */
+static size_t word_size(const struct op *op)
+{
+    return op->size % 8 == 0 ? 8 : op->size % 4 == 0 ? 4 : 1;
+}
+
+static inline uint64_t load_word(const uint8_t *p, size_t w)
+{
+    uint64_t x = 0;
+    if (w == 8) {
+        memcpy(&x, p, 8);
+    } else if (w == 4) {
+        uint32_t y;
+        memcpy(&y, p, 4);
+        x = y;
+    } else {
+        x = *p;
+    }
+    return x;
+}
+
+static inline void store_word(uint8_t *p, uint64_t x, size_t w)
+{
+    if (w == 8) {
+        memcpy(p, &x, 8);
+    } else if (w == 4) {
+        uint32_t y = (uint32_t)x;
+        memcpy(p, &y, 4);
+    } else {
+        *p = (uint8_t)x;
+    }
+}
+
+/* XORs every word with the same word of the previous partial, in the spirit
+ * of Gorilla, and keeps the bytes between the leading and trailing zero
+ * bytes of the result, after a byte holding both counts. Slowly changing
+ * values share their sign, exponent and upper mantissa with their
+ * predecessor, and integers their upper bytes. Returns the bytes written.
+ */
+static size_t xor_encode(
+    uint8_t *dst, const uint8_t *src, size_t n, size_t w, size_t stride)
+{
+    uint8_t *p = dst;
+    for (size_t j = 0; j < n / w; j++) {
+        uint64_t x = load_word(src + j * w, w);
+        if (j >= stride)
+            x ^= load_word(src + (j - stride) * w, w);
+        if (!x) {
+            *p++ = (uint8_t)(w << 4);
+            continue;
+        }
+        size_t lead = (size_t)__builtin_clzll(x) / 8 - (8 - w);
+        size_t trail = (size_t)__builtin_ctzll(x) / 8;
+        *p++ = (uint8_t)(lead << 4 | trail);
+        for (size_t b = trail; b < w - lead; b++)
+            *p++ = (uint8_t)(x >> 8 * b);
+    }
+    return (size_t)(p - dst);
+}
+
+static void xor_decode(uint8_t *dst, const uint8_t *src, size_t len,
+    size_t n, size_t w, size_t stride)
+{
+    const uint8_t *p = src, *end = src + len;
+    for (size_t j = 0; j < n / w; j++) {
+        if (p == end)
+            fail(ERR_CORRUPT, "truncated xor-encoded buffer");
+        size_t lead = *p >> 4, trail = *p & 15;
+        p++;
+        uint64_t x = 0;
+        if (lead < w) {
+            if (lead + trail > w || (size_t)(end - p) < w - lead - trail)
+                fail(ERR_CORRUPT, "corrupt xor-encoded buffer");
+            for (size_t b = trail; b < w - lead; b++)
+                x |= (uint64_t)*p++ << 8 * b;
+        }
+        if (j >= stride)
+            x ^= load_word(dst + (j - stride) * w, w);
+        store_word(dst + j * w, x, w);
+    }
+}
+
+#ifdef HAVE_LZ4
+/* Gathers byte @b of every @w-byte word into the @b-th plane, so that the
+ * slowly changing upper bytes of values end up next to each other. */
+static void shuffle(uint8_t *dst, const uint8_t *src, size_t n, size_t w)
+{
+    size_t words = n / w;
+    for (size_t j = 0; j < words; j++) {
+        for (size_t b = 0; b < w; b++)
+            dst[b * words + j] = src[j * w + b];
+    }
+}
+
+static void unshuffle(uint8_t *dst, const uint8_t *src, size_t n, size_t w)
+{
+    size_t words = n / w;
+    for (size_t j = 0; j < words; j++) {
+        for (size_t b = 0; b < w; b++)
+            dst[j * w + b] = src[b * words + j];
+    }
+}
+#endif
+
+/* Rounds @f to the nearest half-precision value, ties to even. Clears @ok
+ * if @f is finite and beyond the range of half precision. Values below its
+ * normal range lose relative precision, but stay within 2^-25 of @f. */
+static uint16_t to_f16(float f, int *ok)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof x);
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    uint32_t exp = (x >> 23) & 0xff, mant = x & 0x7fffff;
+
+    if (exp == 0xff)
+        return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+    if (exp > 142) {
+        *ok = 0;
+        return 0;
+    }
+    if (exp <= 112) {
+        /* Subnormal in half precision: a multiple of 2^-24. */
+        uint32_t shift = 126 - exp;
+        if (shift > 24)
+            return sign;
+        mant |= 0x800000;
+        uint32_t h = mant >> shift, rem = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1)))
+            h++;
+        return (uint16_t)(sign | h);
+    }
+    uint32_t h = (exp - 112) << 10 | mant >> 13, rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    if (h >= 0x7c00)
+        *ok = 0;
+    return (uint16_t)(sign | h);
+}
+
+static float from_f16(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff, x;
+    float f;
+
+    if (exp == 0) {
+        f = ldexpf((float)mant, -24);
+        return sign ? -f : f;
+    }
+    if (exp == 31)
+        x = sign | 0x7f800000 | mant << 13;
+    else
+        x = sign | (exp + 112) << 23 | mant << 13;
+    memcpy(&f, &x, sizeof f);
+    return f;
+}
+
+/* Rounds @f to the nearest bfloat16 value, ties to even. Clears @ok if a
+ * finite @f rounds to infinity. */
+static uint16_t to_bf16(float f, int *ok)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof x);
+    if ((x & 0x7fffffff) > 0x7f800000)
+        return (uint16_t)(x >> 16 | 0x40);
+    int finite = (x & 0x7f800000) != 0x7f800000;
+    x += 0x7fff + ((x >> 16) & 1);
+    if (finite && (x & 0x7f800000) == 0x7f800000)
+        *ok = 0;
+    return (uint16_t)(x >> 16);
+}
+
+static float from_bf16(uint16_t h)
+{
+    uint32_t x = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &x, sizeof f);
+    return f;
+}
+
+/* Quantizes the values of a buffer to 16 bits. Returns 0 if some value is
+ * out of range, in which case the buffer is to be sent as is. */
+static int quantize(enum codec_kind kind, enum dtype dtype, uint16_t *dst,
+    const void *src, size_t count)
+{
+    int ok = 1;
+    for (size_t i = 0; i < count && ok; i++) {
+        double d = dtype == DTYPE_F64 ? ((const double *)src)[i]
+                                      : ((const float *)src)[i];
+        float f = (float)d;
+        if (isfinite(d) && !isfinite(f))
+            return 0;
+        dst[i] = kind == CODEC_F16 ? to_f16(f, &ok) : to_bf16(f, &ok);
+    }
+    return ok;
+}
+
+static void dequantize(enum codec_kind kind, enum dtype dtype, void *dst,
+    const uint16_t *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        float f = kind == CODEC_F16 ? from_f16(src[i]) : from_bf16(src[i]);
+        if (dtype == DTYPE_F64)
+            ((double *)dst)[i] = f;
+        else
+            ((float *)dst)[i] = f;
+    }
+}
+
+/* Encodes a buffer of partials. Buffers the codec does not make any
+ * smaller, or cannot represent within its error bound, are copied as is.
+ * Returns the number of bytes written to @dst.
+ * @kind: Codec
+ * @op: Operator
+ * @dst: Receives the encoded buffer, of codec_bound() bytes
+ * @src: Partials
+ * @count: Number of partials
+ * @work: Scratch space of @count partials
+ */
+size_t codec_encode(enum codec_kind kind, const struct op *op, void *dst,
+    const void *src, size_t count, void *work)
+{
+    uint8_t *out = dst;
+    size_t n = count * op->size, w = word_size(op), len = 0;
+    (void)work;
+
+    if (!codec_supports(kind, op))
+        kind = CODEC_NONE;
+    switch (kind) {
+    case CODEC_NONE:
+        break;
+    case CODEC_XOR:
+        len = xor_encode(out + 1, src, n, w, op->size / w);
+        break;
+    case CODEC_LZ4:
+#ifdef HAVE_LZ4
+        shuffle(work, src, n, w);
+        len = (size_t)LZ4_compress_default(
+            work, (char *)out + 1, (int)n, (int)(codec_bound(op, count) - 1));
+#endif
+        break;
+    case CODEC_F16:
+    case CODEC_BF16:
+        len = 2 * count;
+        if (!quantize(kind, op->dtype, work, src, count))
+            len = 0;
+        else
+            memcpy(out + 1, work, len);
+        break;
+    }
+
+    if (len == 0 || len >= n) {
+        out[0] = CODEC_NONE;
+        memcpy(out + 1, src, n);
+        return 1 + n;
+    }
+    out[0] = (uint8_t)kind;
+    return 1 + len;
+}
+
+/* Decodes a buffer encoded by codec_encode().
+ * @op: Operator
+ * @dst: Receives @count partials
+ * @src: Encoded buffer
+ * @len: Bytes of the encoded buffer
+ * @count: Number of partials
+ * @work: Scratch space of @count partials
+ */
+void codec_decode(const struct op *op, void *dst, const void *src,
+    size_t len, size_t count, void *work)
+{
+    const uint8_t *in = src;
+    size_t n = count * op->size, w = word_size(op);
+    (void)work;
+
+    if (len < 1)
+        fail(ERR_CORRUPT, "empty encoded buffer");
+    switch (in[0]) {
+    case CODEC_NONE:
+        if (len != 1 + n)
+            fail(ERR_CORRUPT, "encoded buffer of %zu bytes for %zu", len,
+                n);
+        memcpy(dst, in + 1, n);
+        return;
+    case CODEC_XOR:
+        xor_decode(dst, in + 1, len - 1, n, w, op->size / w);
+        return;
+#ifdef HAVE_LZ4
+    case CODEC_LZ4:
+        if (LZ4_decompress_safe((const char *)in + 1, work, (int)(len - 1),
+                (int)n)
+            != (int)n)
+            fail(ERR_CORRUPT, "corrupt lz4-encoded buffer");
+        unshuffle(dst, work, n, w);
+        return;
+#endif
+    case CODEC_F16:
+    case CODEC_BF16:
+        if (len != 1 + 2 * count)
+            fail(ERR_CORRUPT,
+                "quantized buffer of %zu bytes for %zu values", len, count);
+        memcpy(work, in + 1, 2 * count);
+        dequantize((enum codec_kind)in[0], op->dtype, dst, work, count);
+        return;
+    }
+    fail(ERR_CORRUPT, "buffer encoded with unknown codec %d", in[0]);
+}
@@ -0,0 +1,46 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_CODEC_H
+#define MPI_HYPERCUBE_CODEC_H
+
+#include <stddef.h>
+
+#include "ops.h"
+
+/* Encodings of the buffers of partials sent across the hypercube. Encoded
+ * buffers start with a byte telling how they were encoded, so that a
+ * buffer that would not get any smaller, or that a lossy codec cannot
+ * represent within its error bound, is sent as is instead. */
+enum codec_kind {
+    CODEC_NONE,
+    CODEC_XOR, /* lossless: XOR with the previous partial, zero bytes
+                * trimmed off both ends of every word */
+    CODEC_LZ4, /* lossless: byte shuffle, then LZ4, if built with it */
+    CODEC_F16, /* lossy: half precision, relative error 2^-11 per round */
+    CODEC_BF16, /* lossy: bfloat16, relative error 2^-8 per round */
+};
+
+int codec_parse(const char *name);
+int codec_supports(enum codec_kind kind, const struct op *op);
+size_t codec_bound(const struct op *op, size_t count);
+size_t codec_encode(enum codec_kind kind, const struct op *op, void *dst,
+    const void *src, size_t count, void *work);
+void codec_decode(const struct op *op, void *dst, const void *src,
+    size_t len, size_t count, void *work);
+
+#endif /* MPI_HYPERCUBE_CODEC_H */
@@ -0,0 +1,91 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_COMMON_H
+#define MPI_HYPERCUBE_COMMON_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PROGNAME "mpi_hypercube"
+
+#define max(a, b)                                                             \
+    __extension__({                                                           \
+        __typeof(a) _a = a;                                                   \
+        __typeof(b) _b = b;                                                   \
+        _a > _b ? _a : _b;                                                    \
+    })
+#define min(a, b)                                                             \
+    __extension__({                                                           \
+        __typeof(a) _a = a;                                                   \
+        __typeof(b) _b = b;                                                   \
+        _a < _b ? _a : _b;                                                    \
+    })
+#define MPI_Check(v)                                                          \
+    __extension__({                                                           \
+        __typeof(v) _v = v;                                                   \
+        if (_v != MPI_SUCCESS)                                                \
+            handle_error(_v, #v);                                             \
+    })
+#define logf(f, ...) printf(PROGNAME "(%d): " f "\n", g_rank, ##__VA_ARGS__)
+#define fatal(f, ...)                                                         \
+    __extension__({                                                           \
+        fprintf(stderr, PROGNAME "(%d): error: " f "\n", g_rank,              \
+            ##__VA_ARGS__);                                                   \
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);                              \
+        _exit(EXIT_FAILURE);                                                  \
+    })
+
+/* Errors the reduction modules give up with, see fail(). They stand for
+ * those of enum hc_error. */
+enum error {
+    ERR_ARG = 1,
+    ERR_BUSY,
+    ERR_NO_MEM,
+    ERR_MPI,
+    ERR_TIMEOUT,
+    ERR_CORRUPT,
+    ERR_DEVICE,
+};
+
+extern int g_rank, g_size;
+
+void __attribute__((noreturn)) handle_error(int mpi_error, const char *expr);
+void __attribute__((noreturn, format(printf, 2, 3)))
+fail(int err, const char *fmt, ...);
+
+/* Computes the contiguous block of values assigned to a worker when @n values
+ * are split across @parts workers. The first (n % parts) workers get one
+ * extra value, so block sizes differ by at most one.
+ * @n: Total number of values
+ * @parts: Number of workers
+ * @idx: Index of the worker, in [0, parts)
+ * @first: Receives the index of the first value of the block
+ * @count: Receives the number of values in the block
+ */
+static inline void block_range(
+    size_t n, size_t parts, size_t idx, size_t *first, size_t *count)
+{
+    size_t base = n / parts, rem = n % parts;
+    *first = idx * base + (idx < rem ? idx : rem);
+    *count = base + (idx < rem);
+}
+
+#endif /* MPI_HYPERCUBE_COMMON_H */
@@ -0,0 +1,1741 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "common.h"
+#include "cube.h"
+#include "ops.h"
+#include "trace.h"
+
+#ifdef HAVE_ULFM
+#include <mpi-ext.h>
+#endif
+
+/* Spans of the reductions are recorded here while tracing is on, see
+ * trace_init(). */
+struct trace g_trace;
+
+/* Tag of the messages folding processes into the hypercube proper. */
+#define TAG_FOLD 1
+
+static const char *const backend_names[] = {
+    [BACKEND_HYPERCUBE] = "hypercube",
+    [BACKEND_REDUCE] = "reduce",
+    [BACKEND_ALLREDUCE] = "allreduce",
+    [BACKEND_CART] = "cart",
+    [BACKEND_NEIGHBOR] = "neighbor",
+    [BACKEND_HALVING] = "halving",
+    [BACKEND_RMA] = "rma",
+};
+
+/* Returns the backend with the given name, or -1 if there is none.
+ * @name: Name of the backend
+ */
+int cube_parse_backend(const char *name)
+{
+    for (size_t i = 0; i < sizeof backend_names / sizeof *backend_names; i++) {
+        if (!strcmp(name, backend_names[i]))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Returns the name of a backend.
+ * @backend: Backend
+ */
+const char *cube_backend_name(enum cube_backend backend)
+{
+    return backend_names[backend];
+}
+
+/* Number of processes in the hypercube proper. */
+#define CUBE_CORE_SIZE(cube) (1 << (cube)->dim)
+
+/* Whether this process is folded into another one. */
+#define IS_FOLDED(cube) ((cube)->rank >= CUBE_CORE_SIZE(cube))
+
+/* Whether reductions go through guarded_reduce(). */
+#define IS_GUARDED(cube)                                                      \
+    ((cube)->config.backend == BACKEND_HYPERCUBE                              \
+        && ((cube)->config.timeout > 0 || (cube)->config.resilient))
+
+static void get_neighbors(const struct cube *cube, int *neighbors)
+{
+    for (int i = 0; i < cube->dim; i++)
+        neighbors[i] = cube->rank ^ (1 << i);
+}
+
+/* Sets up the two levels of a hierarchical hypercube: a communicator for the
+ * processes of every node, and a flat hypercube of node leaders. Ranks keep
+ * their order, so the first process of @cube is the first node leader.
+ * @cube: Hypercube being set up by cube_init()
+ */
+static void init_hierarchical(struct cube *cube)
+{
+    struct cube_config flat = cube->config;
+    flat.hierarchical = 0;
+
+    MPI_Check(MPI_Comm_split_type(cube->comm, MPI_COMM_TYPE_SHARED,
+        cube->rank, MPI_INFO_NULL, &cube->node));
+    int node_rank;
+    MPI_Check(MPI_Comm_rank(cube->node, &node_rank));
+
+    MPI_Comm leaders;
+    MPI_Check(MPI_Comm_split(cube->comm, node_rank == 0 ? 0 : MPI_UNDEFINED,
+        cube->rank, &leaders));
+    if (leaders == MPI_COMM_NULL)
+        return;
+
+    if (!(cube->leaders = malloc(sizeof *cube->leaders)))
+        fail(ERR_NO_MEM, "out of memory");
+    cube_init(cube->leaders, leaders, &flat);
+    cube->dim = cube->leaders->dim;
+}
+
+/* Sets up a hypercube over the processes of a communicator of any size. Its
+ * dimension is the largest one that fits in the communicator. Every topology
+ * the backend needs is created here once, so that reductions only move data.
+ * @cube: Hypercube to be set up
+ * @comm: Communicator containing the processes of the hypercube
+ * @config: Tunables of the hypercube
+ */
+void cube_init(
+    struct cube *cube, MPI_Comm comm, const struct cube_config *config)
+{
+    enum cube_backend backend = config->backend;
+
+    if (config->pipeline_depth < 1
+        || config->pipeline_depth > CUBE_MAX_PIPELINE_DEPTH)
+        fail(ERR_ARG, "invalid pipeline depth (%d)",
+            config->pipeline_depth);
+
+#ifndef HAVE_ULFM
+    if (config->resilient)
+        fail(ERR_ARG, "resilient hypercubes need a build with ULFM");
+#endif
+
+    memset(cube, 0, sizeof *cube);
+    cube->comm = comm;
+    cube->config = *config;
+    if (config->resilient) {
+        /* Failures are reported on a communicator of our own, which is
+         * the one revoked when they happen. */
+        MPI_Check(MPI_Comm_dup(comm, &cube->comm));
+        MPI_Check(
+            MPI_Comm_set_errhandler(cube->comm, MPI_ERRORS_RETURN));
+        comm = cube->comm;
+    }
+    cube->cart = MPI_COMM_NULL;
+    cube->core = MPI_COMM_NULL;
+    cube->node = MPI_COMM_NULL;
+    cube->win = MPI_WIN_NULL;
+    cube->shm = MPI_COMM_NULL;
+    cube->shm_win = MPI_WIN_NULL;
+    MPI_Check(MPI_Comm_rank(comm, &cube->rank));
+    MPI_Check(MPI_Comm_size(comm, &cube->size));
+
+    if (config->hierarchical) {
+        init_hierarchical(cube);
+        return;
+    }
+
+    int dim = 0;
+    while (dim < CUBE_MAX_DIM && (2 << dim) <= cube->size)
+        dim++;
+    cube->dim = dim;
+    size_t slots = dim ? (size_t)dim : 1; /* per-dimension array lengths */
+
+    /* The topologies only span the processes of the hypercube proper, which
+     * keep their ranks. */
+    cube->core = comm;
+    if (cube->size > CUBE_CORE_SIZE(cube)
+        && (backend == BACKEND_CART || backend == BACKEND_NEIGHBOR
+            || backend == BACKEND_RMA)) {
+        MPI_Check(MPI_Comm_split(comm, IS_FOLDED(cube) ? MPI_UNDEFINED : 0,
+            cube->rank, &cube->core));
+    }
+
+    cube->neighbors = malloc(slots * sizeof *cube->neighbors);
+    if (!cube->neighbors)
+        fail(ERR_NO_MEM, "out of memory");
+    get_neighbors(cube, cube->neighbors);
+
+    /* Partners on the same node as us are found through the ranks they
+     * have in the shared-memory communicator of the node. */
+    if (backend == BACKEND_HYPERCUBE && config->shared_memory) {
+        MPI_Check(MPI_Comm_split_type(comm,
+            IS_FOLDED(cube) ? MPI_UNDEFINED : MPI_COMM_TYPE_SHARED,
+            cube->rank, MPI_INFO_NULL, &cube->shm));
+    }
+    if (cube->shm != MPI_COMM_NULL) {
+        MPI_Group group, shm_group;
+        cube->shm_ranks = malloc(slots * sizeof *cube->shm_ranks);
+        cube->shm_peers = calloc(slots, sizeof *cube->shm_peers);
+        if (!cube->shm_ranks || !cube->shm_peers)
+            fail(ERR_NO_MEM, "out of memory");
+        MPI_Check(MPI_Comm_group(comm, &group));
+        MPI_Check(MPI_Comm_group(cube->shm, &shm_group));
+        MPI_Check(MPI_Group_translate_ranks(
+            group, dim, cube->neighbors, shm_group, cube->shm_ranks));
+        MPI_Check(MPI_Group_free(&shm_group));
+        MPI_Check(MPI_Group_free(&group));
+    }
+
+    /* Compress the rounds asked for, or else the ones leaving the node. */
+    if (backend == BACKEND_HYPERCUBE && config->codec != CODEC_NONE) {
+        uint32_t all = (uint32_t)(((uint64_t)1 << dim) - 1);
+        MPI_Comm node;
+        MPI_Check(MPI_Comm_split_type(comm,
+            IS_FOLDED(cube) || config->codec_dims ? MPI_UNDEFINED
+                                                  : MPI_COMM_TYPE_SHARED,
+            cube->rank, MPI_INFO_NULL, &node));
+        cube->codec_dims = config->codec_dims & all;
+        if (node != MPI_COMM_NULL) {
+            MPI_Group group, node_group;
+            int node_ranks[CUBE_MAX_DIM];
+            MPI_Check(MPI_Comm_group(comm, &group));
+            MPI_Check(MPI_Comm_group(node, &node_group));
+            MPI_Check(MPI_Group_translate_ranks(
+                group, dim, cube->neighbors, node_group, node_ranks));
+            for (int i = 0; i < dim; i++) {
+                if (node_ranks[i] == MPI_UNDEFINED)
+                    cube->codec_dims |= (uint32_t)1 << i;
+            }
+            MPI_Check(MPI_Group_free(&node_group));
+            MPI_Check(MPI_Group_free(&group));
+            MPI_Check(MPI_Comm_free(&node));
+        }
+    }
+
+    if (IS_FOLDED(cube))
+        return;
+    if (backend == BACKEND_CART) {
+        /* A periodic dimension of size two has the same process on both
+         * sides, which is the partner in that dimension. The library may
+         * reorder ranks to match the physical topology. */
+        int *dims = malloc(slots * sizeof *dims);
+        int *periods = malloc(slots * sizeof *periods);
+        cube->cart_partners = malloc(slots * sizeof *cube->cart_partners);
+        if (!dims || !periods || !cube->cart_partners)
+            fail(ERR_NO_MEM, "out of memory");
+        for (int i = 0; i < dim; i++) {
+            dims[i] = 2;
+            periods[i] = 1;
+        }
+        MPI_Check(
+            MPI_Cart_create(cube->core, dim, dims, periods, 1, &cube->cart));
+        for (int i = 0; i < dim; i++) {
+            int source;
+            MPI_Check(MPI_Cart_shift(
+                cube->cart, i, 1, &source, &cube->cart_partners[i]));
+        }
+        free(dims);
+        free(periods);
+    } else if (backend == BACKEND_NEIGHBOR) {
+        /* One single-neighbor graph per dimension, so that every round is a
+         * neighborhood collective of its own. */
+        int weight = 1;
+        cube->graphs = malloc(slots * sizeof *cube->graphs);
+        if (!cube->graphs)
+            fail(ERR_NO_MEM, "out of memory");
+        for (int i = 0; i < dim; i++) {
+            MPI_Check(MPI_Dist_graph_create_adjacent(cube->core, 1,
+                &cube->neighbors[i], &weight, 1, &cube->neighbors[i], &weight,
+                MPI_INFO_NULL, 0, &cube->graphs[i]));
+        }
+    } else if (backend == BACKEND_RMA) {
+        /* Every round is an access and exposure epoch with the partner
+         * only. The window itself is sized by the first reduction. */
+        MPI_Group group;
+        MPI_Check(MPI_Comm_group(cube->core, &group));
+        cube->groups = malloc(slots * sizeof *cube->groups);
+        if (!cube->groups)
+            fail(ERR_NO_MEM, "out of memory");
+        for (int i = 0; i < dim; i++) {
+            MPI_Check(MPI_Group_incl(
+                group, 1, &cube->neighbors[i], &cube->groups[i]));
+        }
+        MPI_Check(MPI_Group_free(&group));
+    }
+}
+
+/* Address of the partial at index @i of a buffer of partials of @op. */
+#define AT(buf, i, op) ((char *)(buf) + (size_t)(i) * (op)->size)
+
+/* Bytes taken by @n partials of @op. */
+#define BYTES(n, op) ((size_t)(n) * (op)->size)
+
+/* Carries out one butterfly round of dimension @i with the buffer split into
+ * segments. Up to pipeline_depth segments are in flight at any time, and
+ * every segment is combined as soon as it arrives, while the following ones
+ * are still on the wire.
+ * @cube: Hypercube
+ * @buf: Local partials, combined in place
+ * @tmp: Scratch space for pipeline_depth segments
+ * @count: Number of partials in the buffer
+ * @seg: Number of partials per segment
+ * @i: Dimension of the round
+ * @op: Operator
+ */
+static void pipelined_round(struct cube *cube, void *buf, void *tmp,
+    int count, int seg, int i, const struct op *op)
+{
+    int depth = cube->config.pipeline_depth, partner = cube->neighbors[i];
+    int nseg = (count + seg - 1) / seg;
+    MPI_Request reqs[2 * CUBE_MAX_PIPELINE_DEPTH];
+
+#define SEG_LEN(j) ((j) == nseg - 1 ? count - (j) * seg : seg)
+#define POST_SEGMENT(j)                                                       \
+    __extension__({                                                           \
+        int _slot = (j) % depth;                                              \
+        MPI_Check(MPI_Irecv(AT(tmp, _slot * seg, op), SEG_LEN(j), op->type,   \
+            partner, 0, cube->comm, &reqs[2 * _slot]));                       \
+        MPI_Check(MPI_Isend(AT(buf, (j) * seg, op), SEG_LEN(j), op->type,     \
+            partner, 0, cube->comm, &reqs[2 * _slot + 1]));                   \
+    })
+
+    for (int j = 0; j < depth && j < nseg; j++)
+        POST_SEGMENT(j);
+    for (int j = 0; j < nseg; j++) {
+        int slot = j % depth;
+        TRACED(TRACE_WAIT, i, BYTES(SEG_LEN(j), op),
+            MPI_Check(
+                MPI_Waitall(2, &reqs[2 * slot], MPI_STATUSES_IGNORE)));
+        TRACED(TRACE_COMBINE, i, 0,
+            op_combine(op, AT(buf, j * seg, op), AT(tmp, slot * seg, op),
+                (size_t)SEG_LEN(j)));
+        if (j + depth < nseg)
+            POST_SEGMENT(j + depth);
+    }
+
+#undef POST_SEGMENT
+#undef SEG_LEN
+}
+
+/* Carries out one butterfly round of dimension @i through the codec. The
+ * encoded buffers of both partners may differ in length, so the partner's
+ * is received into room for the largest one and measured on arrival.
+ * Lossy codecs also round the local partials the way the partner gets
+ * them, so that both partners combine the same operands and keep the same
+ * result.
+ * @cube: Hypercube
+ * @buf: Local partials, combined in place
+ * @tmp: Scratch space for the partner's partials
+ * @enc: Scratch space for our encoded partials, of codec_bound() bytes
+ * @dec: Scratch space for the partner's encoded partials, as large
+ * @count: Number of partials in the buffer
+ * @i: Dimension of the round
+ * @op: Operator
+ */
+static void codec_round(struct cube *cube, void *buf, void *tmp, void *enc,
+    void *dec, int count, int i, const struct op *op)
+{
+    size_t bound = codec_bound(op, (size_t)count), len;
+    MPI_Status status;
+    int recv_len;
+
+    TRACED(TRACE_CODEC, i, 0,
+        len = codec_encode(
+            cube->config.codec, op, enc, buf, (size_t)count, tmp));
+    TRACED(TRACE_WAIT, i, len,
+        MPI_Check(MPI_Sendrecv(enc, (int)len, MPI_BYTE, cube->neighbors[i],
+            0, dec, (int)bound, MPI_BYTE, cube->neighbors[i], 0, cube->comm,
+            &status)));
+    MPI_Check(MPI_Get_count(&status, MPI_BYTE, &recv_len));
+    if (cube->config.codec == CODEC_F16 || cube->config.codec == CODEC_BF16)
+        TRACED(TRACE_CODEC, i, 0,
+            codec_decode(op, buf, enc, len, (size_t)count, tmp));
+    TRACED(TRACE_CODEC, i, 0,
+        codec_decode(op, tmp, dec, (size_t)recv_len, (size_t)count, enc));
+    TRACED(TRACE_COMBINE, i, 0, op_combine(op, buf, tmp, (size_t)count));
+}
+
+/* Ranges of the buffer swapped in one round of recursive halving. */
+struct halving_step {
+    int send_lo, send_hi; /* half handed over to the partner */
+    int keep_lo, keep_hi; /* half combined with the partner's */
+};
+
+/* Works out the rounds of recursive halving for this process. The
+ * reduce-scatter phase runs them from the highest dimension down; the
+ * allgather phase retraces them, sending the kept half of every round and
+ * receiving the half that was handed over.
+ * @cube: Hypercube
+ * @count: Number of partials in the buffer
+ * @steps: Receives one step per dimension
+ */
+static void halving_steps(
+    const struct cube *cube, int count, struct halving_step *steps)
+{
+    int cur_lo = 0, cur_hi = count;
+    for (int i = cube->dim - 1; i >= 0; i--) {
+        struct halving_step *step = &steps[i];
+        int mid = cur_lo + (cur_hi - cur_lo) / 2;
+        int upper = cube->rank & (1 << i);
+        step->keep_lo = upper ? mid : cur_lo;
+        step->keep_hi = upper ? cur_hi : mid;
+        step->send_lo = upper ? cur_lo : mid;
+        step->send_hi = upper ? mid : cur_hi;
+        cur_lo = step->keep_lo;
+        cur_hi = step->keep_hi;
+    }
+}
+
+/* Makes sure the window of a BACKEND_RMA hypercube can take @size bytes of
+ * partials. Windows only grow, and every process of the hypercube proper
+ * must call this function with the same size.
+ * @cube: Hypercube
+ * @size: Bytes the window must hold
+ */
+static void rma_reserve(struct cube *cube, size_t size)
+{
+    if (cube->win != MPI_WIN_NULL && size <= cube->win_size)
+        return;
+    if (cube->win != MPI_WIN_NULL)
+        MPI_Check(MPI_Win_free(&cube->win));
+
+    /* Epochs only ever involve the partner of the round, never locks. */
+    MPI_Info info;
+    MPI_Check(MPI_Info_create(&info));
+    MPI_Check(MPI_Info_set(info, "no_locks", "true"));
+    MPI_Check(MPI_Info_set(info, "same_size", "true"));
+    MPI_Check(MPI_Win_allocate((MPI_Aint)(size ? size : 1), 1, info,
+        cube->core, &cube->win_base, &cube->win));
+    MPI_Check(MPI_Info_free(&info));
+    MPI_Check(MPI_Win_set_errhandler(cube->win, MPI_ERRORS_RETURN));
+    cube->win_size = size;
+}
+
+/* Carries out one butterfly round by putting the local partials straight
+ * into the window of the partner, without it taking part in the transfer.
+ * The exposure epoch of the next round only opens once this one has been
+ * combined, so a single landing area is enough.
+ * @cube: Hypercube
+ * @buf: Local partials, combined in place
+ * @count: Number of partials in the buffer
+ * @i: Dimension of the round
+ * @op: Operator
+ */
+static void rma_round(
+    struct cube *cube, void *buf, int count, int i, const struct op *op)
+{
+    double start = trace_begin();
+    MPI_Check(MPI_Win_post(cube->groups[i], 0, cube->win));
+    MPI_Check(MPI_Win_start(cube->groups[i], 0, cube->win));
+    MPI_Check(MPI_Put(buf, count, op->type, cube->neighbors[i], 0, count,
+        op->type, cube->win));
+    MPI_Check(MPI_Win_complete(cube->win));
+    MPI_Check(MPI_Win_wait(cube->win));
+    trace_end(TRACE_WAIT, i, BYTES(count, op), start);
+    TRACED(TRACE_COMBINE, i, 0,
+        op_combine(op, buf, cube->win_base, (size_t)count));
+}
+
+/* Control block at the start of the shared segment of every process. Flags
+ * are only written by the owner of the segment, and sit on cache lines of
+ * their own so that polling them does not disturb the other dimensions. */
+struct shm_flags {
+    uint64_t ready; /* last reduction whose partials were published */
+    uint64_t ack; /* last reduction the partner's partials were taken in */
+} __attribute__((aligned(ARENA_ALIGN)));
+
+struct shm_header {
+    struct shm_flags flags[CUBE_MAX_DIM];
+    uint64_t offsets[CUBE_MAX_DIM]; /* slot of every on-node dimension */
+};
+
+/* Spins before yielding the processor while waiting on a partner. */
+#define SHM_SPIN_LIMIT 1024
+
+/* Waits until the counter at @p reaches @val. */
+static void shm_wait(const uint64_t *p, uint64_t val)
+{
+    for (unsigned spins = 0; __atomic_load_n(p, __ATOMIC_ACQUIRE) < val;
+         spins++) {
+        if (spins < SHM_SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            __asm__ __volatile__("yield");
+#endif
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/* Makes sure the shared segment of this process has a slot of @size bytes
+ * for every dimension whose partner is on the same node, and finds the
+ * segments of those partners. Segments only grow, and every process of
+ * the hypercube proper must call this function with the same size.
+ * @cube: Hypercube
+ * @size: Bytes every slot must hold
+ */
+static void shm_reserve(struct cube *cube, size_t size)
+{
+    if (cube->shm_win != MPI_WIN_NULL && size <= cube->shm_size)
+        return;
+    if (cube->shm_win != MPI_WIN_NULL) {
+        MPI_Check(MPI_Win_unlock_all(cube->shm_win));
+        MPI_Check(MPI_Win_free(&cube->shm_win));
+    }
+
+    size_t len = ARENA_ROUND(sizeof(struct shm_header)), slot = len;
+    for (int i = 0; i < cube->dim; i++) {
+        if (cube->shm_ranks[i] != MPI_UNDEFINED)
+            len += ARENA_ROUND(size);
+    }
+
+    /* Segments may be placed close to their owner. */
+    MPI_Info info;
+    MPI_Check(MPI_Info_create(&info));
+    MPI_Check(MPI_Info_set(info, "alloc_shared_noncontig", "true"));
+    MPI_Check(MPI_Win_allocate_shared(
+        (MPI_Aint)len, 1, info, cube->shm, &cube->shm_base, &cube->shm_win));
+    MPI_Check(MPI_Info_free(&info));
+    MPI_Check(MPI_Win_set_errhandler(cube->shm_win, MPI_ERRORS_RETURN));
+
+    struct shm_header *header = cube->shm_base;
+    memset(header, 0, sizeof *header);
+    for (int i = 0; i < cube->dim; i++) {
+        if (cube->shm_ranks[i] != MPI_UNDEFINED) {
+            header->offsets[i] = slot;
+            slot += ARENA_ROUND(size);
+        }
+    }
+
+    /* The flags are accessed with atomics in a single passive epoch. */
+    MPI_Check(MPI_Win_lock_all(MPI_MODE_NOCHECK, cube->shm_win));
+    MPI_Check(MPI_Win_sync(cube->shm_win));
+    MPI_Check(MPI_Barrier(cube->shm));
+    MPI_Check(MPI_Win_sync(cube->shm_win));
+    for (int i = 0; i < cube->dim; i++) {
+        cube->shm_peers[i] = NULL;
+        if (cube->shm_ranks[i] == MPI_UNDEFINED)
+            continue;
+        MPI_Aint peer_len;
+        int disp_unit;
+        MPI_Check(MPI_Win_shared_query(cube->shm_win, cube->shm_ranks[i],
+            &peer_len, &disp_unit, &cube->shm_peers[i]));
+    }
+    cube->shm_size = size;
+    cube->shm_gen = 0;
+}
+
+/* Carries out one butterfly round with a partner on the same node through
+ * shared memory. The local partials are published in the slot of the
+ * dimension, and the partner's are combined straight from its own slot.
+ * A slot is only published again once the partner took in the previous
+ * partials of that slot.
+ * @cube: Hypercube
+ * @buf: Local partials, combined in place
+ * @count: Number of partials in the buffer
+ * @i: Dimension of the round
+ * @op: Operator
+ */
+static void shm_round(
+    struct cube *cube, void *buf, int count, int i, const struct op *op)
+{
+    struct shm_header *mine = cube->shm_base, *peer = cube->shm_peers[i];
+    uint64_t gen = cube->shm_gen;
+
+    double start = trace_begin();
+    shm_wait(&peer->flags[i].ack, gen - 1);
+    memcpy((char *)mine + mine->offsets[i], buf, (size_t)count * op->size);
+    __atomic_store_n(&mine->flags[i].ready, gen, __ATOMIC_RELEASE);
+
+    shm_wait(&peer->flags[i].ready, gen);
+    trace_end(TRACE_WAIT, i, BYTES(count, op), start);
+    TRACED(TRACE_COMBINE, i, 0,
+        op_combine(op, buf, (char *)peer + peer->offsets[i], (size_t)count));
+    __atomic_store_n(&mine->flags[i].ack, gen, __ATOMIC_RELEASE);
+}
+
+/* Gets the shared segments ready for a reduction of @count partials, if
+ * the hypercube uses them. */
+static void shm_begin(struct cube *cube, int count, const struct op *op)
+{
+    if (cube->shm == MPI_COMM_NULL)
+        return;
+    shm_reserve(cube, (size_t)count * op->size);
+    cube->shm_gen++;
+}
+
+/* Reduces a buffer with the recursive-halving algorithm. Every round swaps
+ * half of the remaining range with the partner, so that after the
+ * reduce-scatter phase each process owns the result for 1/2^dim of the
+ * buffer; the allgather phase then retraces the rounds in reverse. Every
+ * process sends and receives about twice the buffer size in total, instead
+ * of dim times the buffer size for the plain butterfly.
+ * @cube: Hypercube
+ * @buf: Local partials on entry, result on return
+ * @tmp: Scratch space for half the buffer
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+static void halving_reduce(
+    struct cube *cube, void *buf, void *tmp, int count, const struct op *op)
+{
+    struct halving_step steps[CUBE_MAX_DIM];
+    halving_steps(cube, count, steps);
+
+    /* Reduce-scatter. */
+    for (int i = cube->dim - 1; i >= 0; i--) {
+        const struct halving_step *step = &steps[i];
+        int send = step->send_hi - step->send_lo;
+        int keep = step->keep_hi - step->keep_lo;
+        TRACED(TRACE_WAIT, i, BYTES(send, op),
+            MPI_Check(MPI_Sendrecv(AT(buf, step->send_lo, op), send,
+                op->type, cube->neighbors[i], 0, tmp, keep, op->type,
+                cube->neighbors[i], 0, cube->comm, MPI_STATUS_IGNORE)));
+        TRACED(TRACE_COMBINE, i, 0,
+            op_combine(op, AT(buf, step->keep_lo, op), tmp, (size_t)keep));
+    }
+
+    /* Allgather. */
+    for (int i = 0; i < cube->dim; i++) {
+        const struct halving_step *step = &steps[i];
+        int keep = step->keep_hi - step->keep_lo;
+        TRACED(TRACE_WAIT, i, BYTES(keep, op),
+            MPI_Check(MPI_Sendrecv(AT(buf, step->keep_lo, op), keep,
+                op->type, cube->neighbors[i], 0, AT(buf, step->send_lo, op),
+                step->send_hi - step->send_lo, op->type, cube->neighbors[i],
+                0, cube->comm, MPI_STATUS_IGNORE)));
+    }
+}
+
+/* Acknowledges the failure of processes reported by @err on @comm, so that
+ * receives from any source on it go through again. Returns 1 if there was
+ * such a failure, or 0 if @err reports something else, as it always does
+ * without ULFM.
+ * @comm: Communicator the error was reported on
+ * @err: MPI error code
+ */
+int cube_ack_failure(MPI_Comm comm, int err)
+{
+#ifdef HAVE_ULFM
+    int cls;
+    MPI_Error_class(err, &cls);
+    if (cls == MPIX_ERR_PROC_FAILED || cls == MPIX_ERR_PROC_FAILED_PENDING) {
+        MPI_Check(MPIX_Comm_failure_ack(comm));
+        return 1;
+    }
+#else
+    (void)comm;
+    (void)err;
+#endif
+    return 0;
+}
+
+/* Returns @err if it reports the failure of a process, or the revocation
+ * that follows one, to a resilient hypercube. Any other error is fatal.
+ * @cube: Hypercube
+ * @err: MPI error code
+ * @expr: Call that failed
+ */
+static int check_failure(const struct cube *cube, int err, const char *expr)
+{
+#ifdef HAVE_ULFM
+    int cls;
+    MPI_Error_class(err, &cls);
+    if (cube->config.resilient
+        && (cls == MPIX_ERR_PROC_FAILED || cls == MPIX_ERR_REVOKED
+            || cls == MPIX_ERR_PROC_FAILED_PENDING))
+        return err;
+#else
+    (void)cube;
+#endif
+    handle_error(err, expr);
+}
+
+/* Sends @count partials from @send to process @peer and receives as many
+ * into @recv, either of which may be NULL, waiting at most the timeout of
+ * the hypercube. Without a reply by then, the rest of the reduction would
+ * hang just as well: the reduction fails with the partner at fault
+ * instead, unless the hypercube is resilient, which takes the partner for
+ * failed, see resilient_reduce().
+ * Returns MPI_SUCCESS, or the error reporting a failed process to a
+ * resilient hypercube, whose communicator is revoked then so that the
+ * other processes stop waiting on us.
+ * @cube: Hypercube
+ * @send: Partials sent, or NULL
+ * @recv: Receives the partner's partials, or NULL
+ * @count: Number of partials
+ * @op: Operator
+ * @peer: Partner, as a rank of the communicator of @cube
+ * @tag: Tag of the messages
+ */
+static int transfer(struct cube *cube, const void *send, void *recv,
+    int count, const struct op *op, int peer, int tag)
+{
+    MPI_Request reqs[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+    MPI_Status statuses[2];
+    double timeout = cube->config.timeout;
+    double deadline = MPI_Wtime() + timeout;
+    int err = MPI_SUCCESS, done = 0;
+
+    if (recv)
+        err = MPI_Irecv(
+            recv, count, op->type, peer, tag, cube->comm, &reqs[0]);
+    if (send && err == MPI_SUCCESS)
+        err = MPI_Isend(
+            send, count, op->type, peer, tag, cube->comm, &reqs[1]);
+    for (unsigned spins = 0; err == MPI_SUCCESS && !done; spins++) {
+        if (timeout <= 0) {
+            err = MPI_Waitall(2, reqs, statuses);
+            break;
+        }
+        err = MPI_Testall(2, reqs, &done, statuses);
+        if (err == MPI_SUCCESS && !done && MPI_Wtime() > deadline) {
+#ifdef HAVE_ULFM
+            if (cube->config.resilient) {
+                MPIX_Comm_revoke(cube->comm);
+                MPI_Waitall(2, reqs, MPI_STATUSES_IGNORE);
+                return MPIX_ERR_PROC_FAILED;
+            }
+#endif
+            fail(ERR_TIMEOUT,
+                "process %d of the hypercube did not answer within %g s",
+                peer, timeout);
+        }
+        if (spins >= SHM_SPIN_LIMIT)
+            sched_yield();
+    }
+    if (err == MPI_ERR_IN_STATUS) {
+        for (int j = 0; j < 2; j++) {
+            if (statuses[j].MPI_ERROR != MPI_SUCCESS
+                && statuses[j].MPI_ERROR != MPI_ERR_PENDING) {
+                err = statuses[j].MPI_ERROR;
+                break;
+            }
+        }
+    }
+    if (err == MPI_SUCCESS)
+        return err;
+
+    err = check_failure(cube, err, "transfer()");
+#ifdef HAVE_ULFM
+    /* Requests still pending complete once the communicator is revoked. */
+    MPIX_Comm_revoke(cube->comm);
+    MPI_Waitall(2, reqs, MPI_STATUSES_IGNORE);
+#endif
+    return err;
+}
+
+/* Reduces a buffer with the butterfly of BACKEND_HYPERCUBE, folding
+ * included, one transfer at a time: every transfer is waited on for at most
+ * the timeout of the hypercube, and the failure of a process is reported
+ * rather than fatal to a resilient hypercube. Rounds are neither pipelined
+ * nor compressed, nor go through shared memory. Returns MPI_SUCCESS, or the
+ * error reporting a failed process.
+ * @cube: Hypercube
+ * @buf: Local partials on entry, result on return
+ * @tmp: Scratch space for the partner's partials
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+static int guarded_reduce(
+    struct cube *cube, void *buf, void *tmp, int count, const struct op *op)
+{
+    int core_size = CUBE_CORE_SIZE(cube), err;
+    int fold = cube->rank + core_size;
+    double start = trace_begin();
+
+    if (IS_FOLDED(cube)) {
+        int peer = cube->rank - core_size;
+        err = transfer(cube, buf, NULL, count, op, peer, TAG_FOLD);
+        if (err == MPI_SUCCESS)
+            err = transfer(cube, NULL, buf, count, op, peer, TAG_FOLD);
+        trace_end(TRACE_FOLD, -1, BYTES(count, op), start);
+        return err;
+    }
+    if (fold < cube->size) {
+        err = transfer(cube, NULL, tmp, count, op, fold, TAG_FOLD);
+        if (err != MPI_SUCCESS)
+            return err;
+        trace_end(TRACE_FOLD, -1, 0, start);
+        TRACED(TRACE_COMBINE, -1, 0, op_combine(op, buf, tmp, (size_t)count));
+    }
+
+    for (int i = 0; i < cube->dim; i++) {
+        start = trace_begin();
+        err = transfer(cube, buf, tmp, count, op, cube->neighbors[i], 0);
+        if (err != MPI_SUCCESS)
+            return err;
+        trace_end(TRACE_WAIT, i, BYTES(count, op), start);
+        TRACED(TRACE_COMBINE, i, 0, op_combine(op, buf, tmp, (size_t)count));
+    }
+
+    if (fold < cube->size) {
+        start = trace_begin();
+        err = transfer(cube, buf, NULL, count, op, fold, TAG_FOLD);
+        trace_end(TRACE_FOLD, -1, BYTES(count, op), start);
+    }
+    return err;
+}
+
+#ifdef HAVE_ULFM
+/* Reduces a buffer across a resilient hypercube. Whenever processes fail,
+ * the survivors agree on it, shrink the communicator, rebuild the hypercube
+ * over it and run the butterfly again, without a global restart. The
+ * butterfly starts over from its first round rather than from the one that
+ * lost a partner: shrinking renumbers the survivors, and may fold some of
+ * them or drop a dimension, so the subcubes whose totals the earlier
+ * rounds combined are not those of the new hypercube. Partials of
+ * idempotent operators keep what the rounds carried out so far brought in,
+ * duplicates being harmless, so the values of failed processes may still
+ * be part of the result. Other operators start over from the local
+ * partials, and leave out the values of failed processes, which the
+ * smaller size of the hypercube tells. A partner that times out is taken
+ * for failed; if shrinking then finds no failed process, the reduction
+ * fails, since the partner is too slow rather than gone.
+ * @cube: Hypercube
+ * @buf: Local partials on entry, result on return
+ * @tmp: Scratch space for the partner's partials
+ * @orig: Scratch space for the local partials
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+static void resilient_reduce(struct cube *cube, void *buf, void *tmp,
+    void *orig, int count, const struct op *op)
+{
+    int idempotent = op_is_idempotent(op);
+    if (!idempotent)
+        memcpy(orig, buf, BYTES(count, op));
+
+    for (;;) {
+        /* Processes that got through find out here about the failures
+         * the others ran into. The outcome is agreed upon even when some
+         * failures are reported by the agreement itself. */
+        int ok = guarded_reduce(cube, buf, tmp, count, op) == MPI_SUCCESS;
+        MPIX_Comm_agree(cube->comm, &ok);
+        if (ok)
+            return;
+
+        MPI_Comm shrunk;
+        int size = cube->size;
+        struct cube_config config = cube->config;
+        MPI_Check(MPIX_Comm_shrink(cube->comm, &shrunk));
+        cube_free(cube);
+        cube_init(cube, shrunk, &config);
+        MPI_Check(MPI_Comm_free(&shrunk));
+        if (cube->size == size)
+            fail(ERR_TIMEOUT,
+                "a process of the hypercube did not answer within %g s",
+                config.timeout);
+        if (cube->rank == 0)
+            fprintf(stderr,
+                PROGNAME "(%d): warning: %d processes failed, reducing "
+                         "over the %d left\n",
+                g_rank, size - cube->size, cube->size);
+        if (!idempotent)
+            memcpy(buf, orig, BYTES(count, op));
+    }
+}
+#endif
+
+/* Returns the number of partials of scratch space cube_reduce() needs on
+ * this process for a buffer of @count partials, not counting the leaders of
+ * a hierarchical hypercube.
+ * @cube: Hypercube
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+static size_t scratch_len(
+    const struct cube *cube, int count, const struct op *op)
+{
+    enum cube_backend backend = cube->config.backend;
+    size_t seg = cube->config.segment_size / op->size;
+
+    if (cube->config.hierarchical || backend == BACKEND_REDUCE
+        || backend == BACKEND_ALLREDUCE || IS_FOLDED(cube))
+        return 0;
+    if (cube->rank + CUBE_CORE_SIZE(cube) < cube->size)
+        return (size_t)count;
+    if (backend == BACKEND_RMA)
+        return 0; /* partials land in the window */
+    if (backend == BACKEND_HYPERCUBE && seg > 0 && (size_t)count > seg) {
+        /* Compressed rounds are not pipelined. */
+        size_t len = (size_t)cube->config.pipeline_depth * seg;
+        return cube->codec_dims ? max(len, (size_t)count) : len;
+    }
+    if (backend == BACKEND_HALVING)
+        return (size_t)count / 2 + 1;
+    return (size_t)count;
+}
+
+/* Returns the bytes of each of the two buffers of encoded partials that
+ * cube_reduce() needs for a buffer of @count partials, or 0 if no round
+ * goes through the codec. */
+static size_t codec_len(
+    const struct cube *cube, int count, const struct op *op)
+{
+    if (!cube->codec_dims || IS_FOLDED(cube))
+        return 0;
+    size_t bound = codec_bound(op, (size_t)count);
+    if (bound > INT_MAX)
+        fail(ERR_ARG, "buffer of %d partials is too large to compress",
+            count);
+    return bound;
+}
+
+/* Returns the bytes of g_arena that cube_reduce() takes while it runs.
+ * @cube: Hypercube
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+size_t cube_scratch_size(
+    const struct cube *cube, int count, const struct op *op)
+{
+    if (cube->leaders)
+        return cube_scratch_size(cube->leaders, count, op);
+    if (IS_GUARDED(cube)) {
+        /* Any process may end up in the hypercube proper after failures,
+         * and resilient ones keep their local partials aside. */
+        return (cube->config.resilient ? 2 : 1)
+            * ARENA_ROUND(count ? BYTES(count, op) : 1);
+    }
+    size_t len = scratch_len(cube, count, op);
+    return (len ? ARENA_ROUND(len * op->size) : 0)
+        + 2 * ARENA_ROUND(codec_len(cube, count, op));
+}
+
+/* Reduces a buffer of partials element-wise across all the processes of the
+ * hypercube. On return, the first process of the hypercube holds the
+ * result; every process does for all backends but BACKEND_REDUCE.
+ * Folded processes hand their partials to their partner in the hypercube
+ * proper beforehand, and get the result back from it afterwards. Collective
+ * backends need no folding. Hypercubes with a timeout or resilient ones go
+ * through guarded_reduce(). Scratch space comes from g_arena, see
+ * cube_scratch_size().
+ * @cube: Hypercube
+ * @buf: Buffer holding the local partials on entry and the result on return
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+void cube_reduce(struct cube *cube, void *buf, int count, const struct op *op)
+{
+    if (cube->config.hierarchical) {
+        /* Only the leader of a node is the root of its reduction, and node
+         * leaders are the first process of their node. */
+        int node_rank;
+        MPI_Check(MPI_Comm_rank(cube->node, &node_rank));
+        TRACED(TRACE_COLLECTIVE, -1, BYTES(count, op),
+            MPI_Check(MPI_Reduce(node_rank == 0 ? MPI_IN_PLACE : buf, buf,
+                count, op->type, op->mpi_op, 0, cube->node)));
+        if (cube->leaders)
+            cube_reduce(cube->leaders, buf, count, op);
+        if (cube->config.backend != BACKEND_REDUCE) {
+            TRACED(TRACE_COLLECTIVE, -1, 0,
+                MPI_Check(MPI_Bcast(buf, count, op->type, 0, cube->node)));
+        }
+        return;
+    }
+
+    if (IS_GUARDED(cube)) {
+        size_t mark = arena_mark(&g_arena);
+        void *tmp = arena_alloc(&g_arena, BYTES(count, op));
+#ifdef HAVE_ULFM
+        if (cube->config.resilient) {
+            void *orig = arena_alloc(&g_arena, BYTES(count, op));
+            resilient_reduce(cube, buf, tmp, orig, count, op);
+            arena_release(&g_arena, mark);
+            return;
+        }
+#endif
+        guarded_reduce(cube, buf, tmp, count, op);
+        arena_release(&g_arena, mark);
+        return;
+    }
+
+    size_t seg = cube->config.segment_size / op->size;
+    int pipelined = cube->config.backend == BACKEND_HYPERCUBE && seg > 0
+        && (size_t)count > seg;
+    int collective = cube->config.backend == BACKEND_REDUCE
+        || cube->config.backend == BACKEND_ALLREDUCE;
+    int core_size = CUBE_CORE_SIZE(cube);
+    int fold = !collective && cube->rank + core_size < cube->size;
+    if (!collective && IS_FOLDED(cube)) {
+        double start = trace_begin();
+        MPI_Check(MPI_Send(buf, count, op->type, cube->rank - core_size,
+            TAG_FOLD, cube->comm));
+        MPI_Check(MPI_Recv(buf, count, op->type, cube->rank - core_size,
+            TAG_FOLD, cube->comm, MPI_STATUS_IGNORE));
+        trace_end(TRACE_FOLD, -1, BYTES(count, op), start);
+        return;
+    }
+
+    size_t mark = arena_mark(&g_arena);
+    size_t tmp_len = scratch_len(cube, count, op);
+    void *tmp = tmp_len ? arena_alloc(&g_arena, tmp_len * op->size) : NULL;
+    size_t enc_len = codec_len(cube, count, op);
+    void *enc = enc_len ? arena_alloc(&g_arena, enc_len) : NULL;
+    void *dec = enc_len ? arena_alloc(&g_arena, enc_len) : NULL;
+    if (fold) {
+        TRACED(TRACE_FOLD, -1, 0,
+            MPI_Check(MPI_Recv(tmp, count, op->type, cube->rank + core_size,
+                TAG_FOLD, cube->comm, MPI_STATUS_IGNORE)));
+        TRACED(TRACE_COMBINE, -1, 0, op_combine(op, buf, tmp, (size_t)count));
+    }
+
+    switch (cube->config.backend) {
+    case BACKEND_HYPERCUBE:
+        /* Swap partials with the neighbor in a single combined call, so
+         * that both directions of every round overlap, and combine them.
+         * Large buffers are pipelined in segments instead, partners on the
+         * same node may go through shared memory, and compressed rounds
+         * go through the codec. */
+        shm_begin(cube, count, op);
+        for (int i = 0; i < cube->dim; i++) {
+            if (cube->shm_peers && cube->shm_peers[i]) {
+                shm_round(cube, buf, count, i, op);
+                continue;
+            }
+            if (cube->codec_dims & (uint32_t)1 << i) {
+                codec_round(cube, buf, tmp, enc, dec, count, i, op);
+                continue;
+            }
+            if (pipelined) {
+                pipelined_round(cube, buf, tmp, count, (int)seg, i, op);
+                continue;
+            }
+            TRACED(TRACE_WAIT, i, BYTES(count, op),
+                MPI_Check(MPI_Sendrecv(buf, count, op->type,
+                    cube->neighbors[i], 0, tmp, count, op->type,
+                    cube->neighbors[i], 0, cube->comm, MPI_STATUS_IGNORE)));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, buf, tmp, (size_t)count));
+        }
+        break;
+    case BACKEND_REDUCE:
+        TRACED(TRACE_COLLECTIVE, -1, BYTES(count, op),
+            MPI_Check(MPI_Reduce(cube->rank == 0 ? MPI_IN_PLACE : buf, buf,
+                count, op->type, op->mpi_op, 0, cube->comm)));
+        break;
+    case BACKEND_ALLREDUCE:
+        TRACED(TRACE_COLLECTIVE, -1, BYTES(count, op),
+            MPI_Check(MPI_Allreduce(MPI_IN_PLACE, buf, count, op->type,
+                op->mpi_op, cube->comm)));
+        break;
+    case BACKEND_CART:
+        for (int i = 0; i < cube->dim; i++) {
+            TRACED(TRACE_WAIT, i, BYTES(count, op),
+                MPI_Check(MPI_Sendrecv(buf, count, op->type,
+                    cube->cart_partners[i], 0, tmp, count, op->type,
+                    cube->cart_partners[i], 0, cube->cart,
+                    MPI_STATUS_IGNORE)));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, buf, tmp, (size_t)count));
+        }
+        break;
+    case BACKEND_NEIGHBOR:
+        for (int i = 0; i < cube->dim; i++) {
+            TRACED(TRACE_WAIT, i, BYTES(count, op),
+                MPI_Check(MPI_Neighbor_alltoall(buf, count, op->type, tmp,
+                    count, op->type, cube->graphs[i])));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, buf, tmp, (size_t)count));
+        }
+        break;
+    case BACKEND_HALVING:
+        halving_reduce(cube, buf, tmp, count, op);
+        break;
+    case BACKEND_RMA:
+        rma_reserve(cube, (size_t)count * op->size);
+        for (int i = 0; i < cube->dim; i++)
+            rma_round(cube, buf, count, i, op);
+        break;
+    }
+
+    if (fold) {
+        TRACED(TRACE_FOLD, -1, BYTES(count, op),
+            MPI_Check(MPI_Send(buf, count, op->type, cube->rank + core_size,
+                TAG_FOLD, cube->comm)));
+    }
+    arena_release(&g_arena, mark);
+}
+
+/* Computes a prefix reduction of buffers of partials across all the
+ * processes of the communicator of the hypercube, folded ones included: on
+ * return, every process holds the element-wise combination of the partials
+ * of the processes ranked below it, and of its own unless @exclusive is
+ * set. The first process of an exclusive scan gets empty partials.
+ * Every round of the butterfly swaps the running total of a subcube with
+ * the partner, and totals coming from lower-ranked partners go into the
+ * prefix too. Partners past the end of the communicator are skipped: the
+ * totals missing their partials only ever reach processes ranked above
+ * those partials. Collective backends go through MPI_Scan() and
+ * MPI_Exscan() instead, and all the others through this butterfly over the
+ * communicator of the hypercube: segments, shared memory, codecs and
+ * timeouts only apply to reductions. Scratch space comes from g_arena, see
+ * cube_scan_scratch_size().
+ * @cube: Hypercube
+ * @buf: Buffer holding the local partials on entry and the prefix on return
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ * @exclusive: Leave the local partials out of the prefix
+ */
+void cube_scan(struct cube *cube, void *buf, int count, const struct op *op,
+    int exclusive)
+{
+    enum cube_backend backend = cube->config.backend;
+    if (backend == BACKEND_REDUCE || backend == BACKEND_ALLREDUCE) {
+        if (!exclusive) {
+            TRACED(TRACE_COLLECTIVE, -1, BYTES(count, op),
+                MPI_Check(MPI_Scan(MPI_IN_PLACE, buf, count, op->type,
+                    op->mpi_op, cube->comm)));
+            return;
+        }
+        TRACED(TRACE_COLLECTIVE, -1, BYTES(count, op),
+            MPI_Check(MPI_Exscan(MPI_IN_PLACE, buf, count, op->type,
+                op->mpi_op, cube->comm)));
+        if (cube->rank == 0) {
+            for (int j = 0; j < count; j++)
+                op_local(op, AT(buf, j, op), NULL, 0, 0);
+        }
+        return;
+    }
+
+    size_t mark = arena_mark(&g_arena);
+    void *total = arena_alloc(&g_arena, BYTES(count, op));
+    void *tmp = arena_alloc(&g_arena, BYTES(count, op));
+    memcpy(total, buf, BYTES(count, op));
+    if (exclusive) {
+        for (int j = 0; j < count; j++)
+            op_local(op, AT(buf, j, op), NULL, 0, 0);
+    }
+
+    for (int i = 0; i < CUBE_MAX_DIM && (1 << i) < cube->size; i++) {
+        int partner = cube->rank ^ 1 << i;
+        if (partner >= cube->size)
+            continue;
+        TRACED(TRACE_WAIT, i, BYTES(count, op),
+            MPI_Check(MPI_Sendrecv(total, count, op->type, partner, 0, tmp,
+                count, op->type, partner, 0, cube->comm,
+                MPI_STATUS_IGNORE)));
+        double start = trace_begin();
+        if (partner < cube->rank)
+            op_combine(op, buf, tmp, (size_t)count);
+        op_combine(op, total, tmp, (size_t)count);
+        trace_end(TRACE_COMBINE, i, 0, start);
+    }
+    arena_release(&g_arena, mark);
+}
+
+/* Returns the bytes of g_arena that cube_scan() takes while it runs.
+ * @cube: Hypercube
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+size_t cube_scan_scratch_size(
+    const struct cube *cube, int count, const struct op *op)
+{
+    enum cube_backend backend = cube->config.backend;
+    if (backend == BACKEND_REDUCE || backend == BACKEND_ALLREDUCE)
+        return 0;
+    return 2 * ARENA_ROUND(count ? BYTES(count, op) : 1);
+}
+
+/* Sets up a reduction of the same buffer to be run any number of times with
+ * cube_plan_run(). Every transfer of the reduction is set up once as a
+ * persistent request, so that runs skip the matching and setup cost of
+ * every call, which dominates the latency of small buffers. The scratch
+ * space of the plan is taken from g_arena until cube_plan_free().
+ * Pipelined, hierarchical, compressed and guarded reductions, and
+ * collective ones before MPI 4, have no persistent form: their runs go
+ * through cube_reduce() instead.
+ * @plan: Plan to be set up
+ * @cube: Hypercube
+ * @buf: Buffer holding the local partials on entry to every run, and the
+ * result on return
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+void cube_plan_init(struct cube_plan *plan, struct cube *cube, void *buf,
+    int count, const struct op *op)
+{
+    enum cube_backend backend = cube->config.backend;
+    size_t seg = cube->config.segment_size / op->size;
+    int collective
+        = backend == BACKEND_REDUCE || backend == BACKEND_ALLREDUCE;
+    int core_size = CUBE_CORE_SIZE(cube);
+
+    memset(plan, 0, sizeof *plan);
+    plan->cube = cube;
+    plan->buf = buf;
+    plan->count = count;
+    plan->op = op;
+    plan->mark = arena_mark(&g_arena);
+    if (cube->config.hierarchical || cube->codec_dims || IS_GUARDED(cube)
+        || (backend == BACKEND_HYPERCUBE && seg > 0 && (size_t)count > seg))
+        return;
+#if MPI_VERSION < 4
+    if (collective || backend == BACKEND_NEIGHBOR)
+        return;
+#endif
+
+    /* Two requests for folding, then up to four per round. */
+    size_t tmp_len = scratch_len(cube, count, op);
+    plan->tmp = tmp_len ? arena_alloc(&g_arena, tmp_len * op->size) : NULL;
+    plan->num_reqs = 2 + 4 * cube->dim;
+    plan->reqs = malloc((size_t)plan->num_reqs * sizeof *plan->reqs);
+    if (!plan->reqs)
+        fail(ERR_NO_MEM, "out of memory");
+    for (int i = 0; i < plan->num_reqs; i++)
+        plan->reqs[i] = MPI_REQUEST_NULL;
+    plan->persistent = 1;
+
+    MPI_Request *req = plan->reqs;
+    if (!collective && IS_FOLDED(cube)) {
+        int peer = cube->rank - core_size;
+        MPI_Check(MPI_Send_init(
+            buf, count, op->type, peer, TAG_FOLD, cube->comm, &req[0]));
+        MPI_Check(MPI_Recv_init(
+            buf, count, op->type, peer, TAG_FOLD, cube->comm, &req[1]));
+        return;
+    }
+    if (!collective && cube->rank + core_size < cube->size) {
+        int peer = cube->rank + core_size;
+        MPI_Check(MPI_Recv_init(
+            plan->tmp, count, op->type, peer, TAG_FOLD, cube->comm, &req[0]));
+        MPI_Check(MPI_Send_init(
+            buf, count, op->type, peer, TAG_FOLD, cube->comm, &req[1]));
+    }
+    req += 2;
+
+    struct halving_step steps[CUBE_MAX_DIM];
+    switch (backend) {
+    case BACKEND_HYPERCUBE:
+    case BACKEND_CART:
+        if (cube->shm != MPI_COMM_NULL)
+            shm_reserve(cube, (size_t)count * op->size);
+        for (int i = 0; i < cube->dim; i++, req += 4) {
+            if (cube->shm_peers && cube->shm_peers[i])
+                continue;
+            MPI_Comm comm = backend == BACKEND_CART ? cube->cart : cube->comm;
+            int partner = backend == BACKEND_CART ? cube->cart_partners[i]
+                                                  : cube->neighbors[i];
+            MPI_Check(MPI_Recv_init(
+                plan->tmp, count, op->type, partner, 0, comm, &req[0]));
+            MPI_Check(MPI_Send_init(
+                buf, count, op->type, partner, 0, comm, &req[1]));
+        }
+        break;
+    case BACKEND_HALVING:
+        halving_steps(cube, count, steps);
+        for (int i = 0; i < cube->dim; i++, req += 4) {
+            const struct halving_step *step = &steps[i];
+            int keep = step->keep_hi - step->keep_lo;
+            int send = step->send_hi - step->send_lo;
+            int partner = cube->neighbors[i];
+            MPI_Check(MPI_Recv_init(plan->tmp, keep, op->type, partner, 0,
+                cube->comm, &req[0]));
+            MPI_Check(MPI_Send_init(AT(buf, step->send_lo, op), send,
+                op->type, partner, 0, cube->comm, &req[1]));
+            MPI_Check(MPI_Recv_init(AT(buf, step->send_lo, op), send,
+                op->type, partner, 0, cube->comm, &req[2]));
+            MPI_Check(MPI_Send_init(AT(buf, step->keep_lo, op), keep,
+                op->type, partner, 0, cube->comm, &req[3]));
+        }
+        break;
+    case BACKEND_RMA:
+        /* Puts need no setup beyond the window. */
+        rma_reserve(cube, (size_t)count * op->size);
+        break;
+#if MPI_VERSION >= 4
+    case BACKEND_REDUCE:
+        MPI_Check(MPI_Reduce_init(cube->rank == 0 ? MPI_IN_PLACE : buf, buf,
+            count, op->type, op->mpi_op, 0, cube->comm, MPI_INFO_NULL, req));
+        break;
+    case BACKEND_ALLREDUCE:
+        MPI_Check(MPI_Allreduce_init(MPI_IN_PLACE, buf, count, op->type,
+            op->mpi_op, cube->comm, MPI_INFO_NULL, req));
+        break;
+    case BACKEND_NEIGHBOR:
+        for (int i = 0; i < cube->dim; i++, req += 4) {
+            MPI_Check(MPI_Neighbor_alltoall_init(buf, count, op->type,
+                plan->tmp, count, op->type, cube->graphs[i], MPI_INFO_NULL,
+                req));
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+/* Starts some of the persistent requests of a plan and waits for them,
+ * as a span of @phase sending @bytes in dimension @dim. */
+static inline void run_requests(MPI_Request *reqs, int n,
+    enum trace_phase phase, int dim, size_t bytes)
+{
+    double start = trace_begin();
+    MPI_Check(MPI_Startall(n, reqs));
+    MPI_Check(MPI_Waitall(n, reqs, MPI_STATUSES_IGNORE));
+    trace_end(phase, dim, bytes, start);
+}
+
+/* Runs a reduction set up by cube_plan_init(), with the same outcome as
+ * cube_reduce() on the buffer of the plan.
+ * @plan: Plan
+ */
+void cube_plan_run(struct cube_plan *plan)
+{
+    struct cube *cube = plan->cube;
+    const struct op *op = plan->op;
+    void *buf = plan->buf, *tmp = plan->tmp;
+    int count = plan->count;
+    MPI_Request *req = plan->reqs;
+
+    if (!plan->persistent) {
+        cube_reduce(cube, buf, count, op);
+        return;
+    }
+
+    /* Folded processes send their partials, then wait for the result. */
+    int fold = req[0] != MPI_REQUEST_NULL;
+    if (fold && IS_FOLDED(cube)) {
+        run_requests(&req[0], 1, TRACE_FOLD, -1, BYTES(count, op));
+        run_requests(&req[1], 1, TRACE_FOLD, -1, 0);
+        return;
+    }
+    if (fold) {
+        run_requests(&req[0], 1, TRACE_FOLD, -1, 0);
+        TRACED(TRACE_COMBINE, -1, 0, op_combine(op, buf, tmp, (size_t)count));
+    }
+    req += 2;
+
+    struct halving_step steps[CUBE_MAX_DIM];
+    switch (cube->config.backend) {
+    case BACKEND_HYPERCUBE:
+    case BACKEND_CART:
+        shm_begin(cube, count, op);
+        for (int i = 0; i < cube->dim; i++) {
+            if (cube->shm_peers && cube->shm_peers[i]) {
+                shm_round(cube, buf, count, i, op);
+                continue;
+            }
+            run_requests(&req[4 * i], 2, TRACE_WAIT, i, BYTES(count, op));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, buf, tmp, (size_t)count));
+        }
+        break;
+    case BACKEND_NEIGHBOR:
+        for (int i = 0; i < cube->dim; i++) {
+            run_requests(&req[4 * i], 1, TRACE_WAIT, i, BYTES(count, op));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, buf, tmp, (size_t)count));
+        }
+        break;
+    case BACKEND_HALVING:
+        halving_steps(cube, count, steps);
+        for (int i = cube->dim - 1; i >= 0; i--) {
+            const struct halving_step *step = &steps[i];
+            run_requests(&req[4 * i], 2, TRACE_WAIT, i,
+                BYTES(step->send_hi - step->send_lo, op));
+            TRACED(TRACE_COMBINE, i, 0,
+                op_combine(op, AT(buf, step->keep_lo, op), tmp,
+                    (size_t)(step->keep_hi - step->keep_lo)));
+        }
+        for (int i = 0; i < cube->dim; i++) {
+            run_requests(&req[4 * i + 2], 2, TRACE_WAIT, i,
+                BYTES(steps[i].keep_hi - steps[i].keep_lo, op));
+        }
+        break;
+    case BACKEND_REDUCE:
+    case BACKEND_ALLREDUCE:
+        run_requests(&req[0], 1, TRACE_COLLECTIVE, -1, BYTES(count, op));
+        break;
+    case BACKEND_RMA:
+        for (int i = 0; i < cube->dim; i++)
+            rma_round(cube, buf, count, i, op);
+        break;
+    }
+
+    if (fold)
+        run_requests(&plan->reqs[1], 1, TRACE_FOLD, -1, BYTES(count, op));
+}
+
+/* Releases the requests and the scratch space of a plan set up by
+ * cube_plan_init(). Nothing may have been taken from g_arena after the plan
+ * was set up and not handed back since.
+ * @plan: Plan
+ */
+void cube_plan_free(struct cube_plan *plan)
+{
+    for (int i = 0; i < plan->num_reqs; i++) {
+        if (plan->reqs[i] != MPI_REQUEST_NULL)
+            MPI_Check(MPI_Request_free(&plan->reqs[i]));
+    }
+    free(plan->reqs);
+    arena_release(&g_arena, plan->mark);
+}
+
+/* Returns the number of rounds of a reduction started by cube_ireduce(),
+ * not counting folding. */
+static int ireduce_rounds(const struct cube *cube)
+{
+    switch (cube->config.backend) {
+    case BACKEND_REDUCE:
+    case BACKEND_ALLREDUCE:
+        return 1;
+    case BACKEND_HALVING:
+        return 2 * cube->dim;
+    default:
+        return cube->dim;
+    }
+}
+
+/* Returns the number of partials a step of a reduction started by
+ * cube_ireduce() swaps at once: as many segments as the pipeline holds
+ * when rounds are pipelined, the whole buffer otherwise. */
+static int ireduce_batch(const struct cube_request *req)
+{
+    const struct cube *cube = req->cube;
+    size_t seg = cube->config.segment_size / req->op->size;
+
+    if (cube->config.backend != BACKEND_HYPERCUBE || seg == 0
+        || (size_t)req->count <= seg)
+        return req->count;
+    size_t batch = (size_t)cube->config.pipeline_depth * seg;
+    return batch < (size_t)req->count ? (int)batch : req->count;
+}
+
+/* Returns whether a hypercube can start reductions with cube_ireduce().
+ * Hierarchical, compressed, guarded and shared-memory ones cannot: their
+ * rounds wait on collectives, on encoded buffers of unknown length, on
+ * deadlines or on flags in shared memory respectively. The answer only
+ * depends on the settings, so that all processes agree on it whichever
+ * rounds they take part in.
+ * @cube: Hypercube
+ */
+int cube_can_ireduce(const struct cube *cube)
+{
+    return !cube->config.hierarchical && cube->config.codec == CODEC_NONE
+        && !cube->config.shared_memory && !IS_GUARDED(cube);
+}
+
+/* Posts the transfers of the current step of a reduction started by
+ * cube_ireduce(). Step 0 hands the partials of folded processes over to
+ * the hypercube proper, the last step hands the result back to them, and
+ * the steps in between are the rounds of the backend; recursive halving
+ * runs its reduce-scatter phase before its allgather phase. Pipelined
+ * rounds swap one batch of segments at a time, from the offset of the
+ * reduction on, and BACKEND_RMA rounds open an exposure epoch of the
+ * window, whose closing is awaited instead of transfers. Steps that have
+ * nothing to transfer on this process post nothing.
+ * @req: Reduction
+ */
+static void ireduce_post(struct cube_request *req)
+{
+    struct cube *cube = req->cube;
+    const struct op *op = req->op;
+    void *buf = req->buf, *tmp = req->tmp;
+    int count = req->count, last = req->num_steps - 1;
+    enum cube_backend backend = cube->config.backend;
+    int collective
+        = backend == BACKEND_REDUCE || backend == BACKEND_ALLREDUCE;
+    int core_size = CUBE_CORE_SIZE(cube);
+
+    if (!collective && IS_FOLDED(cube)) {
+        int peer = cube->rank - core_size;
+        if (req->step == 0)
+            MPI_Check(MPI_Isend(buf, count, op->type, peer, TAG_FOLD,
+                cube->comm, &req->reqs[0]));
+        else if (req->step == last)
+            MPI_Check(MPI_Irecv(buf, count, op->type, peer, TAG_FOLD,
+                cube->comm, &req->reqs[0]));
+        return;
+    }
+    if (req->step == 0 || req->step == last) {
+        if (collective || cube->rank + core_size >= cube->size)
+            return;
+        int peer = cube->rank + core_size;
+        if (req->step == 0)
+            MPI_Check(MPI_Irecv(tmp, count, op->type, peer, TAG_FOLD,
+                cube->comm, &req->reqs[0]));
+        else
+            MPI_Check(MPI_Isend(buf, count, op->type, peer, TAG_FOLD,
+                cube->comm, &req->reqs[0]));
+        return;
+    }
+
+    int i = req->step - 1, batch = ireduce_batch(req);
+    struct halving_step steps[CUBE_MAX_DIM];
+    switch (backend) {
+    case BACKEND_HYPERCUBE:
+        if (batch < count) {
+            int seg = (int)(cube->config.segment_size / op->size);
+            int end = min(req->offset + batch, count);
+            for (int lo = req->offset, j = 0; lo < end; lo += seg, j++) {
+                int len = min(seg, end - lo);
+                MPI_Check(MPI_Irecv(AT(tmp, lo - req->offset, op), len,
+                    op->type, cube->neighbors[i], 0, cube->comm,
+                    &req->reqs[2 * j]));
+                MPI_Check(MPI_Isend(AT(buf, lo, op), len, op->type,
+                    cube->neighbors[i], 0, cube->comm,
+                    &req->reqs[2 * j + 1]));
+            }
+            break;
+        }
+        /* fall through */
+    case BACKEND_CART: {
+        MPI_Comm comm = backend == BACKEND_CART ? cube->cart : cube->comm;
+        int partner = backend == BACKEND_CART ? cube->cart_partners[i]
+                                              : cube->neighbors[i];
+        MPI_Check(MPI_Irecv(
+            tmp, count, op->type, partner, 0, comm, &req->reqs[0]));
+        MPI_Check(MPI_Isend(
+            buf, count, op->type, partner, 0, comm, &req->reqs[1]));
+        break;
+    }
+    case BACKEND_NEIGHBOR:
+        MPI_Check(MPI_Ineighbor_alltoall(buf, count, op->type, tmp, count,
+            op->type, cube->graphs[i], &req->reqs[0]));
+        break;
+    case BACKEND_HALVING: {
+        halving_steps(cube, count, steps);
+        int reduce = i < cube->dim;
+        int j = reduce ? cube->dim - 1 - i : i - cube->dim;
+        const struct halving_step *step = &steps[j];
+        int send = step->send_hi - step->send_lo;
+        int keep = step->keep_hi - step->keep_lo;
+        void *in = reduce ? tmp : AT(buf, step->send_lo, op);
+        void *out = AT(buf, reduce ? step->send_lo : step->keep_lo, op);
+        MPI_Check(MPI_Irecv(in, reduce ? keep : send, op->type,
+            cube->neighbors[j], 0, cube->comm, &req->reqs[0]));
+        MPI_Check(MPI_Isend(out, reduce ? send : keep, op->type,
+            cube->neighbors[j], 0, cube->comm, &req->reqs[1]));
+        break;
+    }
+    case BACKEND_REDUCE:
+        MPI_Check(MPI_Ireduce(cube->rank == 0 ? MPI_IN_PLACE : buf, buf,
+            count, op->type, op->mpi_op, 0, cube->comm, &req->reqs[0]));
+        break;
+    case BACKEND_ALLREDUCE:
+        MPI_Check(MPI_Iallreduce(MPI_IN_PLACE, buf, count, op->type,
+            op->mpi_op, cube->comm, &req->reqs[0]));
+        break;
+    case BACKEND_RMA:
+        /* Closing the access epoch may wait for the partner to open its
+         * exposure epoch, which it does as soon as it reaches this round;
+         * the exposure epoch is only awaited by ireduce_progress(). */
+        MPI_Check(MPI_Win_post(cube->groups[i], 0, cube->win));
+        MPI_Check(MPI_Win_start(cube->groups[i], 0, cube->win));
+        MPI_Check(MPI_Put(buf, count, op->type, cube->neighbors[i], 0, count,
+            op->type, cube->win));
+        MPI_Check(MPI_Win_complete(cube->win));
+        req->epoch = 1;
+        break;
+    }
+}
+
+/* Combines the partials received in the current step of a reduction
+ * started by cube_ireduce(), once its transfers are complete.
+ * @req: Reduction
+ */
+static void ireduce_combine(struct cube_request *req)
+{
+    struct cube *cube = req->cube;
+    const struct op *op = req->op;
+    enum cube_backend backend = cube->config.backend;
+    int i = req->step - 1;
+
+    if (backend == BACKEND_REDUCE || backend == BACKEND_ALLREDUCE
+        || IS_FOLDED(cube) || req->step == req->num_steps - 1)
+        return;
+    if (req->step == 0) {
+        if (cube->rank + CUBE_CORE_SIZE(cube) < cube->size)
+            TRACED(TRACE_COMBINE, -1, 0,
+                op_combine(op, req->buf, req->tmp, (size_t)req->count));
+        return;
+    }
+    if (backend == BACKEND_RMA) {
+        TRACED(TRACE_COMBINE, i, 0,
+            op_combine(op, req->buf, cube->win_base, (size_t)req->count));
+        return;
+    }
+    if (backend != BACKEND_HALVING) {
+        int len = min(ireduce_batch(req), req->count - req->offset);
+        TRACED(TRACE_COMBINE, i, 0,
+            op_combine(op, AT(req->buf, req->offset, op), req->tmp,
+                (size_t)len));
+        return;
+    }
+    if (i < cube->dim) {
+        struct halving_step steps[CUBE_MAX_DIM];
+        halving_steps(cube, req->count, steps);
+        const struct halving_step *step = &steps[cube->dim - 1 - i];
+        TRACED(TRACE_COMBINE, cube->dim - 1 - i, 0,
+            op_combine(op, AT(req->buf, step->keep_lo, op), req->tmp,
+                (size_t)(step->keep_hi - step->keep_lo)));
+    }
+}
+
+/* Starts reducing a buffer of partials across the hypercube without
+ * waiting for the partners, with the same outcome as cube_reduce() once
+ * cube_test() or cube_wait() reports the reduction complete. Every round
+ * only goes as far as posting its transfers, and moves on to the next one
+ * when those calls find them complete, so the caller may compute in the
+ * meantime and should call cube_test() now and then for the reduction to
+ * progress. Only hypercubes for which cube_can_ireduce() holds may start
+ * one, and BACKEND_RMA ones set up their window first, which every process
+ * of the hypercube proper does at once when it grows. Scratch space is
+ * taken from g_arena until the reduction is complete, and nothing may be
+ * taken from it in the meantime and not handed back; the buffer must not
+ * be touched either. No other reduction may run over the hypercube while
+ * this one is in flight.
+ * @req: Receives the reduction in flight
+ * @cube: Hypercube
+ * @buf: Buffer holding the local partials on entry, and the result once
+ * the reduction is complete
+ * @count: Number of partials in the buffer
+ * @op: Operator
+ */
+void cube_ireduce(struct cube_request *req, struct cube *cube, void *buf,
+    int count, const struct op *op)
+{
+    memset(req, 0, sizeof *req);
+    for (size_t i = 0; i < sizeof req->reqs / sizeof *req->reqs; i++)
+        req->reqs[i] = MPI_REQUEST_NULL;
+    if (cube->config.backend == BACKEND_RMA && !IS_FOLDED(cube))
+        rma_reserve(cube, (size_t)count * op->size);
+
+    req->cube = cube;
+    req->buf = buf;
+    req->count = count;
+    req->op = op;
+    req->mark = arena_mark(&g_arena);
+    size_t tmp_len = scratch_len(cube, count, op);
+    req->tmp = tmp_len ? arena_alloc(&g_arena, tmp_len * op->size) : NULL;
+    req->num_steps = ireduce_rounds(cube) + 2;
+    ireduce_post(req);
+}
+
+/* Moves a reduction started by cube_ireduce() through every step whose
+ * transfers are complete, or until it is complete if @wait is set. Returns
+ * whether the reduction is complete. */
+static int ireduce_progress(struct cube_request *req, int wait)
+{
+    int num_reqs = (int)(sizeof req->reqs / sizeof *req->reqs);
+
+    while (req->step < req->num_steps) {
+        if (wait && req->epoch) {
+            TRACED(TRACE_WAIT, -1, 0, MPI_Check(MPI_Win_wait(req->cube->win)));
+        } else if (wait) {
+            TRACED(TRACE_WAIT, -1, 0,
+                MPI_Check(MPI_Waitall(
+                    num_reqs, req->reqs, MPI_STATUSES_IGNORE)));
+        } else {
+            int done;
+            if (req->epoch)
+                MPI_Check(MPI_Win_test(req->cube->win, &done));
+            else
+                MPI_Check(MPI_Testall(
+                    num_reqs, req->reqs, &done, MPI_STATUSES_IGNORE));
+            if (!done)
+                return 0;
+        }
+        req->epoch = 0;
+        ireduce_combine(req);
+
+        /* Pipelined rounds move on to their next batch of segments. */
+        int round = req->step > 0 && req->step < req->num_steps - 1
+            && !IS_FOLDED(req->cube);
+        if (round && (req->offset += ireduce_batch(req)) < req->count) {
+            ireduce_post(req);
+            continue;
+        }
+        req->offset = 0;
+        if (++req->step < req->num_steps)
+            ireduce_post(req);
+        else
+            arena_release(&g_arena, req->mark);
+    }
+    return 1;
+}
+
+/* Advances a reduction started by cube_ireduce() as far as its partners
+ * allow without waiting for them. Returns 1 if the reduction is complete,
+ * 0 if it is still in flight.
+ * @req: Reduction
+ */
+int cube_test(struct cube_request *req)
+{
+    return ireduce_progress(req, 0);
+}
+
+/* Waits until a reduction started by cube_ireduce() is complete.
+ * @req: Reduction
+ */
+void cube_wait(struct cube_request *req)
+{
+    ireduce_progress(req, 1);
+}
+
+/* Releases the topologies of a hypercube set up by cube_init(). The
+ * communicator of the hypercube is left alone.
+ * @cube: Hypercube
+ */
+void cube_free(struct cube *cube)
+{
+    if (cube->cart != MPI_COMM_NULL)
+        MPI_Check(MPI_Comm_free(&cube->cart));
+    if (cube->graphs) {
+        for (int i = 0; i < cube->dim; i++)
+            MPI_Check(MPI_Comm_free(&cube->graphs[i]));
+    }
+    if (cube->core != cube->comm && cube->core != MPI_COMM_NULL)
+        MPI_Check(MPI_Comm_free(&cube->core));
+    if (cube->leaders) {
+        MPI_Comm leaders = cube->leaders->comm;
+        cube_free(cube->leaders);
+        MPI_Check(MPI_Comm_free(&leaders));
+        free(cube->leaders);
+    }
+    if (cube->node != MPI_COMM_NULL)
+        MPI_Check(MPI_Comm_free(&cube->node));
+    if (cube->groups) {
+        for (int i = 0; i < cube->dim; i++)
+            MPI_Check(MPI_Group_free(&cube->groups[i]));
+    }
+    if (cube->win != MPI_WIN_NULL)
+        MPI_Check(MPI_Win_free(&cube->win));
+    if (cube->shm_win != MPI_WIN_NULL) {
+        MPI_Check(MPI_Win_unlock_all(cube->shm_win));
+        MPI_Check(MPI_Win_free(&cube->shm_win));
+    }
+    if (cube->shm != MPI_COMM_NULL)
+        MPI_Check(MPI_Comm_free(&cube->shm));
+    free(cube->shm_peers);
+    free(cube->shm_ranks);
+    free(cube->groups);
+    free(cube->graphs);
+    free(cube->cart_partners);
+    free(cube->neighbors);
+    if (cube->config.resilient)
+        MPI_Check(MPI_Comm_free(&cube->comm));
+    memset(cube, 0, sizeof *cube);
+}
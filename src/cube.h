@@ -0,0 +1,161 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_CUBE_H
+#define MPI_HYPERCUBE_CUBE_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "ops.h"
+
+/* Largest supported dimension of a hypercube. */
+#define CUBE_MAX_DIM 30
+
+/* Largest number of segments in flight when pipelining. */
+#define CUBE_MAX_PIPELINE_DEPTH 16
+
+/* Ways of carrying out the reduction across the workers. */
+enum cube_backend {
+    BACKEND_HYPERCUBE, /* hand-written butterfly over point-to-point */
+    BACKEND_REDUCE, /* MPI_Reduce to the first worker */
+    BACKEND_ALLREDUCE, /* MPI_Allreduce */
+    BACKEND_CART, /* butterfly over a periodic Cartesian topology */
+    BACKEND_NEIGHBOR, /* butterfly over neighborhood collectives */
+    BACKEND_HALVING, /* recursive-halving reduce-scatter plus allgather */
+    BACKEND_RMA, /* butterfly over one-sided puts into a window */
+};
+
+#define CUBE_NUM_BACKENDS (BACKEND_RMA + 1)
+
+/* Tunables of a hypercube. */
+struct cube_config {
+    enum cube_backend backend;
+    size_t segment_size; /* bytes per pipelined segment, 0 to disable */
+    int pipeline_depth; /* segments in flight when pipelining */
+    int hierarchical; /* reduce within nodes, then across node leaders */
+    int shared_memory; /* BACKEND_HYPERCUBE: go through shared memory with
+                        * partners on the same node */
+    enum codec_kind codec; /* BACKEND_HYPERCUBE: encoding of the partials
+                            * sent in compressed dimensions */
+    uint32_t codec_dims; /* compressed dimensions, as a bit mask; 0 for
+                          * the ones whose partner is on another node */
+    double timeout; /* BACKEND_HYPERCUBE: seconds a transfer may take
+                     * before the reduction gives up, 0 for no limit */
+    int resilient; /* BACKEND_HYPERCUBE: go on without failed processes,
+                    * which needs ULFM */
+};
+
+#define CUBE_CONFIG_INIT                                                      \
+    { BACKEND_HYPERCUBE, 0, 2, 0, 0, CODEC_NONE, 0, 0, 0 }
+
+/* Hypercube made of all the processes of a communicator. When the size of
+ * the communicator is not a power of two, the hypercube is made of the
+ * first 2^dim processes, and each of the remaining ones is folded into the
+ * process 2^dim ranks below it. Hierarchical hypercubes are instead made of
+ * the first process of every node, and the other processes of a node only
+ * talk to their leader. */
+struct cube {
+    MPI_Comm comm; /* resilient: a duplicate of our own, revoked and
+                    * shrunk when processes fail */
+    int rank, size, dim;
+    struct cube_config config;
+    MPI_Comm core; /* first 2^dim processes of @comm, or MPI_COMM_NULL */
+    int *neighbors; /* partner in every dimension, as ranks of @comm */
+    MPI_Comm cart; /* BACKEND_CART */
+    int *cart_partners; /* BACKEND_CART, as ranks of @cart */
+    MPI_Comm *graphs; /* BACKEND_NEIGHBOR, one per dimension */
+    MPI_Group *groups; /* BACKEND_RMA, the partner in every dimension */
+    MPI_Win win; /* BACKEND_RMA, exposing where partners put partials */
+    void *win_base;
+    size_t win_size;
+    MPI_Comm shm; /* shared memory: processes of the hypercube proper on our
+                   * node, or MPI_COMM_NULL */
+    int *shm_ranks; /* shared memory: partner in every dimension, as ranks
+                     * of @shm, or MPI_UNDEFINED if on another node */
+    MPI_Win shm_win; /* shared memory: segments of the processes of @shm */
+    void *shm_base; /* our own segment */
+    void **shm_peers; /* segment of the partner in every dimension */
+    size_t shm_size; /* bytes of partials per slot of the segments */
+    uint64_t shm_gen; /* reductions carried out through the segments */
+    uint32_t codec_dims; /* dimensions whose rounds go through the codec */
+    MPI_Comm node; /* hierarchical: processes sharing memory with us */
+    struct cube *leaders; /* hierarchical: hypercube of node leaders, or
+                           * NULL if we are not a leader */
+};
+
+/* Reduction of one buffer across a hypercube, set up once by
+ * cube_plan_init() and run any number of times. */
+struct cube_plan {
+    struct cube *cube;
+    void *buf; /* partials on entry to every run, result on return */
+    void *tmp; /* scratch space, from g_arena */
+    int count;
+    const struct op *op;
+    int persistent; /* runs go through cube_reduce() otherwise */
+    MPI_Request *reqs; /* folding, then four per dimension at most; unused
+                        * ones are MPI_REQUEST_NULL */
+    int num_reqs;
+    size_t mark; /* position of g_arena before the plan was set up */
+};
+
+/* Reduction of one buffer across a hypercube in flight, started by
+ * cube_ireduce() and advanced by cube_test() and cube_wait(). */
+struct cube_request {
+    struct cube *cube;
+    void *buf; /* partials on entry, result once complete */
+    void *tmp; /* scratch space, from g_arena */
+    int count;
+    const struct op *op;
+    int step; /* step whose transfers are in flight */
+    int num_steps; /* folding twice, then the rounds of the backend */
+    int offset; /* first partial of the segments in flight, when rounds are
+                 * pipelined */
+    int epoch; /* whether the step is an exposure epoch of the window, for
+                * BACKEND_RMA, rather than transfers */
+    MPI_Request reqs[2 * CUBE_MAX_PIPELINE_DEPTH]; /* transfers of the step,
+                                                    * MPI_REQUEST_NULL when
+                                                    * unused */
+    size_t mark; /* position of g_arena before the reduction started */
+};
+
+int cube_parse_backend(const char *name);
+const char *cube_backend_name(enum cube_backend backend);
+void cube_init(
+    struct cube *cube, MPI_Comm comm, const struct cube_config *config);
+void cube_reduce(struct cube *cube, void *buf, int count, const struct op *op);
+size_t cube_scratch_size(
+    const struct cube *cube, int count, const struct op *op);
+void cube_scan(struct cube *cube, void *buf, int count, const struct op *op,
+    int exclusive);
+size_t cube_scan_scratch_size(
+    const struct cube *cube, int count, const struct op *op);
+void cube_plan_init(struct cube_plan *plan, struct cube *cube, void *buf,
+    int count, const struct op *op);
+void cube_plan_run(struct cube_plan *plan);
+void cube_plan_free(struct cube_plan *plan);
+int cube_can_ireduce(const struct cube *cube);
+void cube_ireduce(struct cube_request *req, struct cube *cube, void *buf,
+    int count, const struct op *op);
+int cube_test(struct cube_request *req);
+void cube_wait(struct cube_request *req);
+void cube_free(struct cube *cube);
+int cube_ack_failure(MPI_Comm comm, int err);
+
+#endif /* MPI_HYPERCUBE_CUBE_H */
@@ -0,0 +1,228 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The C++ bindings of MPI are of no use here. */
+#define OMPI_SKIP_MPICXX 1
+
+#include <climits>
+#include <cstring>
+#include <cub/cub.cuh>
+#include <cuda_runtime.h>
+
+extern "C" {
+#include "common.h"
+#include "device.h"
+}
+
+#define CUDA_Check(v)                                                         \
+    do {                                                                      \
+        cudaError_t _err = v;                                                 \
+        if (_err != cudaSuccess)                                              \
+            fail(ERR_DEVICE, "CUDA error `%s' (`%s')",                        \
+                cudaGetErrorString(_err), #v);                                \
+    } while (0)
+
+/* Threads per block of the combine kernel, and largest number of blocks,
+ * beyond which every thread takes several partials. */
+#define COMBINE_THREADS 256
+#define COMBINE_MAX_BLOCKS 4096
+
+struct Max {
+    template <typename T>
+    __host__ __device__ T operator()(const T &a, const T &b) const
+    {
+        return b > a || b != b ? b : a;
+    }
+};
+
+struct Min {
+    template <typename T>
+    __host__ __device__ T operator()(const T &a, const T &b) const
+    {
+        return b < a || b != b ? b : a;
+    }
+};
+
+struct Sum {
+    template <typename T>
+    __host__ __device__ T operator()(const T &a, const T &b) const
+    {
+        return a + b;
+    }
+};
+
+struct Prod {
+    template <typename T>
+    __host__ __device__ T operator()(const T &a, const T &b) const
+    {
+        return a * b;
+    }
+};
+
+/* Scratch space of the CUB reductions, which only grows. */
+static void *g_temp;
+static size_t g_temp_size;
+
+/* Calls @f with a value of the element type of a plain operator and the
+ * functor combining two of them. */
+template <typename Op, typename F> static void dispatch_type(enum dtype t, F f)
+{
+    switch (t) {
+    case DTYPE_F64:
+        f(0.0, Op());
+        break;
+    case DTYPE_F32:
+        f(0.0f, Op());
+        break;
+    case DTYPE_I32:
+        f((int32_t)0, Op());
+        break;
+    case DTYPE_I64:
+        f((int64_t)0, Op());
+        break;
+    }
+}
+
+template <typename F> static void dispatch(const struct op *op, F f)
+{
+    switch (op->kind) {
+    case OP_MAX:
+        dispatch_type<Max>(op->dtype, f);
+        break;
+    case OP_MIN:
+        dispatch_type<Min>(op->dtype, f);
+        break;
+    case OP_SUM:
+        dispatch_type<Sum>(op->dtype, f);
+        break;
+    case OP_PROD:
+        dispatch_type<Prod>(op->dtype, f);
+        break;
+    default:
+        fail(ERR_ARG, "%s has no device kernel", op_name(op));
+    }
+}
+
+template <typename T, typename Op>
+__global__ void combine_kernel(T *inout, const T *in, size_t n, Op op)
+{
+    size_t stride = (size_t)blockDim.x * gridDim.x;
+    for (size_t i = blockIdx.x * (size_t)blockDim.x + threadIdx.x; i < n;
+         i += stride)
+        inout[i] = op(inout[i], in[i]);
+}
+
+/* Picks the device of this process among the ones of its node, round-robin.
+ * @node_rank: Rank of the process among the processes of its node
+ */
+void device_select(int node_rank)
+{
+    int count;
+    CUDA_Check(cudaGetDeviceCount(&count));
+    if (count == 0)
+        fail(ERR_DEVICE, "no CUDA device found");
+    CUDA_Check(cudaSetDevice(node_rank % count));
+}
+
+/* Returns @size bytes of device memory.
+ * @size: Number of bytes
+ */
+void *device_alloc(size_t size)
+{
+    void *p;
+    CUDA_Check(cudaMalloc(&p, size));
+    return p;
+}
+
+/* Releases device memory from device_alloc().
+ * @p: Device memory
+ */
+void device_free(void *p)
+{
+    CUDA_Check(cudaFree(p));
+}
+
+/* Copies @size bytes from host memory at @src to device memory at @dst. */
+void device_upload(void *dst, const void *src, size_t size)
+{
+    CUDA_Check(cudaMemcpy(dst, src, size, cudaMemcpyHostToDevice));
+}
+
+/* Copies @size bytes from device memory at @src to host memory at @dst. */
+void device_download(void *dst, const void *src, size_t size)
+{
+    CUDA_Check(cudaMemcpy(dst, src, size, cudaMemcpyDeviceToHost));
+}
+
+/* Reduces a block of values in device memory with CUB into a partial in
+ * device memory. Empty blocks give the identity of the operator.
+ * @op: Plain operator
+ * @partial: Receives the partial, in device memory
+ * @vals: Values to be reduced, in device memory
+ * @n: Number of values
+ */
+void device_local(
+    const struct op *op, void *partial, const void *vals, size_t n)
+{
+    int64_t identity;
+    op_local(op, &identity, NULL, 0, 0);
+    if (n > INT_MAX)
+        fail(ERR_ARG, "block of %zu values is too large for the device",
+            n);
+
+    dispatch(op, [&](auto zero, auto f) {
+        using T = decltype(zero);
+        T init;
+        memcpy(&init, &identity, sizeof init);
+        size_t bytes = 0;
+        CUDA_Check(cub::DeviceReduce::Reduce(NULL, bytes, (const T *)vals,
+            (T *)partial, (int)n, f, init));
+        if (bytes > g_temp_size) {
+            if (g_temp)
+                CUDA_Check(cudaFree(g_temp));
+            CUDA_Check(cudaMalloc(&g_temp, bytes));
+            g_temp_size = bytes;
+        }
+        CUDA_Check(cub::DeviceReduce::Reduce(g_temp, bytes, (const T *)vals,
+            (T *)partial, (int)n, f, init));
+    });
+    CUDA_Check(cudaStreamSynchronize(0));
+}
+
+/* Combines two buffers of partials in device memory element-wise.
+ * @op: Plain operator
+ * @inout: Partials combined in place, in device memory
+ * @in: Partials combined into @inout, in device memory
+ * @count: Number of partials
+ */
+void device_combine(
+    const struct op *op, void *inout, const void *in, size_t count)
+{
+    if (count == 0)
+        return;
+    size_t blocks = (count + COMBINE_THREADS - 1) / COMBINE_THREADS;
+    if (blocks > COMBINE_MAX_BLOCKS)
+        blocks = COMBINE_MAX_BLOCKS;
+
+    dispatch(op, [&](auto zero, auto f) {
+        using T = decltype(zero);
+        combine_kernel<<<(unsigned)blocks, COMBINE_THREADS>>>(
+            (T *)inout, (const T *)in, count, f);
+    });
+    CUDA_Check(cudaGetLastError());
+    CUDA_Check(cudaStreamSynchronize(0));
+}
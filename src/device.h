@@ -0,0 +1,49 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_DEVICE_H
+#define MPI_HYPERCUBE_DEVICE_H
+
+#include <stddef.h>
+
+#include "ops.h"
+
+/* Reductions of values held in the memory of a CUDA device, for
+ * ARENA_DEVICE. Only plain operators (max, min, sum and prod) have device
+ * kernels. Every call returns once the device is done, so that buffers can
+ * be handed to a CUDA-aware MPI library right away. Built with
+ * `make CUDA=1'. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void device_select(int node_rank);
+void *device_alloc(size_t size);
+void device_free(void *p);
+void device_upload(void *dst, const void *src, size_t size);
+void device_download(void *dst, const void *src, size_t size);
+void device_local(
+    const struct op *op, void *partial, const void *vals, size_t n);
+void device_combine(
+    const struct op *op, void *inout, const void *in, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MPI_HYPERCUBE_DEVICE_H */
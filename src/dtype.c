@@ -0,0 +1,103 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dtype.h"
+
+static const struct {
+    const char *name;
+    size_t size;
+} dtypes[] = {
+    [DTYPE_F64] = { "f64", sizeof(double) },
+    [DTYPE_F32] = { "f32", sizeof(float) },
+    [DTYPE_I32] = { "i32", sizeof(int32_t) },
+    [DTYPE_I64] = { "i64", sizeof(int64_t) },
+};
+
+/* Returns the element type with the given name, or -1 if there is none.
+ * @name: Name of the type
+ */
+int dtype_parse(const char *name)
+{
+    for (size_t i = 0; i < sizeof dtypes / sizeof *dtypes; i++) {
+        if (!strcmp(name, dtypes[i].name))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Returns the name of an element type.
+ * @t: Element type
+ */
+const char *dtype_name(enum dtype t)
+{
+    return dtypes[t].name;
+}
+
+/* Returns the size of an element type in bytes.
+ * @t: Element type
+ */
+size_t dtype_size(enum dtype t)
+{
+    return dtypes[t].size;
+}
+
+/* Returns the MPI datatype matching an element type.
+ * @t: Element type
+ */
+MPI_Datatype dtype_mpi(enum dtype t)
+{
+    switch (t) {
+    case DTYPE_F32:
+        return MPI_FLOAT;
+    case DTYPE_I32:
+        return MPI_INT32_T;
+    case DTYPE_I64:
+        return MPI_INT64_T;
+    case DTYPE_F64:
+        break;
+    }
+    return MPI_DOUBLE;
+}
+
+/* Writes a value as text that parses back to the same value. Returns the
+ * number of characters written, not counting the terminator.
+ * @t: Element type of the value
+ * @buf: Receives the text, of DTYPE_FORMAT_MAX characters at most
+ * @val: Value
+ */
+int dtype_format(enum dtype t, char *buf, const void *val)
+{
+    switch (t) {
+    case DTYPE_F32:
+        return snprintf(
+            buf, DTYPE_FORMAT_MAX, "%.9g", (double)*(const float *)val);
+    case DTYPE_I32:
+        return snprintf(
+            buf, DTYPE_FORMAT_MAX, "%" PRId32, *(const int32_t *)val);
+    case DTYPE_I64:
+        return snprintf(
+            buf, DTYPE_FORMAT_MAX, "%" PRId64, *(const int64_t *)val);
+    case DTYPE_F64:
+        break;
+    }
+    return snprintf(buf, DTYPE_FORMAT_MAX, "%.17g", *(const double *)val);
+}
@@ -0,0 +1,50 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_DTYPE_H
+#define MPI_HYPERCUBE_DTYPE_H
+
+#include <mpi.h>
+#include <stddef.h>
+
+/* Element types of the values being reduced. The numbering is the one used
+ * for data types in the header of binary input files. */
+enum dtype {
+    DTYPE_F64,
+    DTYPE_F32,
+    DTYPE_I32,
+    DTYPE_I64,
+};
+
+#define DTYPE_COUNT (DTYPE_I64 + 1)
+
+/* Returns 1 if @t is an integer type. */
+static inline int dtype_is_integer(enum dtype t)
+{
+    return t == DTYPE_I32 || t == DTYPE_I64;
+}
+
+int dtype_parse(const char *name);
+const char *dtype_name(enum dtype t);
+/* Longest text written by dtype_format(), terminator included. */
+#define DTYPE_FORMAT_MAX 32
+
+size_t dtype_size(enum dtype t);
+MPI_Datatype dtype_mpi(enum dtype t);
+int dtype_format(enum dtype t, char *buf, const void *val);
+
+#endif /* MPI_HYPERCUBE_DTYPE_H */
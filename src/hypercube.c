@@ -0,0 +1,784 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mpi.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "codec.h"
+#include "common.h"
+#include "cube.h"
+#include "device.h"
+#include "dtype.h"
+#include "hypercube.h"
+#include "kernels.h"
+#include "ops.h"
+#include "trace.h"
+
+/* The public enumerations of hypercube.h stand for the internal ones. */
+_Static_assert((int)HC_I64 == (int)DTYPE_I64, "enum hc_dtype");
+_Static_assert((int)HC_BACKEND_RMA == (int)BACKEND_RMA, "enum hc_backend");
+_Static_assert((int)HC_CODEC_BF16 == (int)CODEC_BF16, "enum hc_codec");
+_Static_assert((int)HC_ARENA_DEVICE == (int)ARENA_DEVICE, "enum hc_arena");
+_Static_assert((int)HC_ERR_DEVICE == (int)ERR_DEVICE, "enum hc_error");
+
+/* Reduction in flight. A context has room for a single one. */
+struct hc_request {
+    struct hc_ctx *ctx;
+    struct cube_request cube;
+    void *recvbuf;
+    int count;
+    int active;
+};
+
+/* Reduction context. Its operator must not move once set up, since the MPI
+ * datatype of the partials points back to it, see op_init(). */
+struct hc_ctx {
+    struct hc_config config;
+    MPI_Comm comm; /* duplicate of the communicator given to hc_init() */
+    struct op op;
+    struct cube cube;
+    struct arena arena; /* swapped into g_arena by every call */
+    void *buf; /* config.count partials */
+    struct cube_plan plan; /* persistent: reduction of @buf */
+    struct hc_request req;
+    int failed; /* error a call of the context ended with, if any */
+};
+
+/* Arguments of a call of the library, handed over to its body by
+ * guard(). */
+struct call {
+    struct hc_ctx *ctx;
+    MPI_Comm comm; /* hc_init(): communicator of the context */
+    const void *in;
+    void *out;
+    size_t n;
+    int64_t first;
+    int count;
+    int exclusive;
+    int wait; /* progress(): wait for the reduction to complete */
+    int done; /* progress(): receives whether it is complete */
+};
+
+int g_rank = -1, g_size = -1;
+
+/* Where to go back to when the call of the library running on this thread
+ * fails, see guard(), and the description of the last error one returned,
+ * see hc_last_error(). */
+static __thread jmp_buf *g_catch;
+static __thread char g_error[BUFSIZ];
+
+/* Describes an error about to be returned by a call of the library.
+ * Returns @err. */
+static int __attribute__((format(printf, 2, 3)))
+error(int err, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(g_error, sizeof g_error, fmt, ap);
+    va_end(ap);
+    return err;
+}
+
+/* Gives up on whatever the reduction modules were carrying out. Within a
+ * call of the library, the call returns @err at once; anywhere else, the
+ * program is aborted the way fatal() does it.
+ * @err: Error, one of enum error
+ * @fmt: Description of the error, as for printf()
+ */
+void fail(int err, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(g_error, sizeof g_error, fmt, ap);
+    va_end(ap);
+    if (g_catch)
+        longjmp(*g_catch, err);
+    fatal("%s", g_error);
+}
+
+/* Generic MPI error handler.
+ * This function gets called from within the MPI_Check() macro in case a MPI
+ * call does not succeed. Do not attempt to call this handler manually.
+ * This function does not return, see fail().
+ * @mpi_error: MPI status code
+ * @expr: Failing expression
+ */
+void __attribute__((noreturn)) handle_error(int mpi_error, const char *expr)
+{
+    char msg_buf[MPI_MAX_ERROR_STRING];
+    int msg_len = -1;
+
+    if (MPI_Error_string(mpi_error, msg_buf, &msg_len) != MPI_SUCCESS
+        || msg_len <= 0)
+        fail(ERR_MPI, "MPI error %d (`%s')", mpi_error, expr);
+    fail(ERR_MPI, "MPI error %d (`%s'): %s", mpi_error, expr, msg_buf);
+}
+
+/* Makes the arena of a context the one of this process for the length of a
+ * call. Returns the arena to be restored by leave(). */
+static struct arena enter(struct hc_ctx *ctx)
+{
+    struct arena saved = g_arena;
+    g_arena = ctx->arena;
+    return saved;
+}
+
+/* Hands the arena of this process back after a call, see enter(). */
+static void leave(struct hc_ctx *ctx, struct arena saved)
+{
+    ctx->arena = g_arena;
+    g_arena = saved;
+}
+
+/* Runs the body of a call of the library over the arena of its context.
+ * Errors the modules run into on the way, see fail(), end the body there.
+ * The context is then left with its partners halfway through a reduction,
+ * so that every later call of it but hc_free() fails the same way.
+ * Returns 0, or the error the body ended with.
+ * @body: Body of the call
+ * @call: Arguments of the call
+ */
+static int guard(void (*body)(struct call *), struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    struct arena saved = enter(ctx);
+    jmp_buf env;
+
+    int err = setjmp(env);
+    if (!err) {
+        g_catch = &env;
+        body(call);
+    } else {
+        ctx->failed = err;
+    }
+    g_catch = NULL;
+    leave(ctx, saved);
+    return err;
+}
+
+/* Makes sure an operator goes with the other settings of a context. The
+ * operators of device contexts are those that the device kernels cover,
+ * see device.h. Returns 0, or ERR_ARG. */
+static int check_op(const struct op *op, const struct hc_config *config)
+{
+    if (config->arena == HC_ARENA_DEVICE && op->kind > OP_PROD)
+        return error(ERR_ARG, "device contexts need a max, min, sum or prod");
+    if (codec_supports((enum codec_kind)config->codec, op))
+        return 0;
+    if (config->codec == HC_CODEC_LZ4)
+        return error(ERR_ARG, "the lz4 codec needs a build with LZ4");
+    return error(ERR_ARG,
+        "lossy codecs need a max, min, sum or prod of f32 or f64 values");
+}
+
+/* Makes sure settings can be carried out on this build, before anything is
+ * set up: every setting a context cannot carry out together with the
+ * others is refused here, rather than left unused. Returns 0, or ERR_ARG.
+ */
+static int check_config(const struct hc_config *config)
+{
+    if (!config->op)
+        return error(ERR_ARG, "no operator");
+    if (config->count < 1)
+        return error(ERR_ARG, "invalid count (%d)", config->count);
+    if (config->threads < 1)
+        return error(ERR_ARG, "invalid number of threads (%d)",
+            config->threads);
+    if ((unsigned)config->dtype > HC_I64
+        || (unsigned)config->backend > HC_BACKEND_RMA
+        || (unsigned)config->codec > HC_CODEC_BF16
+        || (unsigned)config->arena > HC_ARENA_DEVICE)
+        return error(ERR_ARG, "unknown data type, backend, codec or arena");
+    if (config->pipeline_depth < 1
+        || config->pipeline_depth > CUBE_MAX_PIPELINE_DEPTH)
+        return error(ERR_ARG, "invalid pipeline depth (%d)",
+            config->pipeline_depth);
+    if (config->codec != HC_CODEC_NONE
+        && config->backend != HC_BACKEND_HYPERCUBE)
+        return error(ERR_ARG, "codecs need the hypercube backend");
+    if (config->timeout < 0)
+        return error(ERR_ARG, "invalid timeout (%g s)", config->timeout);
+
+    /* Timeouts and failures are only watched for by the plain butterfly of
+     * guarded reductions, see cube.c. */
+    if ((config->timeout > 0 || config->resilient)
+        && (config->backend != HC_BACKEND_HYPERCUBE || config->hierarchical
+            || config->shared_memory || config->codec != HC_CODEC_NONE
+            || config->segment_size))
+        return error(ERR_ARG,
+            "timeouts and resilient contexts need the hypercube backend, "
+            "and cannot be hierarchical, go through shared memory, "
+            "compress or pipeline");
+#ifndef HAVE_ULFM
+    if (config->resilient)
+        return error(ERR_ARG, "resilient contexts need a build with ULFM");
+#endif
+#ifdef HAVE_CUDA
+    if (config->arena == HC_ARENA_DEVICE
+        && (config->threads > 1 || config->shared_memory
+            || config->codec != HC_CODEC_NONE
+            || config->backend == HC_BACKEND_RMA))
+        return error(ERR_ARG,
+            "device contexts do not go with threads, shared memory, "
+            "compression or the rma backend");
+#else
+    if (config->arena == HC_ARENA_DEVICE)
+        return error(ERR_ARG, "device contexts need a build with CUDA");
+#endif
+    if (!kernels_find(config->kernels))
+        return error(ERR_ARG, "instruction set `%s' is unknown or not "
+                              "supported",
+            config->kernels);
+    if (config->threads > 1) {
+        int provided;
+        MPI_Check(MPI_Query_thread(&provided));
+        if (provided < MPI_THREAD_FUNNELED)
+            return error(ERR_ARG, "threads need MPI_THREAD_FUNNELED");
+    }
+
+    struct op op;
+    if (op_parse(config->op, &op) < 0)
+        return error(ERR_ARG, "unknown operator `%s'", config->op);
+    op.dtype = (enum dtype)config->dtype;
+    int err = check_op(&op, config);
+    free(op.children);
+    return err;
+}
+
+/* Makes sure settings can be carried out on this build, the way hc_init()
+ * does, without setting anything up. MPI must have been initialized.
+ * Returns 0, or HC_ERR_ARG, see hc_last_error().
+ * @config: Settings of a context
+ */
+int hc_check_config(const struct hc_config *config)
+{
+    return check_config(config);
+}
+
+/* Sets up the operator of a context, whose settings were checked by
+ * check_config(). */
+static void setup_op(struct hc_ctx *ctx, const struct hc_config *config)
+{
+    op_parse(config->op, &ctx->op);
+    ctx->op.dtype = (enum dtype)config->dtype;
+    ctx->op.kernels = kernels_find(config->kernels);
+    op_init(&ctx->op);
+    ctx->op.device = config->arena == HC_ARENA_DEVICE;
+}
+
+/* Body of hc_init(), past the settings and the operator. */
+static void init_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    const struct hc_config *config = &ctx->config;
+    struct cube_config cube_config = {
+        .backend = (enum cube_backend)config->backend,
+        .segment_size = config->segment_size,
+        .pipeline_depth = config->pipeline_depth,
+        .hierarchical = config->hierarchical,
+        .shared_memory = config->shared_memory,
+        .codec = (enum codec_kind)config->codec,
+        .codec_dims = config->codec_dims,
+        .timeout = config->timeout,
+        .resilient = config->resilient,
+    };
+    if (g_rank < 0) {
+        MPI_Check(MPI_Comm_rank(MPI_COMM_WORLD, &g_rank));
+        MPI_Check(MPI_Comm_size(MPI_COMM_WORLD, &g_size));
+    }
+    MPI_Check(MPI_Comm_dup(call->comm, &ctx->comm));
+    MPI_Check(MPI_Comm_set_errhandler(ctx->comm, MPI_ERRORS_RETURN));
+    cube_init(&ctx->cube, ctx->comm, &cube_config);
+
+    /* The plan keeps its scratch space for as long as the context, and
+     * every call takes the largest scratch space of any call on top. */
+    const struct op *op = &ctx->op;
+    int count = config->count;
+    size_t size = (size_t)count * op->size;
+    size_t plan_scratch = cube_scratch_size(&ctx->cube, count, op);
+    size_t scratch = max(plan_scratch,
+        max(op_scratch_size(op, SIZE_MAX, config->threads),
+            max(cube_scan_scratch_size(&ctx->cube, count, op),
+                ARENA_ROUND(op->size)
+                    + cube_scan_scratch_size(&ctx->cube, 1, op))));
+    arena_init(&g_arena,
+        ARENA_ROUND(size) + (config->persistent ? plan_scratch : 0) + scratch,
+        (enum arena_kind)config->arena);
+    ctx->buf = arena_alloc(&g_arena, size);
+    if (config->persistent)
+        cube_plan_init(&ctx->plan, &ctx->cube, ctx->buf, count, op);
+}
+
+/* Sets up a reduction context over the processes of a communicator: the
+ * hypercube and every topology its backend needs, the operator, the
+ * kernels, an arena holding the buffers of the reductions and, for
+ * persistent contexts, the transfers of reductions of config->count
+ * values. The context works on its own duplicate of the communicator, so
+ * that its messages never match those of other contexts, even with
+ * reductions of several of them in flight. MPI must have been initialized,
+ * with MPI_THREAD_FUNNELED or more for several threads. Device contexts
+ * work on the CUDA device the caller selected.
+ * Returns the context, or NULL if the settings are invalid or not
+ * supported by this build, or if setting them up failed, see
+ * hc_last_error().
+ * @comm: Communicator containing the processes of the reductions
+ * @config: Settings of the context
+ */
+struct hc_ctx *hc_init(MPI_Comm comm, const struct hc_config *config)
+{
+    if (check_config(config))
+        return NULL;
+    struct hc_ctx *ctx = calloc(1, sizeof *ctx);
+    if (!ctx) {
+        error(ERR_NO_MEM, "out of memory");
+        return NULL;
+    }
+    setup_op(ctx, config);
+    ctx->config = *config;
+    struct call call = { .ctx = ctx, .comm = comm };
+    if (guard(init_call, &call)) {
+        /* Whatever got set up is left behind, as after a failed call. */
+        op_free(&ctx->op);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Makes sure a context can start a call working on @count elements, which
+ * are in host memory unless @device is set. Returns 0, or the error the
+ * call is to return. */
+static int check_call(const struct hc_ctx *ctx, int count, int device)
+{
+    if (ctx->failed)
+        return error(ctx->failed, "an earlier call of the context failed");
+    if (count < 0 || count > ctx->config.count)
+        return error(ERR_ARG,
+            "cannot reduce %d values in a context set up for %d", count,
+            ctx->config.count);
+    if (ctx->req.active)
+        return error(ERR_BUSY, "a reduction of the context is in flight");
+    if (ctx->op.device && !device)
+        return error(
+            ERR_ARG, "device contexts only reduce blocks of values");
+    return 0;
+}
+
+/* Makes sure a context can start a scan of @count elements: scans are
+ * neither guarded by a timeout nor go on without failed processes.
+ * Returns 0, or the error the call is to return. */
+static int check_scan(const struct hc_ctx *ctx, int count)
+{
+    int err = check_call(ctx, count, 0);
+    if (err)
+        return err;
+    if (ctx->config.timeout > 0 || ctx->config.resilient)
+        return error(ERR_ARG,
+            "scans cannot have a timeout nor be resilient");
+    return 0;
+}
+
+/* Copies partials out of the buffer of a context. */
+static void copy_out(const struct hc_ctx *ctx, void *dst, size_t size)
+{
+#ifdef HAVE_CUDA
+    if (ctx->op.device) {
+        device_download(dst, ctx->buf, size);
+        return;
+    }
+#endif
+    memcpy(dst, ctx->buf, size);
+}
+
+/* Turns the buffer of values of this process into the partials of a
+ * context, ahead of an element-wise reduction of them. */
+static void lift(struct hc_ctx *ctx, const void *sendbuf, int count)
+{
+    TRACED(TRACE_LOCAL, -1, 0,
+        op_lift_parallel(&ctx->op, ctx->buf, sendbuf, (size_t)count,
+            (int64_t)ctx->cube.rank * count, ctx->config.threads));
+}
+
+/* Body of hc_reduce(). */
+static void reduce_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    lift(ctx, call->in, call->count);
+    if (ctx->config.persistent && call->count == ctx->config.count)
+        cube_plan_run(&ctx->plan);
+    else
+        cube_reduce(&ctx->cube, ctx->buf, call->count, &ctx->op);
+    copy_out(ctx, call->out, (size_t)call->count * ctx->op.size);
+}
+
+/* Reduces buffers of values element-wise across the processes of a
+ * context. On return, @recvbuf holds the partial of every element, which
+ * for max, min, sum and prod is the resulting value itself; it does on
+ * every process for all backends but HC_BACKEND_REDUCE, and on the first
+ * one otherwise. Indices reported by argmax and argmin are those of the
+ * elements in the concatenation of the buffers of all processes, in rank
+ * order. Every process must call this function with the same @count.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ * @sendbuf: Values of this process
+ * @recvbuf: Receives @count partials, see hc_partial_size()
+ * @count: Number of values, at most the count of the context
+ */
+int hc_reduce(
+    struct hc_ctx *ctx, const void *sendbuf, void *recvbuf, int count)
+{
+    int err = check_call(ctx, count, 0);
+    if (err)
+        return err;
+    struct call call
+        = { .ctx = ctx, .in = sendbuf, .out = recvbuf, .count = count };
+    return guard(reduce_call, &call);
+}
+
+/* Body of hc_reduce_block(). */
+static void reduce_block_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    TRACED(TRACE_LOCAL, -1, 0,
+        op_local_parallel(&ctx->op, ctx->buf, call->in, call->n,
+            call->first, ctx->config.threads));
+    if (ctx->config.persistent && ctx->config.count == 1)
+        cube_plan_run(&ctx->plan);
+    else
+        cube_reduce(&ctx->cube, ctx->buf, 1, &ctx->op);
+    copy_out(ctx, call->out, ctx->op.size);
+}
+
+/* Reduces the blocks of values of all the processes of a context to a
+ * single partial, as if they were a single buffer: every process reduces
+ * its block on its own, and the partials of the blocks are then reduced
+ * across the processes. Blocks may be of any length, and differ from a
+ * process to the next. On return, @recvbuf holds the partial on the same
+ * processes as with hc_reduce(). Device contexts take blocks in the memory
+ * of their device.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ * @vals: Block of values of this process
+ * @n: Number of values of the block
+ * @first: Index of the first value of the block in the concatenation of
+ *         the blocks of all processes, for argmax and argmin
+ * @recvbuf: Receives the partial, see hc_partial_size()
+ */
+int hc_reduce_block(struct hc_ctx *ctx, const void *vals, size_t n,
+    int64_t first, void *recvbuf)
+{
+    int err = check_call(ctx, 1, 1);
+    if (err)
+        return err;
+    struct call call = {
+        .ctx = ctx, .in = vals, .out = recvbuf, .n = n, .first = first
+    };
+    return guard(reduce_block_call, &call);
+}
+
+/* Body of hc_scan(). */
+static void scan_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    lift(ctx, call->in, call->count);
+    cube_scan(
+        &ctx->cube, ctx->buf, call->count, &ctx->op, call->exclusive);
+    memcpy(call->out, ctx->buf, (size_t)call->count * ctx->op.size);
+}
+
+/* Computes a prefix reduction of buffers of values element-wise across the
+ * processes of a context: on return, @recvbuf holds on every process the
+ * partial of every element over the processes ranked below it, and over
+ * this one unless @exclusive is set. The first process of an exclusive
+ * scan gets empty partials. Every process must call this function with the
+ * same @count. Scans go through MPI_Scan() with the reduce and allreduce
+ * backends, and through a butterfly of point-to-point transfers with all
+ * the others, which neither pipelines nor compresses partials nor goes
+ * through shared memory, whatever the settings of the context. Contexts
+ * with a timeout and resilient ones get HC_ERR_ARG.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ * @sendbuf: Values of this process
+ * @recvbuf: Receives @count partials, see hc_partial_size()
+ * @count: Number of values, at most the count of the context
+ * @exclusive: Leave the values of this process out of its prefix
+ */
+int hc_scan(struct hc_ctx *ctx, const void *sendbuf, void *recvbuf,
+    int count, int exclusive)
+{
+    int err = check_scan(ctx, count);
+    if (err)
+        return err;
+    struct call call = { .ctx = ctx,
+        .in = sendbuf,
+        .out = recvbuf,
+        .count = count,
+        .exclusive = exclusive };
+    return guard(scan_call, &call);
+}
+
+/* Body of hc_scan_block(). */
+static void scan_block_call(struct call *call)
+{
+    const struct op *op = &call->ctx->op;
+    char *partials = call->out;
+    size_t n = call->n;
+    op_lift_parallel(
+        op, partials, call->in, n, call->first, call->ctx->config.threads);
+    TRACED(TRACE_LOCAL, -1, 0, op_prefix(op, partials, n));
+
+    /* Prefix of the values before the block. */
+    size_t mark = arena_mark(&g_arena);
+    char *prefix = arena_alloc(&g_arena, op->size);
+    if (n)
+        memcpy(prefix, partials + (n - 1) * op->size, op->size);
+    else
+        op_local(op, prefix, NULL, 0, 0);
+    cube_scan(&call->ctx->cube, prefix, 1, op, 1);
+
+    double start = trace_begin();
+    for (size_t i = 0; i < n; i++)
+        op_combine(op, partials + i * op->size, prefix, 1);
+    if (call->exclusive && n) {
+        memmove(partials + op->size, partials, (n - 1) * op->size);
+        memcpy(partials, prefix, op->size);
+    }
+    trace_end(TRACE_COMBINE, -1, 0, start);
+    arena_release(&g_arena, mark);
+}
+
+/* Computes the prefix reduction of the blocks of values of all the
+ * processes of a context, as if they were a single buffer: on return,
+ * @recvbuf holds the partial of every value of the block of this process
+ * over every value before it, and over the value itself unless @exclusive
+ * is set. Every value is combined with the ones before it within the
+ * block, and then with the exclusive scan of the block totals across the
+ * processes, as hc_scan() computes it. Blocks may be of any length.
+ * Contexts with a timeout and resilient ones get HC_ERR_ARG.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ * @vals: Block of values of this process
+ * @n: Number of values of the block
+ * @first: Index of the first value of the block in the concatenation of
+ *         the blocks of all processes, for argmax and argmin
+ * @recvbuf: Receives @n partials, see hc_partial_size()
+ * @exclusive: Leave every value out of its own prefix
+ */
+int hc_scan_block(struct hc_ctx *ctx, const void *vals, size_t n,
+    int64_t first, void *recvbuf, int exclusive)
+{
+    int err = check_scan(ctx, 1);
+    if (err)
+        return err;
+    struct call call = { .ctx = ctx,
+        .in = vals,
+        .out = recvbuf,
+        .n = n,
+        .first = first,
+        .exclusive = exclusive };
+    return guard(scan_block_call, &call);
+}
+
+/* Body of hc_ireduce(). */
+static void ireduce_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    lift(ctx, call->in, call->count);
+    cube_ireduce(&ctx->req.cube, &ctx->cube, ctx->buf, call->count, &ctx->op);
+}
+
+/* Starts reducing buffers of values element-wise across the processes of
+ * a context, with the same outcome as hc_reduce() once hc_test() or
+ * hc_wait() reports the reduction complete. Only one reduction of a
+ * context may be in flight, and the context may not be used for anything
+ * else until it is complete. @sendbuf may be reused as soon as this
+ * function returns; @recvbuf is only written once the reduction is
+ * complete. The reduction only moves on from one round to the next within
+ * hc_test() and hc_wait(), so callers computing in the meantime should call
+ * hc_test() now and then. Hierarchical and shared-memory contexts, those
+ * compressing partials and those with a timeout or resilient ones cannot
+ * start reductions this way, and get HC_ERR_ARG.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ * @sendbuf: Values of this process
+ * @recvbuf: Receives @count partials, see hc_partial_size()
+ * @count: Number of values, at most the count of the context
+ * @req: Receives the reduction in flight, which belongs to the context
+ */
+int hc_ireduce(struct hc_ctx *ctx, const void *sendbuf, void *recvbuf,
+    int count, struct hc_request **req)
+{
+    int err = check_call(ctx, count, 0);
+    if (err)
+        return err;
+    if (!cube_can_ireduce(&ctx->cube))
+        return error(ERR_ARG,
+            "reductions of this context cannot be started without waiting");
+    struct call call = { .ctx = ctx, .in = sendbuf, .count = count };
+    if ((err = guard(ireduce_call, &call)))
+        return err;
+
+    ctx->req.ctx = ctx;
+    ctx->req.recvbuf = recvbuf;
+    ctx->req.count = count;
+    ctx->req.active = 1;
+    *req = &ctx->req;
+    return 0;
+}
+
+/* Body of hc_test() and hc_wait(). */
+static void progress_call(struct call *call)
+{
+    struct hc_request *req = &call->ctx->req;
+    if (call->wait) {
+        cube_wait(&req->cube);
+        call->done = 1;
+    } else {
+        call->done = cube_test(&req->cube);
+    }
+}
+
+/* Advances a reduction started by hc_ireduce(), or waits until it is
+ * complete if @wait is set, then hands the result over on completion.
+ * Returns 0, or one of enum hc_error, which ends the reduction. */
+static int progress(struct hc_request *req, int wait, int *done)
+{
+    *done = 1;
+    if (!req->active)
+        return 0;
+
+    struct hc_ctx *ctx = req->ctx;
+    struct call call = { .ctx = ctx, .wait = wait };
+    int err = guard(progress_call, &call);
+    if (err) {
+        req->active = 0;
+        return err;
+    }
+    if (!(*done = call.done))
+        return 0;
+
+    memcpy(req->recvbuf, ctx->buf, (size_t)req->count * ctx->op.size);
+    req->active = 0;
+    return 0;
+}
+
+/* Advances a reduction started by hc_ireduce() as far as the other
+ * processes allow without waiting for them.
+ * Returns 0, or one of enum hc_error.
+ * @req: Reduction
+ * @done: Receives 1 if the reduction is complete, and its result in the
+ *        receive buffer, 0 otherwise
+ */
+int hc_test(struct hc_request *req, int *done)
+{
+    return progress(req, 0, done);
+}
+
+/* Waits until a reduction started by hc_ireduce() is complete and its
+ * result is in the receive buffer.
+ * Returns 0, or one of enum hc_error.
+ * @req: Reduction
+ */
+int hc_wait(struct hc_request *req)
+{
+    int done;
+    return progress(req, 1, &done);
+}
+
+/* Returns the rank of this process among those taking part in the
+ * reductions of a context. It is its rank in the communicator of the
+ * context unless resilient reductions went on without failed processes.
+ * Whatever the backend, the process of rank 0 gets the results.
+ * @ctx: Context
+ */
+int hc_rank(const struct hc_ctx *ctx)
+{
+    return ctx->cube.rank;
+}
+
+/* Returns the number of processes taking part in the reductions of a
+ * context. It is the size of the communicator of the context unless
+ * resilient reductions went on without failed processes. The values of
+ * those are then left out of the results, but for operators made of max,
+ * min, argmax and argmin alone, which may still count them in.
+ * @ctx: Context
+ */
+int hc_size(const struct hc_ctx *ctx)
+{
+    return ctx->cube.size;
+}
+
+/* Returns the bytes of the partial of every element of a reduction.
+ * @ctx: Context
+ */
+size_t hc_partial_size(const struct hc_ctx *ctx)
+{
+    return ctx->op.size;
+}
+
+/* Writes out the result held by a partial, the way the command-line tool
+ * prints it: a value, an index, a pair of them, or a list of them.
+ * @ctx: Context
+ * @fp: Stream written to
+ * @partial: Partial, as received from a reduction of the context
+ */
+void hc_print(const struct hc_ctx *ctx, FILE *fp, const void *partial)
+{
+    op_print(&ctx->op, fp, partial);
+}
+
+/* Returns a description of the last error a function of the library
+ * returned on this thread, or of the reason hc_init() returned NULL. */
+const char *hc_last_error(void)
+{
+    return g_error;
+}
+
+/* Body of hc_free(). */
+static void free_call(struct call *call)
+{
+    struct hc_ctx *ctx = call->ctx;
+    if (ctx->config.persistent)
+        cube_plan_free(&ctx->plan);
+    arena_free(&g_arena);
+    cube_free(&ctx->cube);
+    MPI_Check(MPI_Comm_free(&ctx->comm));
+}
+
+/* Releases everything set up by hc_init(), the context included, unless
+ * a reduction of it is still in flight. A context whose calls failed is
+ * released as far as it can be.
+ * Returns 0, or one of enum hc_error.
+ * @ctx: Context
+ */
+int hc_free(struct hc_ctx *ctx)
+{
+    if (ctx->req.active)
+        return error(ERR_BUSY, "a reduction of the context is in flight");
+    struct call call = { .ctx = ctx };
+    int err = guard(free_call, &call);
+    op_free(&ctx->op);
+    free(ctx);
+    return err;
+}
@@ -0,0 +1,166 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_HYPERCUBE_H
+#define MPI_HYPERCUBE_HYPERCUBE_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Public interface of libhypercube, for programs reducing buffers across
+ * the processes of a communicator from their own MPI job:
+ *
+ *     struct hc_config config = HC_CONFIG_INIT;
+ *     config.op = "sum";
+ *     config.count = 1024;
+ *     struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, &config);
+ *     if (!ctx)
+ *             ... hc_last_error() ...
+ *     for (;;)
+ *             if (hc_reduce(ctx, sendbuf, recvbuf, 1024))
+ *                     ... hc_last_error() ...
+ *     hc_free(ctx);
+ *
+ * Everything a reduction needs is set up once by hc_init(), so that every
+ * call only moves and combines data. hc_ireduce() starts a reduction and
+ * returns right away, so that the caller can keep computing while it runs:
+ *
+ *     struct hc_request *req;
+ *     int done = 0;
+ *     hc_ireduce(ctx, sendbuf, recvbuf, 1024, &req);
+ *     while (!done && !hc_test(req, &done))
+ *             ...
+ *
+ * This header is all a program needs: contexts and reductions in flight
+ * are opaque, and the enumerations below stand for the settings of the
+ * command-line tool of the same names. */
+
+/* Functions exported by the shared library. */
+#define HC_EXPORT __attribute__((visibility("default")))
+
+/* Errors returned by the functions below, which return 0 on success. A
+ * context whose call failed past checking its arguments, that is with
+ * anything but HC_ERR_ARG or HC_ERR_BUSY, can only be released. */
+enum hc_error {
+    HC_ERR_ARG = 1, /* invalid argument */
+    HC_ERR_BUSY, /* a reduction of the context is still in flight */
+    HC_ERR_NO_MEM, /* out of memory */
+    HC_ERR_MPI, /* a call to the MPI library failed */
+    HC_ERR_TIMEOUT, /* a partner did not answer within the timeout */
+    HC_ERR_CORRUPT, /* a compressed partial could not be decoded */
+    HC_ERR_DEVICE, /* a call to the CUDA runtime failed */
+};
+
+/* Element types of the values, as --dtype. */
+enum hc_dtype {
+    HC_F64,
+    HC_F32,
+    HC_I32,
+    HC_I64,
+};
+
+/* Ways of carrying out the reduction, as --backend. */
+enum hc_backend {
+    HC_BACKEND_HYPERCUBE,
+    HC_BACKEND_REDUCE,
+    HC_BACKEND_ALLREDUCE,
+    HC_BACKEND_CART,
+    HC_BACKEND_NEIGHBOR,
+    HC_BACKEND_HALVING,
+    HC_BACKEND_RMA,
+};
+
+/* Encodings of the partials sent across the hypercube, as --compress. */
+enum hc_codec {
+    HC_CODEC_NONE,
+    HC_CODEC_XOR,
+    HC_CODEC_LZ4,
+    HC_CODEC_F16,
+    HC_CODEC_BF16,
+};
+
+/* Memory of the buffers of the reductions, as --arena. */
+enum hc_arena {
+    HC_ARENA_HEAP,
+    HC_ARENA_HUGEPAGES,
+    HC_ARENA_MPI,
+    HC_ARENA_DEVICE, /* CUDA device memory; the caller picks the device */
+};
+
+/* Settings of a reduction context. */
+struct hc_config {
+    const char *op; /* operator, as given to --op */
+    enum hc_dtype dtype;
+    int count; /* largest number of values reduced or scanned element-wise
+                * by a call */
+    int threads; /* threads turning values into partials */
+    enum hc_arena arena;
+    int persistent; /* set up the transfers of reductions of @count values
+                     * once */
+    const char *kernels; /* instruction set of the vector kernels, as
+                          * --kernels, or NULL for the widest one */
+    enum hc_backend backend;
+    size_t segment_size; /* bytes per pipelined segment, 0 to disable */
+    int pipeline_depth; /* segments in flight when pipelining */
+    int hierarchical; /* reduce within nodes, then across node leaders */
+    int shared_memory; /* go through shared memory with partners on the
+                        * same node */
+    enum hc_codec codec;
+    uint32_t codec_dims; /* compressed dimensions, as a bit mask; 0 for
+                          * the ones whose partner is on another node */
+    double timeout; /* seconds a transfer may take, 0 for no limit */
+    int resilient; /* go on without failed processes, which needs ULFM */
+};
+
+#define HC_CONFIG_INIT                                                        \
+    {                                                                         \
+        "max", HC_F64, 1, 1, HC_ARENA_HEAP, 0, NULL, HC_BACKEND_HYPERCUBE, 0, \
+            2, 0, 0, HC_CODEC_NONE, 0, 0, 0                                   \
+    }
+
+/* Reduction context, set up by hc_init(). */
+struct hc_ctx;
+
+/* Reduction in flight, started by hc_ireduce(). */
+struct hc_request;
+
+HC_EXPORT int hc_check_config(const struct hc_config *config);
+HC_EXPORT struct hc_ctx *hc_init(
+    MPI_Comm comm, const struct hc_config *config);
+HC_EXPORT int hc_reduce(
+    struct hc_ctx *ctx, const void *sendbuf, void *recvbuf, int count);
+HC_EXPORT int hc_reduce_block(struct hc_ctx *ctx, const void *vals,
+    size_t n, int64_t first, void *recvbuf);
+HC_EXPORT int hc_scan(struct hc_ctx *ctx, const void *sendbuf,
+    void *recvbuf, int count, int exclusive);
+HC_EXPORT int hc_scan_block(struct hc_ctx *ctx, const void *vals, size_t n,
+    int64_t first, void *recvbuf, int exclusive);
+HC_EXPORT int hc_ireduce(struct hc_ctx *ctx, const void *sendbuf,
+    void *recvbuf, int count, struct hc_request **req);
+HC_EXPORT int hc_test(struct hc_request *req, int *done);
+HC_EXPORT int hc_wait(struct hc_request *req);
+HC_EXPORT int hc_rank(const struct hc_ctx *ctx);
+HC_EXPORT int hc_size(const struct hc_ctx *ctx);
+HC_EXPORT size_t hc_partial_size(const struct hc_ctx *ctx);
+HC_EXPORT void hc_print(
+    const struct hc_ctx *ctx, FILE *fp, const void *partial);
+HC_EXPORT const char *hc_last_error(void);
+HC_EXPORT int hc_free(struct hc_ctx *ctx);
+
+#endif /* MPI_HYPERCUBE_HYPERCUBE_H */
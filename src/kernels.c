@@ -0,0 +1,214 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kernels.h"
+
+/* The kernels are written once with GCC vector extensions and instantiated
+ * for every vector width, each under the matching target attribute so that
+ * one binary carries all of them. Per-element steps match the scalar
+ * definitions exactly: max and min yield NaN as soon as either operand is
+ * one, so that the partners of a butterfly round agree on the result
+ * whichever order they combine their operands in. Integer sums and products
+ * wrap, as they are computed on unsigned types. */
+
+/* Scalar steps. @U is the type arithmetic is carried out in. */
+#define STEP_MAX(U, a, v) ((v) > (a) || (v) != (v) ? (v) : (a))
+#define STEP_MIN(U, a, v) ((v) < (a) || (v) != (v) ? (v) : (a))
+#define STEP_SUM(U, a, v) ((__typeof(a))((U)(a) + (U)(v)))
+#define STEP_PROD(U, a, v) ((__typeof(a))((U)(a) * (U)(v)))
+
+/* Vector steps. Comparisons yield all-ones lanes where they hold, which
+ * select between the operands bitwise. @M is the integer vector type
+ * comparisons yield, @UV the vector type arithmetic is carried out in. */
+#define VSELECT(M, m, x, y)                                                   \
+    ((__typeof(x))(((M)(x) & (m)) | ((M)(y) & ~(m))))
+#define VSTEP_MAX(M, UV, a, v)                                                \
+    VSELECT(M, (M)(((v) > (a)) | ((v) != (v))), v, a)
+#define VSTEP_MIN(M, UV, a, v)                                                \
+    VSELECT(M, (M)(((v) < (a)) | ((v) != (v))), v, a)
+#define VSTEP_SUM(M, UV, a, v) ((__typeof(a))((UV)(a) + (UV)(v)))
+#define VSTEP_PROD(M, UV, a, v) ((__typeof(a))((UV)(a) * (UV)(v)))
+
+/* Defines the reduction and the combine kernel of one operator for one type
+ * and vector width. The reduction keeps four vector accumulators to hide the
+ * latency of the steps. Both kernels peel scalar iterations until their
+ * output pointer is aligned to the vector width, so that the main loops only
+ * use aligned loads and stores on it.
+ * @isa: Name of the instruction set
+ * @attr: Attributes of the kernels
+ * @width: Vector width in bytes
+ * @tn: Name of the type
+ * @T: Element type
+ * @U: Type arithmetic is carried out in
+ * @I: Signed integer type of the same size as @T
+ * @op: Name of the operator
+ * @STEP: Step of the operator, STEP_MAX for instance
+ * @init: Identity of the operator
+ */
+#define DEFINE_KERNELS(isa, attr, width, tn, T, U, I, op, STEP, init)        \
+    attr static void isa##_reduce_##op##_##tn(                                \
+        void *out, const void *vals_, size_t n)                               \
+    {                                                                         \
+        typedef T vec __attribute__((vector_size(width)));                    \
+        typedef U uvec __attribute__((vector_size(width), unused));           \
+        typedef I mask __attribute__((vector_size(width), unused));           \
+        enum { LANES = (width) / sizeof(T) };                                 \
+        const T *vals = vals_;                                                \
+        T acc = init;                                                         \
+        size_t i = 0;                                                         \
+                                                                              \
+        for (; i < n && (uintptr_t)(vals + i) % (width); i++)                 \
+            acc = STEP(U, acc, vals[i]);                                      \
+        vec a0 = (vec) {} + (T)(init), a1 = a0, a2 = a0, a3 = a0;             \
+        for (; i + 4 * LANES <= n; i += 4 * LANES) {                          \
+            const vec *p = (const vec *)(vals + i);                           \
+            a0 = V##STEP(mask, uvec, a0, p[0]);                               \
+            a1 = V##STEP(mask, uvec, a1, p[1]);                               \
+            a2 = V##STEP(mask, uvec, a2, p[2]);                               \
+            a3 = V##STEP(mask, uvec, a3, p[3]);                               \
+        }                                                                     \
+        for (; i + LANES <= n; i += LANES)                                    \
+            a0 = V##STEP(mask, uvec, a0, *(const vec *)(vals + i));           \
+        a0 = V##STEP(mask, uvec, V##STEP(mask, uvec, a0, a1),                 \
+            V##STEP(mask, uvec, a2, a3));                                     \
+        for (int j = 0; j < LANES; j++)                                       \
+            acc = STEP(U, acc, a0[j]);                                        \
+        for (; i < n; i++)                                                    \
+            acc = STEP(U, acc, vals[i]);                                      \
+        memcpy(out, &acc, sizeof acc);                                        \
+    }                                                                         \
+                                                                              \
+    attr static void isa##_combine_##op##_##tn(                               \
+        void *inout_, const void *in_, size_t n)                              \
+    {                                                                         \
+        typedef T vec __attribute__((vector_size(width)));                    \
+        typedef T vec_u                                                       \
+            __attribute__((vector_size(width), aligned(sizeof(T))));          \
+        typedef U uvec __attribute__((vector_size(width), unused));           \
+        typedef I mask __attribute__((vector_size(width), unused));           \
+        enum { LANES = (width) / sizeof(T) };                                 \
+        T *a = inout_;                                                        \
+        const T *b = in_;                                                     \
+        size_t i = 0;                                                         \
+                                                                              \
+        for (; i < n && (uintptr_t)(a + i) % (width); i++)                    \
+            a[i] = STEP(U, a[i], b[i]);                                       \
+        for (; i + 2 * LANES <= n; i += 2 * LANES) {                          \
+            vec *pa = (vec *)(a + i);                                         \
+            const vec_u *pb = (const vec_u *)(b + i);                         \
+            vec x0 = pb[0], x1 = pb[1];                                       \
+            pa[0] = V##STEP(mask, uvec, pa[0], x0);                           \
+            pa[1] = V##STEP(mask, uvec, pa[1], x1);                           \
+        }                                                                     \
+        for (; i < n; i++)                                                    \
+            a[i] = STEP(U, a[i], b[i]);                                       \
+    }
+
+/* Instantiates the kernels of every operator for one type. */
+#define DEFINE_TYPE_KERNELS(isa, attr, width, tn, T, U, I, lo, hi)           \
+    DEFINE_KERNELS(isa, attr, width, tn, T, U, I, max, STEP_MAX, lo)          \
+    DEFINE_KERNELS(isa, attr, width, tn, T, U, I, min, STEP_MIN, hi)          \
+    DEFINE_KERNELS(isa, attr, width, tn, T, U, I, sum, STEP_SUM, (T)0)        \
+    DEFINE_KERNELS(isa, attr, width, tn, T, U, I, prod, STEP_PROD, (T)1)
+
+/* Instantiates the kernels of every operator and type for one instruction
+ * set, along with its kernel set. */
+#define DEFINE_KERNEL_SET(isa, attr, width)                                   \
+    DEFINE_TYPE_KERNELS(isa, attr, width, f64, double, double, int64_t,       \
+        -INFINITY, INFINITY)                                                  \
+    DEFINE_TYPE_KERNELS(isa, attr, width, f32, float, float, int32_t,         \
+        -INFINITY, INFINITY)                                                  \
+    DEFINE_TYPE_KERNELS(isa, attr, width, i32, int32_t, uint32_t, int32_t,    \
+        INT32_MIN, INT32_MAX)                                                 \
+    DEFINE_TYPE_KERNELS(isa, attr, width, i64, int64_t, uint64_t, int64_t,    \
+        INT64_MIN, INT64_MAX)                                                 \
+                                                                              \
+    static const struct kernel_set isa##_kernels = {                          \
+        .name = #isa,                                                         \
+        .reduce = { KERNEL_ROW(isa, reduce, max),                             \
+            KERNEL_ROW(isa, reduce, min), KERNEL_ROW(isa, reduce, sum),       \
+            KERNEL_ROW(isa, reduce, prod) },                                  \
+        .combine = { KERNEL_ROW(isa, combine, max),                           \
+            KERNEL_ROW(isa, combine, min), KERNEL_ROW(isa, combine, sum),     \
+            KERNEL_ROW(isa, combine, prod) },                                 \
+    };
+
+#define KERNEL_ROW(isa, kind, op)                                             \
+    {                                                                         \
+        [DTYPE_F64] = isa##_##kind##_##op##_f64,                             \
+        [DTYPE_F32] = isa##_##kind##_##op##_f32,                             \
+        [DTYPE_I32] = isa##_##kind##_##op##_i32,                             \
+        [DTYPE_I64] = isa##_##kind##_##op##_i64,                             \
+    }
+
+/* The baseline instruction set needs no attribute: SSE2 is part of x86-64
+ * and NEON of AArch64. Elsewhere, the compiler lowers the vectors to scalar
+ * code. */
+#if defined(__x86_64__)
+#define BASELINE sse2
+#elif defined(__aarch64__)
+#define BASELINE neon
+#else
+#define BASELINE generic
+#endif
+
+/* Expands BASELINE before it is pasted into names. */
+#define DEFINE_KERNEL_SET_(isa, attr, width)                                  \
+    DEFINE_KERNEL_SET(isa, attr, width)
+#define KERNELS_OF(isa) KERNELS_OF_(isa)
+#define KERNELS_OF_(isa) isa##_kernels
+
+DEFINE_KERNEL_SET_(BASELINE, , 16)
+#if defined(__x86_64__)
+DEFINE_KERNEL_SET(avx2, __attribute__((target("avx2"))), 32)
+DEFINE_KERNEL_SET(avx512, __attribute__((target("avx512f"))), 64)
+#endif
+
+/* Looks up the kernels of an instruction set, or of the widest one the
+ * processor supports.
+ * Returns the kernels, or NULL if the instruction set is unknown or not
+ * supported
+ * @name: Name of the instruction set, or NULL to pick the best one
+ */
+const struct kernel_set *kernels_find(const char *name)
+{
+    const struct kernel_set *sets[] = {
+#if defined(__x86_64__)
+        &avx512_kernels,
+        &avx2_kernels,
+#endif
+        &KERNELS_OF(BASELINE),
+    };
+    int supported[sizeof sets / sizeof *sets];
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    supported[0] = __builtin_cpu_supports("avx512f");
+    supported[1] = __builtin_cpu_supports("avx2");
+#endif
+    supported[sizeof sets / sizeof *sets - 1] = 1;
+
+    for (size_t i = 0; i < sizeof sets / sizeof *sets; i++) {
+        if (supported[i] && (!name || !strcmp(name, sets[i]->name)))
+            return sets[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_KERNELS_H
+#define MPI_HYPERCUBE_KERNELS_H
+
+#include <stddef.h>
+
+#include "dtype.h"
+#include "ops.h"
+
+/* Kernels exist for the operators whose partial is a plain value, OP_MAX to
+ * OP_PROD. */
+#define KERNEL_NUM_OPS (OP_PROD + 1)
+
+/* Reduces @n values to a single one, written to @out. An empty block yields
+ * the identity of the operator. */
+typedef void (*kernel_reduce_fn)(void *out, const void *vals, size_t n);
+
+/* Combines @n values of @in into @inout element-wise. */
+typedef void (*kernel_combine_fn)(void *inout, const void *in, size_t n);
+
+/* Kernels built for one instruction set. */
+struct kernel_set {
+    const char *name;
+    kernel_reduce_fn reduce[KERNEL_NUM_OPS][DTYPE_COUNT];
+    kernel_combine_fn combine[KERNEL_NUM_OPS][DTYPE_COUNT];
+};
+
+const struct kernel_set *kernels_find(const char *name);
+
+#endif /* MPI_HYPERCUBE_KERNELS_H */
@@ -15,8 +15,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <ctype.h>
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <getopt.h>
 #include <limits.h>
 #include <math.h>
 #include <mpi.h>
@@ -25,51 +27,123 @@
 #include <string.h>
 #include <unistd.h>
 
-#define PROGNAME "mpi_hypercube"
+#include "arena.h"
+#include "bench.h"
+#include "binfile.h"
+#include "common.h"
+#include "cube.h"
+#include "device.h"
+#include "dtype.h"
+#include "hypercube.h"
+#include "kernels.h"
+#include "ops.h"
+#include "parse.h"
+#include "sort.h"
+#include "stream.h"
+#include "trace.h"
+
 #define DISTRIB_RANK 0
+#define TAG_BLOCK 1
+#define TAG_HEAD 2
+#define TAG_STREAM_END 3
 #define TAG_FINAL_RESULT 42
 
-#define max(a, b)                                                             \
-    __extension__({                                                           \
-        __typeof(a) _a = a;                                                   \
-        __typeof(b) _b = b;                                                   \
-        _a > _b ? _a : _b;                                                    \
-    })
-#define MPI_Check(v)                                                          \
-    __extension__({                                                           \
-        __typeof(v) _v = v;                                                   \
-        if (_v != MPI_SUCCESS)                                                \
-            handle_error(_v, #v);                                             \
-    })
-#define logf(f, ...) printf(PROGNAME "(%d): " f "\n", g_rank, ##__VA_ARGS__)
-
-static int g_rank = -1, g_size = -1;
-
-/* Generic MPI error handler.
- * This function gets called from within the MPI_Check() macro in case a MPI
- * call does not succeed. Do not attempt to call this handler manually.
- * This function does not return.
- * @mpi_error: MPI status code
- * @expr: Failing expression
+/* Largest byte count handed to a single MPI-IO call. */
+#define IO_CHUNK_SIZE (1 << 30)
+
+/* Most quantiles selected by a single run, see --quantile. */
+#define MAX_QUANTILES 16
+
+/* Prefix scans, see --scan. */
+enum scan_kind {
+    SCAN_NONE,
+    SCAN_INCLUSIVE, /* every value combined with all the ones before it */
+    SCAN_EXCLUSIVE, /* only the values before it */
+};
+
+/* Settings given on the command line. */
+struct options {
+    int dim; /* -1 to use every process */
+    const char *path;
+    int parallel_io;
+    int no_distributor; /* rank 0 is a hypercube node too */
+    int root; /* rank receiving the result */
+    int vector; /* reduce element-wise instead of to a single value */
+    int threads; /* threads reducing the local block */
+    const char *kernels; /* instruction set of the kernels, NULL for best */
+    enum arena_kind arena; /* memory of the reduction buffers */
+    int repeat; /* times the reduction is carried out */
+    int persistent; /* set up the transfers once, as persistent requests */
+    size_t window; /* records per window in streaming mode, 0 if off */
+    size_t slide; /* records between windows, 0 for tumbling windows */
+    double window_time; /* seconds after which a window closes, 0 if never */
+    int follow; /* wait for more data at the end of the input file */
+    int bench; /* measure reductions of synthetic data instead */
+    enum bench_format bench_format;
+    size_t bench_min, bench_max; /* bytes of partials per process */
+    int all_backends; /* no backend was asked for */
+    const char *trace; /* file the trace is written to, NULL if off */
+    enum scan_kind scan;
+    const char *sort; /* file the sorted values are written to, or NULL */
+    double quantiles[MAX_QUANTILES];
+    int num_quantiles; /* 0 unless selecting quantiles */
+    const char *op_spec; /* operator, as given to --op */
+    struct op op;
+    struct cube_config cube;
+};
+
+/* Buffer attached for buffered sends, see reserve_bsend_buffer(). */
+static void *g_bsend_buf;
+static int g_bsend_size;
+
+/* Where workers get their block of values from. */
+enum input_source {
+    INPUT_DISTRIBUTOR, /* sent by the distributor process */
+    INPUT_SCATTER, /* read by the first worker and scattered */
+    INPUT_PARALLEL_TEXT, /* read by every worker through MPI-IO */
+    INPUT_BINARY, /* mapped by every worker from a binary input file */
+};
+
+/* Makes sure the attached buffer for buffered sends can hold a message of
+ * @count elements of type @type. The buffer is attached once and only grows,
+ * so it can be reused by any number of buffered sends.
+ * @count: Number of elements of the message
+ * @type: Data type of the elements
  */
-static void __attribute__((noreturn))
-handle_error(int mpi_error, const char *expr)
+static void reserve_bsend_buffer(int count, MPI_Datatype type)
 {
-    char msg_buf[BUFSIZ];
-    int msg_len = -1;
+    int size;
+    MPI_Check(MPI_Pack_size(count, type, MPI_COMM_WORLD, &size));
+    size += MPI_BSEND_OVERHEAD;
+    if (size <= g_bsend_size)
+        return;
 
-    if (MPI_Error_string(mpi_error, msg_buf, &msg_len) != MPI_SUCCESS
-        && msg_len > 0) {
-        fprintf(stderr, PROGNAME "(%d): MPI error %d (`%s')\n", g_rank,
-            mpi_error, expr);
-    } else {
-        fprintf(stderr, PROGNAME "(%d): MPI error %d (`%s'): %s\n", g_rank,
-            mpi_error, expr, msg_buf);
+    /* Detaching waits for pending buffered sends to complete. */
+    if (g_bsend_buf) {
+        void *old;
+        int old_size;
+        MPI_Check(MPI_Buffer_detach(&old, &old_size));
+        free(old);
     }
+    if (!(g_bsend_buf = malloc((size_t)size)))
+        fatal("out of memory");
+    g_bsend_size = size;
+    MPI_Check(MPI_Buffer_attach(g_bsend_buf, size));
+}
 
-    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    MPI_Finalize();
-    _exit(EXIT_FAILURE);
+/* Detaches and frees the buffer for buffered sends, if any. Pending buffered
+ * sends complete before this function returns.
+ */
+static void release_bsend_buffer(void)
+{
+    if (g_bsend_buf) {
+        void *old;
+        int old_size;
+        MPI_Check(MPI_Buffer_detach(&old, &old_size));
+        free(old);
+        g_bsend_buf = NULL;
+        g_bsend_size = 0;
+    }
 }
 
 /* Parse the dimensions of the hypercube from the command line arguments.
@@ -90,144 +164,1503 @@ static int parse_dimensions(char *str)
     return (int)result;
 }
 
-/* Returns 1 if the given character is part of a valid floating-point numeric
- * entity.
- * @c: Character to be checked
+/* Parse a byte count from the command line arguments, with an optional k, m
+ * or g suffix for powers of 1024.
+ * Returns 0 on success, -1 on failure
+ * @str: String to be parsed
+ * @size: Receives the parsed value
  */
-static inline int __attribute__((always_inline)) is_numeric_char(char c)
+static int parse_size(const char *str, size_t *size)
 {
-    return isdigit(c) || c == '.' || c == '-';
+    errno = 0;
+    char *endptr;
+    unsigned long long result = strtoull(str, &endptr, 10);
+
+    if (endptr == str || errno == ERANGE || *str == '-')
+        return -1;
+
+    switch (*endptr) {
+    case 'g':
+    case 'G':
+        result <<= 10;
+        /* fall through */
+    case 'm':
+    case 'M':
+        result <<= 10;
+        /* fall through */
+    case 'k':
+    case 'K':
+        result <<= 10;
+        endptr++;
+        break;
+    }
+    if (*endptr != '\0')
+        return -1;
+
+    *size = (size_t)result;
+    return 0;
 }
 
-/* Reads the input file and scans for numeric entities and sends out these
- * values across the network for every peer to process.
+/* Reads the input file, scans for numeric entities and sends out a
+ * contiguous block of these values to every peer for processing.
  * @path: Path to the file containing the data
+ * @num_workers: Number of worker processes in the hypercube
+ * @dtype: Element type of the values
  */
-static void perform_distribution(const char *path)
+static void perform_distribution(
+    const char *path, int num_workers, enum dtype dtype)
 {
-    /* Open input file. */
-    errno = 0;
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
+    /* Read and parse the whole input file. */
+    struct value_list values = { .dtype = dtype };
+    TRACED(TRACE_PARSE, -1, 0, parse_file(path, &values));
+
+    if (values.len == 0) {
         fprintf(stderr,
-            PROGNAME "(%d): error: could not open file `%s' for reading: %s\n",
-            g_rank, path, strerror(errno));
-        MPI_Check(MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE));
-        MPI_Check(MPI_Finalize());
+            PROGNAME "(%d): error: no numeric entities on the list\n",
+            g_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        MPI_Finalize();
         _exit(EXIT_FAILURE);
     }
 
-    /* Keep reading from file until we're done. */
-    int n = 0;
-    char c = 0, item_buf[BUFSIZ];
-    for (;;) {
-        size_t i = 0;
+    /* Send out a block of values to each worker. We send it to (1 + n)
+     * because first worker is always the distributor process. All blocks
+     * are in flight at once. */
+    MPI_Request *reqs = malloc((size_t)num_workers * sizeof *reqs);
+    if (!reqs)
+        fatal("out of memory");
+    double start = trace_begin();
+    for (int n = 0; n < num_workers; n++) {
+        size_t first, count;
+        block_range(values.len, (size_t)num_workers, (size_t)n, &first,
+            &count);
+        if (count > INT_MAX)
+            fatal("block of %zu values for worker %d is too large", count,
+                1 + n);
+        MPI_Check(MPI_Isend(value_list_at(&values, first), (int)count,
+            dtype_mpi(dtype), 1 + n, TAG_BLOCK, MPI_COMM_WORLD, &reqs[n]));
+    }
+    MPI_Check(MPI_Waitall(num_workers, reqs, MPI_STATUSES_IGNORE));
+    trace_end(TRACE_DISTRIBUTE, -1, values.len * dtype_size(dtype), start);
+    free(reqs);
+    free(values.data);
+}
 
-        /* Copy characters into our item buffer as long as they are part of a
-         * numeric entity. */
-        while (i < BUFSIZ && is_numeric_char((c = (char)fgetc(fp))))
-            item_buf[i++] = c;
-        item_buf[i] = '\0';
+/* Receives the final result from the worker processes and prints it. The
+ * result is either a single partial or, in vector mode, a buffer of
+ * partials printed as a comma-separated list.
+ * @op: Operator of the reduction
+ */
+static void receive_result(const struct op *op)
+{
+    MPI_Status status;
+    int count;
+    double start = trace_begin();
+    int err;
+    /* With --resilient, receives from any source report the failures of
+     * workers as well, which the reduction went on without. */
+    while ((err = MPI_Probe(MPI_ANY_SOURCE, TAG_FINAL_RESULT, MPI_COMM_WORLD,
+                &status))
+        != MPI_SUCCESS) {
+        if (!cube_ack_failure(MPI_COMM_WORLD, err))
+            handle_error(err, "MPI_Probe()");
+    }
+    MPI_Check(MPI_Get_count(&status, op->type, &count));
 
-        if (c == EOF) /* EOF reached -- we're good to go */
-            break;
+    char *result = malloc((count ? (size_t)count : 1) * op->size);
+    if (!result)
+        fatal("out of memory");
+    MPI_Check(MPI_Recv(result, count, op->type, status.MPI_SOURCE,
+        TAG_FINAL_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE));
+    trace_end(TRACE_GATHER, -1, 0, start);
 
-        if (n >= g_size - 1) {
-            fprintf(stderr,
-                PROGNAME "(%d): warning: too many numeric "
-                         "entities on the list. %d values were "
-                         "expected but this is the %dth. Only first %d "
-                         "values will be taken into account\n",
-                g_rank, g_size - 1, 1 + n, g_size - 1);
-            break;
+    for (int i = 0; i < count; i++) {
+        op_print(op, stdout, result + (size_t)i * op->size);
+        putchar(i + 1 < count ? ',' : '\n');
+    }
+    free(result);
+}
+/* Receives the prefix scan from every worker in turn and prints it. In
+ * vector mode, every worker sends a buffer of partials, printed as a
+ * comma-separated line; otherwise, every value of the input gets a line of
+ * its own.
+ * @op: Operator of the scan
+ * @first_worker: Rank of the first worker
+ * @num_workers: Number of worker processes
+ * @vector: Whether the scan is element-wise across the workers
+ */
+static void receive_scan(
+    const struct op *op, int first_worker, int num_workers, int vector)
+{
+    for (int n = 0; n < num_workers; n++) {
+        MPI_Status status;
+        int count;
+        MPI_Check(MPI_Probe(
+            first_worker + n, TAG_FINAL_RESULT, MPI_COMM_WORLD, &status));
+        MPI_Check(MPI_Get_count(&status, op->type, &count));
+
+        char *result = malloc((count ? (size_t)count : 1) * op->size);
+        if (!result)
+            fatal("out of memory");
+        MPI_Check(MPI_Recv(result, count, op->type, first_worker + n,
+            TAG_FINAL_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE));
+        for (int i = 0; i < count; i++) {
+            op_print(op, stdout, result + (size_t)i * op->size);
+            putchar(vector && i + 1 < count ? ',' : '\n');
         }
+        free(result);
+    }
+}
+
+/* Receives the quantiles selected by the workers and prints them, one per
+ * line.
+ * @t: Element type of the values
+ */
+static void receive_quantiles(enum dtype t)
+{
+    MPI_Status status;
+    int count;
+    MPI_Check(MPI_Probe(MPI_ANY_SOURCE, TAG_FINAL_RESULT, MPI_COMM_WORLD,
+        &status));
+    MPI_Check(MPI_Get_count(&status, dtype_mpi(t), &count));
+
+    uint64_t vals[MAX_QUANTILES];
+    char text[DTYPE_FORMAT_MAX];
+    MPI_Check(MPI_Recv(vals, count, dtype_mpi(t), status.MPI_SOURCE,
+        TAG_FINAL_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE));
+    for (int i = 0; i < count; i++) {
+        dtype_format(t, text, (char *)vals + (size_t)i * dtype_size(t));
+        puts(text);
+    }
+}
+
+/* Reads the byte range [offset, offset + len) of a file collectively. Every
+ * process in the communicator of the file must call this function, since
+ * large ranges are read through several collective calls.
+ * @fh: File handle
+ * @offset: Offset of the first byte
+ * @buf: Receives the bytes read
+ * @len: Number of bytes to read
+ * @max_len: Largest @len across all processes of the communicator
+ */
+static void read_range_all(
+    MPI_File fh, MPI_Offset offset, char *buf, size_t len, size_t max_len)
+{
+    for (size_t done = 0; done < max_len; done += IO_CHUNK_SIZE) {
+        size_t chunk = done < len ? len - done : 0;
+        if (chunk > IO_CHUNK_SIZE)
+            chunk = IO_CHUNK_SIZE;
+        MPI_Check(MPI_File_read_at_all(fh, offset + (MPI_Offset)done,
+            buf + done, (int)chunk, MPI_CHAR, MPI_STATUS_IGNORE));
+    }
+}
+
+/* Writes the byte range [offset, offset + len) of a file collectively, the
+ * counterpart of read_range_all().
+ * @fh: File handle
+ * @offset: Offset of the first byte
+ * @buf: Bytes to write
+ * @len: Number of bytes to write
+ * @max_len: Largest @len across all processes of the communicator
+ */
+static void write_range_all(MPI_File fh, MPI_Offset offset, const char *buf,
+    size_t len, size_t max_len)
+{
+    for (size_t done = 0; done < max_len; done += IO_CHUNK_SIZE) {
+        size_t chunk = done < len ? len - done : 0;
+        if (chunk > IO_CHUNK_SIZE)
+            chunk = IO_CHUNK_SIZE;
+        MPI_Check(MPI_File_write_at_all(fh, offset + (MPI_Offset)done,
+            buf + done, (int)chunk, MPI_CHAR, MPI_STATUS_IGNORE));
+    }
+}
+
+/* Reads this worker's share of the input file through MPI-IO and parses it.
+ * Every worker reads a contiguous byte range of the file. A numeric entity
+ * belongs to the worker whose range contains its first byte, so the head of
+ * a range that starts in the middle of an entity is sent to the worker that
+ * owns it, which appends it to the tail of its own range before parsing.
+ * @path: Path to the file containing the data
+ * @comm: Communicator containing all the workers
+ * @list: List receiving the values owned by this worker, of its element type
+ */
+static void read_block_parallel(
+    const char *path, MPI_Comm comm, struct value_list *list)
+{
+    int rank, size;
+    MPI_Check(MPI_Comm_rank(comm, &rank));
+    MPI_Check(MPI_Comm_size(comm, &size));
+
+    MPI_File fh;
+    int err = MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) {
+        char msg_buf[MPI_MAX_ERROR_STRING];
+        int msg_len;
+        MPI_Error_string(err, msg_buf, &msg_len);
+        fatal("could not open file `%s' for reading: %s", path, msg_buf);
+    }
+
+    MPI_Offset file_size;
+    MPI_Check(MPI_File_get_size(fh, &file_size));
+
+    /* Read our range plus the byte right before it, which tells whether the
+     * range starts in the middle of an entity. */
+    size_t first, len, max_len = (size_t)file_size / (size_t)size + 2;
+    block_range((size_t)file_size, (size_t)size, (size_t)rank, &first, &len);
+    size_t lead = rank > 0 && len > 0;
+    char *buf = malloc(lead + len + 1);
+    if (!buf)
+        fatal("out of memory");
+    read_range_all(fh, (MPI_Offset)(first - lead), buf, lead + len, max_len);
+    MPI_Check(MPI_File_close(&fh));
+
+    char *data = buf + lead;
+    int cont = lead && is_numeric_char(buf[0]) && is_numeric_char(data[0]);
+    size_t head_len = 0;
+    while (cont && head_len < len && is_numeric_char(data[head_len]))
+        head_len++;
+    int has_delim = head_len < len;
+    if (!cont) {
+        has_delim = 0;
+        for (size_t i = 0; i < len && !has_delim; i++)
+            has_delim = !is_numeric_char(data[i]);
+    }
+
+    /* Share how every range starts so that each worker can tell where its
+     * entity fragments come from and where they go. */
+    int flags[2] = { cont, has_delim };
+    int *all_flags = malloc(2 * (size_t)size * sizeof *all_flags);
+    if (!all_flags)
+        fatal("out of memory");
+    MPI_Check(MPI_Allgather(flags, 2, MPI_INT, all_flags, 2, MPI_INT, comm));
+#define RANGE_CONT(r) (all_flags[2 * (r)])
+#define RANGE_HAS_DELIM(r) (all_flags[2 * (r) + 1])
+#define RANGE_HAS_START(r) (!RANGE_CONT(r) || RANGE_HAS_DELIM(r))
+
+    /* Send our head to the worker owning the entity it belongs to. */
+    MPI_Request head_req = MPI_REQUEST_NULL;
+    if (cont) {
+        int owner = rank - 1;
+        while (owner > 0 && !RANGE_HAS_START(owner))
+            owner--;
+        if (head_len > INT_MAX)
+            fatal("numeric entity is too large");
+        MPI_Check(MPI_Isend(data, (int)head_len, MPI_CHAR, owner, TAG_HEAD,
+            comm, &head_req));
+    }
 
-        if (i >= BUFSIZ - 1) {
-            /* Buffer overflow -- skip entity */
-            logf("warning: skipping entity overflowing buffer");
-            continue;
+    /* Copy the entities we own and complete the trailing one with the heads
+     * of the following ranges. */
+    size_t own_len = len - head_len, text_len = own_len;
+    char *text = malloc(own_len + 1);
+    if (!text)
+        fatal("out of memory");
+    memcpy(text, data + head_len, own_len);
+    if (len > 0 && is_numeric_char(data[len - 1]) && RANGE_HAS_START(rank)) {
+        for (int r = rank + 1; r < size && RANGE_CONT(r); r++) {
+            MPI_Status status;
+            int frag_len;
+            MPI_Check(MPI_Probe(r, TAG_HEAD, comm, &status));
+            MPI_Check(MPI_Get_count(&status, MPI_CHAR, &frag_len));
+            char *grown = realloc(text, text_len + (size_t)frag_len + 1);
+            if (!grown)
+                fatal("out of memory");
+            text = grown;
+            MPI_Check(MPI_Recv(text + text_len, frag_len, MPI_CHAR, r,
+                TAG_HEAD, comm, MPI_STATUS_IGNORE));
+            text_len += (size_t)frag_len;
+            if (RANGE_HAS_DELIM(r))
+                break;
         }
+    }
+#undef RANGE_CONT
+#undef RANGE_HAS_DELIM
+#undef RANGE_HAS_START
+    MPI_Check(MPI_Wait(&head_req, MPI_STATUS_IGNORE));
+    free(all_flags);
+    free(buf);
+
+    parse_values(text, text_len, 1, list);
+    free(text);
+}
 
-        /* Parse double (see <https://stackoverflow.com/a/5581058>) */
-        char *endptr;
-        double val = strtod(item_buf, &endptr);
-        if (*endptr != '\0') {
-            logf("warning: skipping invalid entity (`%s')", item_buf);
-            continue;
+/* Reads the input file on the first worker and scatters a contiguous block
+ * of its values to every worker, the first one included.
+ * @path: Path to the file containing the data
+ * @workers: Communicator containing all the workers
+ * @list: List receiving the values of this worker, of its element type
+ */
+static void scatter_block(
+    const char *path, MPI_Comm workers, struct value_list *list)
+{
+    int rank, size;
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    MPI_Check(MPI_Comm_size(workers, &size));
+
+    struct value_list values = { .dtype = list->dtype };
+    int *counts = NULL, *displs = NULL;
+    if (rank == 0) {
+        parse_file(path, &values);
+        if (values.len == 0)
+            fatal("no numeric entities on the list");
+        if (values.len > INT_MAX)
+            fatal("too many values to scatter (%zu)", values.len);
+
+        counts = malloc(2 * (size_t)size * sizeof *counts);
+        if (!counts)
+            fatal("out of memory");
+        displs = counts + size;
+        for (int n = 0; n < size; n++) {
+            size_t first, count;
+            block_range(values.len, (size_t)size, (size_t)n, &first, &count);
+            counts[n] = (int)count;
+            displs[n] = (int)first;
         }
+    }
+
+    /* Everybody knows the size of its own block beforehand. */
+    unsigned long long total = values.len;
+    MPI_Check(MPI_Bcast(&total, 1, MPI_UNSIGNED_LONG_LONG, 0, workers));
+    size_t first, count;
+    block_range(total, (size_t)size, (size_t)rank, &first, &count);
+
+    MPI_Datatype type = dtype_mpi(list->dtype);
+    list->cap = count ? count : 1;
+    list->data = malloc(list->cap * dtype_size(list->dtype));
+    if (!list->data)
+        fatal("out of memory");
+    MPI_Check(MPI_Scatterv(values.data, counts, displs, type, list->data,
+        (int)count, type, 0, workers));
+    list->len = count;
+    free(counts);
+    free(values.data);
+}
+
+/* Receives this worker's block of values from the distributor process.
+ * @list: List receiving the values, of its element type
+ */
+static void receive_block(struct value_list *list)
+{
+    MPI_Datatype type = dtype_mpi(list->dtype);
+    MPI_Status status;
+    int count;
+    MPI_Check(MPI_Probe(DISTRIB_RANK, TAG_BLOCK, MPI_COMM_WORLD, &status));
+    MPI_Check(MPI_Get_count(&status, type, &count));
+
+    list->cap = count ? (size_t)count : 1;
+    list->data = malloc(list->cap * dtype_size(list->dtype));
+    if (!list->data)
+        fatal("out of memory");
+    MPI_Check(MPI_Recv(list->data, count, type, DISTRIB_RANK, TAG_BLOCK,
+        MPI_COMM_WORLD, MPI_STATUS_IGNORE));
+    list->len = (size_t)count;
+}
 
-        /* Send out this value to the rest of processes
-         * we send it to (1 + n) because first worker is always the
-         * distributor process. */
-        MPI_Check(MPI_Bsend(&val, 1, MPI_DOUBLE, 1 + n, 0, MPI_COMM_WORLD));
-        n++;
+/* Moves values between workers so that every worker holds the block that
+ * block_range() assigns to it, keeping the global order of the values.
+ * Parallel text ingestion splits the input at byte boundaries, so blocks
+ * may be uneven before this call.
+ * @workers: Communicator containing all the workers
+ * @list: Block of this worker, replaced with the balanced block
+ */
+static void rebalance_block(MPI_Comm workers, struct value_list *list)
+{
+    int rank, size;
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    MPI_Check(MPI_Comm_size(workers, &size));
+
+    /* Learn the current layout of the values across the workers. */
+    unsigned long long len = list->len;
+    unsigned long long *lens = malloc((size_t)size * sizeof *lens);
+    int *counts = malloc(4 * (size_t)size * sizeof *counts);
+    if (!lens || !counts)
+        fatal("out of memory");
+    MPI_Check(MPI_Allgather(
+        &len, 1, MPI_UNSIGNED_LONG_LONG, lens, 1, MPI_UNSIGNED_LONG_LONG,
+        workers));
+
+    size_t total = 0, my_first = 0;
+    for (int r = 0; r < size; r++) {
+        if (r == rank)
+            my_first = total;
+        total += lens[r];
     }
 
-    if (n < g_size - 1) {
-        fprintf(stderr,
-            PROGNAME "(%d): error: invalid number of values on the list. "
-                     "Expected exactly %d but got %d.\n",
-            g_rank, g_size - 1, n);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        MPI_Finalize();
-        _exit(EXIT_FAILURE);
+    /* Intersect our current range with every target block, and our target
+     * block with every current range. */
+    int *send_counts = counts, *send_displs = counts + size;
+    int *recv_counts = counts + 2 * size, *recv_displs = counts + 3 * size;
+    size_t target_first, target_len, cur_first = 0;
+    block_range(total, (size_t)size, (size_t)rank, &target_first, &target_len);
+    for (int r = 0; r < size; r++) {
+        size_t first, n;
+        block_range(total, (size_t)size, (size_t)r, &first, &n);
+        size_t lo = max(first, my_first);
+        size_t hi = first + n < my_first + list->len ? first + n
+                                                      : my_first + list->len;
+        send_counts[r] = hi > lo ? (int)(hi - lo) : 0;
+        send_displs[r] = hi > lo ? (int)(lo - my_first) : 0;
+
+        lo = max(cur_first, target_first);
+        hi = cur_first + lens[r] < target_first + target_len
+            ? cur_first + lens[r]
+            : target_first + target_len;
+        recv_counts[r] = hi > lo ? (int)(hi - lo) : 0;
+        recv_displs[r] = hi > lo ? (int)(lo - target_first) : 0;
+        cur_first += lens[r];
     }
+    if (list->len > INT_MAX || target_len > INT_MAX)
+        fatal("block of values is too large");
 
-    fclose(fp);
+    MPI_Datatype type = dtype_mpi(list->dtype);
+    void *data
+        = malloc((target_len ? target_len : 1) * dtype_size(list->dtype));
+    if (!data)
+        fatal("out of memory");
+    MPI_Check(MPI_Alltoallv(list->data, send_counts, send_displs, type, data,
+        recv_counts, recv_displs, type, workers));
 
-    /* Receive the minimum value back from the worker processes. */
-    MPI_Status status;
-    double minimum_value;
-    MPI_Recv(&minimum_value, 1, MPI_DOUBLE, MPI_ANY_SOURCE, TAG_FINAL_RESULT,
-        MPI_COMM_WORLD, &status);
-    MPI_Check(status.MPI_ERROR);
-    printf("%lf\n", minimum_value);
+    free(list->data);
+    list->data = data;
+    list->len = list->cap = target_len;
+    free(counts);
+    free(lens);
 }
 
-static void get_neighbors(int *neighbors, int dim)
+/* Returns the settings of libhypercube for those given on the command line.
+ * @opts: Settings given on the command line
+ * @count: Largest number of values reduced or scanned element-wise
+ */
+static struct hc_config reduction_config(const struct options *opts, int count)
 {
-    for (int i = 0; i < dim; i++)
-        neighbors[i] = 1 + ((g_rank - 1) ^ (1 << i));
+    struct hc_config config = HC_CONFIG_INIT;
+    config.op = opts->op_spec;
+    config.dtype = (enum hc_dtype)opts->op.dtype;
+    config.count = count;
+    config.threads = opts->threads;
+    config.arena = (enum hc_arena)opts->arena;
+    config.persistent = opts->persistent;
+    config.kernels = opts->kernels;
+    config.backend = (enum hc_backend)opts->cube.backend;
+    config.segment_size = opts->cube.segment_size;
+    config.pipeline_depth = opts->cube.pipeline_depth;
+    config.hierarchical = opts->cube.hierarchical;
+    config.shared_memory = opts->cube.shared_memory;
+    config.codec = (enum hc_codec)opts->cube.codec;
+    config.codec_dims = opts->cube.codec_dims;
+    config.timeout = opts->cube.timeout;
+    config.resilient = opts->cube.resilient;
+    return config;
 }
 
-static void do_work(int dim)
+/* Sets up a reduction context of libhypercube over the workers. The
+ * settings were checked along with the command line, so that they are
+ * always carried out.
+ * @workers: Communicator containing all the workers
+ * @config: Settings of the context, see reduction_config()
+ */
+static struct hc_ctx *open_reduction(
+    MPI_Comm workers, const struct hc_config *config)
 {
-    MPI_Status status;
+    struct hc_ctx *ctx = hc_init(workers, config);
+    if (!ctx)
+        fatal("could not set up the reduction: %s", hc_last_error());
+    return ctx;
+}
+
+/* Gives up on the run if a call of libhypercube failed.
+ * @err: What the call returned
+ */
+static void check_reduction(int err)
+{
+    if (err)
+        fatal("%s", hc_last_error());
+}
+
+/* Computes the prefix scan of the block of values of a worker, and sends it
+ * to the root process. In vector mode, the block is scanned element-wise
+ * across the workers. Otherwise, every value is combined with the values
+ * before it within the block, and then with the exclusive scan of the
+ * block totals across the workers, which yields the prefix of every value
+ * of the whole input.
+ * @opts: Settings given on the command line
+ * @workers: Communicator containing all the workers
+ * @block: Block of values of this worker
+ * @first: Global index of the first value of the block
+ */
+static void scan_block(const struct options *opts, MPI_Comm workers,
+    const struct value_list *block, long long first)
+{
+    const struct op *op = &opts->op;
+    size_t n = block->len;
+    int exclusive = opts->scan == SCAN_EXCLUSIVE;
+    if (n > INT_MAX)
+        fatal("block of %zu values is too large to scan", n);
+
+    /* Plans only ever go through reductions. */
+    struct hc_config config
+        = reduction_config(opts, opts->vector && n ? (int)n : 1);
+    config.persistent = 0;
+    struct hc_ctx *ctx = open_reduction(workers, &config);
+    char *partials = malloc((n ? n : 1) * op->size);
+    if (!partials)
+        fatal("out of memory");
+    if (opts->vector)
+        check_reduction(
+            hc_scan(ctx, block->data, partials, (int)n, exclusive));
+    else
+        check_reduction(hc_scan_block(
+            ctx, block->data, n, first, partials, exclusive));
+    check_reduction(hc_free(ctx));
+
+    /* The send is buffered, since the worker may be the root itself. */
+    reserve_bsend_buffer((int)n, op->type);
+    TRACED(TRACE_GATHER, -1, n * op->size,
+        MPI_Check(MPI_Bsend(partials, (int)n, op->type, opts->root,
+            TAG_FINAL_RESULT, MPI_COMM_WORLD)));
+    free(partials);
+}
+
+/* Sorts the values of the input across the workers, and writes them out in
+ * increasing order, one per line. Every worker radix-sorts its block, the
+ * runs are then sorted across a hypercube of the workers, and every worker
+ * writes its run at its place in the output file through MPI-IO.
+ * @opts: Settings given on the command line
+ * @workers: Communicator containing all the workers
+ * @block: Block of values of this worker
+ */
+static void sort_block(const struct options *opts, MPI_Comm workers,
+    const struct value_list *block)
+{
+    enum dtype t = block->dtype;
+    size_t n = block->len;
+    uint64_t *keys = malloc((n ? n : 1) * sizeof *keys);
+    if (!keys)
+        fatal("out of memory");
+    sort_to_keys(t, keys, block->data, n);
+    TRACED(TRACE_LOCAL, -1, 0, sort_radix(keys, n, dtype_size(t)));
+
+    /* The hand-written butterfly is the only backend that sorts. */
+    struct cube_config config = CUBE_CONFIG_INIT;
+    struct cube cube;
+    cube_init(&cube, workers, &config);
+    sort_hypercube(&cube, &keys, &n);
+    cube_free(&cube);
+
+    char *text = malloc(n * DTYPE_FORMAT_MAX + 1), *p = text;
+    if (!text)
+        fatal("out of memory");
+    for (size_t i = 0; i < n; i++) {
+        union {
+            double f64;
+            float f32;
+            int32_t i32;
+            int64_t i64;
+        } val;
+        sort_from_keys(t, &val, &keys[i], 1);
+        p += dtype_format(t, p, &val);
+        *p++ = '\n';
+    }
+    free(keys);
+
+    /* Runs are laid out in the order of the workers. */
+    long long len = p - text, offset = 0, max_len;
+    MPI_Check(
+        MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, workers));
+    MPI_Check(MPI_Allreduce(
+        &len, &max_len, 1, MPI_LONG_LONG, MPI_MAX, workers));
+    int rank;
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    if (rank == 0)
+        offset = 0;
+
+    MPI_File fh;
+    int err = MPI_File_open(workers, opts->sort,
+        MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) {
+        char msg_buf[MPI_MAX_ERROR_STRING];
+        int msg_len;
+        MPI_Error_string(err, msg_buf, &msg_len);
+        fatal("could not open file `%s' for writing: %s", opts->sort,
+            msg_buf);
+    }
+    MPI_Check(MPI_File_set_size(fh, 0));
+    TRACED(TRACE_GATHER, -1, (size_t)len,
+        write_range_all(
+            fh, (MPI_Offset)offset, text, (size_t)len, (size_t)max_len));
+    MPI_Check(MPI_File_close(&fh));
+    free(text);
+}
+
+/* Selects quantiles of the values of the input across the workers, and
+ * sends them to the root process. Values stay where they are: every
+ * quantile takes a few reductions of counts through the hypercube, see
+ * sort_select().
+ * @opts: Settings given on the command line
+ * @workers: Communicator containing all the workers
+ * @block: Block of values of this worker
+ */
+static void quantile_block(const struct options *opts, MPI_Comm workers,
+    const struct value_list *block)
+{
+    enum dtype t = block->dtype;
+    size_t n = block->len;
+    uint64_t *keys = malloc((n ? n : 1) * sizeof *keys);
+    if (!keys)
+        fatal("out of memory");
+    sort_to_keys(t, keys, block->data, n);
+
+    /* Every worker needs the counts of every round, and they are not worth
+     * compressing. */
+    struct cube_config config = opts->cube;
+    if (config.backend == BACKEND_REDUCE)
+        config.backend = BACKEND_ALLREDUCE;
+    config.codec = CODEC_NONE;
+    struct cube cube;
+    cube_init(&cube, workers, &config);
+    arena_init(&g_arena, sort_select_scratch_size(&cube), opts->arena);
+
+    uint64_t vals[MAX_QUANTILES];
+    for (int i = 0; i < opts->num_quantiles; i++) {
+        uint64_t key = sort_select(&cube, keys, n, opts->quantiles[i]);
+        sort_from_keys(t, (char *)vals + (size_t)i * dtype_size(t), &key, 1);
+    }
+    arena_free(&g_arena);
+    cube_free(&cube);
+    free(keys);
+
+    int rank;
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    if (rank == 0) {
+        /* The send is buffered, since the worker may be the root itself. */
+        reserve_bsend_buffer(opts->num_quantiles, dtype_mpi(t));
+        TRACED(TRACE_GATHER, -1, (size_t)opts->num_quantiles * dtype_size(t),
+            MPI_Check(MPI_Bsend(vals, opts->num_quantiles, dtype_mpi(t),
+                opts->root, TAG_FINAL_RESULT, MPI_COMM_WORLD)));
+    }
+}
+
+/* Obtains this worker's block of values, reduces it and takes part in the
+ * hypercube exchange. In vector mode, the block is instead reduced
+ * element-wise with the blocks of the other workers. Scans, sorts and
+ * quantiles hand the block over to scan_block(), sort_block() and
+ * quantile_block().
+ * @opts: Settings given on the command line
+ * @source: Where the block of values comes from
+ * @workers: Communicator containing all the workers
+ */
+static void do_work(
+    const struct options *opts, enum input_source source, MPI_Comm workers)
+{
+    struct value_list block = { .dtype = opts->op.dtype };
+    struct binfile_slice slice = { 0 };
+    int rank, size;
+
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    MPI_Check(MPI_Comm_size(workers, &size));
+
+    double start = trace_begin();
+    switch (source) {
+    case INPUT_DISTRIBUTOR:
+        receive_block(&block);
+        break;
+    case INPUT_SCATTER:
+        scatter_block(opts->path, workers, &block);
+        break;
+    case INPUT_PARALLEL_TEXT:
+        read_block_parallel(opts->path, workers, &block);
+        if (opts->vector)
+            rebalance_block(workers, &block);
+        break;
+    case INPUT_BINARY:
+        binfile_map_slice(opts->path, (size_t)rank, (size_t)size, &slice);
+        block.data = slice.data;
+        block.len = slice.count;
+        break;
+    }
+    trace_end(TRACE_INPUT, -1, 0, start);
+
+    /* Global index of our first value, for operators reporting indices. */
+    long long first = 0, len = (long long)block.len;
+    MPI_Check(MPI_Exscan(&len, &first, 1, MPI_LONG_LONG, MPI_SUM, workers));
+    if (rank == 0)
+        first = 0;
+
+    /* Reduce our block locally before going through the hypercube, unless
+     * the block itself is what we reduce. */
+    int count = 1;
+    if (opts->vector) {
+        /* Get the largest and the smallest block length in one call. */
+        unsigned long long lens[2] = { block.len, ULLONG_MAX - block.len };
+        MPI_Check(MPI_Allreduce(MPI_IN_PLACE, lens, 2, MPI_UNSIGNED_LONG_LONG,
+            MPI_MAX, workers));
+        if (lens[0] != ULLONG_MAX - lens[1] || lens[0] > INT_MAX)
+            fatal("vector mode needs the same number of values on every "
+                  "worker");
+        count = (int)block.len;
+    }
+
+    if (opts->scan || opts->sort || opts->num_quantiles) {
+        if (opts->scan)
+            scan_block(opts, workers, &block, first);
+        else if (opts->sort)
+            sort_block(opts, workers, &block);
+        else
+            quantile_block(opts, workers, &block);
+        if (source == INPUT_BINARY)
+            binfile_unmap_slice(&slice);
+        else
+            free(block.data);
+        return;
+    }
+
+    /* Everything the reduction needs is set up once, ahead of the
+     * repetitions. */
+    struct hc_config config = reduction_config(opts, count ? count : 1);
+    struct hc_ctx *ctx = open_reduction(workers, &config);
+    void *result = malloc((count ? (size_t)count : 1) * opts->op.size);
+    if (!result)
+        fatal("out of memory");
+    const void *vals = block.data;
+#ifdef HAVE_CUDA
+    /* The block is uploaded to the device once, and then reduced where it
+     * sits by every repetition. Only the result ever comes back. */
+    void *dev = NULL;
+    if (opts->op.device) {
+        size_t block_size = block.len * dtype_size(block.dtype);
+        dev = device_alloc(block_size ? block_size : 1);
+        device_upload(dev, block.data, block_size);
+        vals = dev;
+    }
+#endif
+
+    /* Reduce locally, then across the hypercube, as many times as asked. */
+    for (int i = 0; i < opts->repeat; i++) {
+        if (opts->vector)
+            check_reduction(hc_reduce(ctx, vals, result, count));
+        else
+            check_reduction(
+                hc_reduce_block(ctx, vals, block.len, first, result));
+    }
+#ifdef HAVE_CUDA
+    if (dev)
+        device_free(dev);
+#endif
+    if (source == INPUT_BINARY)
+        binfile_unmap_slice(&slice);
+    else
+        free(block.data);
+
+    /* Send out the result to the root process. The first worker always
+     * holds it, so it is the one reporting it. The send is buffered, since
+     * the first worker may be the root itself. */
+    if (hc_rank(ctx) == 0) {
+        reserve_bsend_buffer(count, opts->op.type);
+        TRACED(TRACE_GATHER, -1, (size_t)count * opts->op.size,
+            MPI_Check(MPI_Bsend(result, count, opts->op.type, opts->root,
+                TAG_FINAL_RESULT, MPI_COMM_WORLD)));
+    }
+    free(result);
+    check_reduction(hc_free(ctx));
+}
+
+/* Process reading records for streaming mode and sending them out to the
+ * workers one window at a time. Every window is sent from one of two
+ * buffers, so that the next window can be read and sent while the workers
+ * are still reducing this one. */
+struct feeder {
+    struct stream stream;
+    struct value_list window; /* records of the window being filled */
+    size_t fresh; /* records since the last window was sent */
+    size_t size, slide; /* records per window, and between windows */
+    double period; /* seconds after which a window is sent anyway, or 0 */
+    int num_workers, first_worker; /* workers, as ranks of MPI_COMM_WORLD */
+    void *bufs[2];
+    MPI_Request *reqs[2]; /* sends out of every buffer */
+    int turn; /* buffer of the next window */
+};
+
+/* Opens the input of a feeder.
+ * @feeder: Feeder to be set up
+ * @opts: Settings given on the command line
+ * @num_workers: Number of worker processes
+ */
+static void feeder_open(
+    struct feeder *feeder, const struct options *opts, int num_workers)
+{
+    memset(feeder, 0, sizeof *feeder);
+    stream_open(&feeder->stream, opts->path, opts->follow, opts->op.dtype);
+    feeder->window.dtype = opts->op.dtype;
+    feeder->size = opts->window;
+    feeder->slide = opts->slide ? opts->slide : opts->window;
+    feeder->period = opts->window_time;
+    feeder->num_workers = num_workers;
+    feeder->first_worker = opts->no_distributor ? 0 : 1;
+    for (int i = 0; i < 2; i++) {
+        feeder->bufs[i] = malloc(feeder->size * dtype_size(opts->op.dtype));
+        feeder->reqs[i] = malloc((size_t)num_workers * sizeof **feeder->reqs);
+        if (!feeder->bufs[i] || !feeder->reqs[i])
+            fatal("out of memory");
+        for (int n = 0; n < num_workers; n++)
+            feeder->reqs[i][n] = MPI_REQUEST_NULL;
+    }
+}
+
+/* Fills the next window and sends it out, one contiguous share to every
+ * worker. A window is sent once @slide records arrived since the last one,
+ * once the period of the window passed with any record in it, or at the end
+ * of the input; it holds the last @size records. At the end of the input,
+ * every worker is told to stop instead.
+ * Returns 0 once the end of the input has been sent out.
+ * @feeder: Feeder
+ */
+static int feed_window(struct feeder *feeder)
+{
+    struct value_list *window = &feeder->window;
+    size_t size = dtype_size(window->dtype);
+
+    while (feeder->fresh < feeder->slide && !stream_done(&feeder->stream)) {
+        double until = feeder->period > 0 ? MPI_Wtime() + feeder->period : -1;
+        feeder->fresh += stream_read(&feeder->stream, window,
+            feeder->slide - feeder->fresh, until);
+        if (window->len > feeder->size) {
+            size_t drop = window->len - feeder->size;
+            memmove(window->data, value_list_at(window, drop),
+                feeder->size * size);
+            window->len = feeder->size;
+        }
+        if (feeder->fresh > 0 && feeder->period > 0 && MPI_Wtime() >= until)
+            break;
+    }
+
+    /* The buffer was last sent out two windows ago. */
+    int turn = feeder->turn, num_workers = feeder->num_workers;
+    MPI_Check(
+        MPI_Waitall(num_workers, feeder->reqs[turn], MPI_STATUSES_IGNORE));
+    if (feeder->fresh == 0) {
+        for (int n = 0; n < num_workers; n++) {
+            MPI_Check(MPI_Send(NULL, 0, dtype_mpi(window->dtype),
+                feeder->first_worker + n, TAG_STREAM_END, MPI_COMM_WORLD));
+        }
+        MPI_Check(MPI_Waitall(
+            num_workers, feeder->reqs[turn ^ 1], MPI_STATUSES_IGNORE));
+        return 0;
+    }
 
-    /* Receive value from the distributor process. */
-    double distrib_val;
-    MPI_Recv(&distrib_val, 1, MPI_DOUBLE, DISTRIB_RANK, MPI_ANY_TAG,
-        MPI_COMM_WORLD, &status);
-    MPI_Check(status.MPI_ERROR);
-
-    /* Obtain neighbor processes. */
-    int neighbors[dim];
-    get_neighbors(neighbors, dim);
-
-    /* Receive value from neighbor and calculate maximum. */
-    double neighbor_val;
-    for (int i = 0; i < dim; i++) {
-        MPI_Check(MPI_Bsend(
-            &distrib_val, 1, MPI_DOUBLE, neighbors[i], 0, MPI_COMM_WORLD));
-        MPI_Recv(&neighbor_val, 1, MPI_DOUBLE, neighbors[i], MPI_ANY_TAG,
-            MPI_COMM_WORLD, &status);
-        MPI_Check(status.MPI_ERROR);
-        distrib_val = max(distrib_val, neighbor_val);
-    }
-
-    /* Send out the minimum value back to the distributor process. */
-    MPI_Check(MPI_Bsend(&distrib_val, 1, MPI_DOUBLE, DISTRIB_RANK,
-        TAG_FINAL_RESULT, MPI_COMM_WORLD));
+    memcpy(feeder->bufs[turn], window->data, window->len * size);
+    for (int n = 0; n < num_workers; n++) {
+        size_t first, count;
+        block_range(window->len, (size_t)num_workers, (size_t)n, &first,
+            &count);
+        MPI_Check(MPI_Isend((char *)feeder->bufs[turn] + first * size,
+            (int)count, dtype_mpi(window->dtype), feeder->first_worker + n,
+            TAG_BLOCK, MPI_COMM_WORLD, &feeder->reqs[turn][n]));
+    }
+    if (feeder->slide == feeder->size)
+        window->len = 0;
+    feeder->fresh = 0;
+    feeder->turn ^= 1;
+    return 1;
+}
+
+/* Releases a feeder set up by feeder_open().
+ * @feeder: Feeder
+ */
+static void feeder_close(struct feeder *feeder)
+{
+    stream_close(&feeder->stream);
+    free(feeder->window.data);
+    for (int i = 0; i < 2; i++) {
+        free(feeder->bufs[i]);
+        free(feeder->reqs[i]);
+    }
+}
+
+/* Reduces windows of records as they come from the feeder, until it runs
+ * out of them. The share of the next window is received while this one is
+ * being reduced. The first worker prints the result of every window on a
+ * line of its own.
+ * @opts: Settings given on the command line
+ * @workers: Communicator containing all the workers
+ * @feeder: Feeder, if this worker is the one reading the input, or NULL
+ */
+static void stream_work(
+    const struct options *opts, MPI_Comm workers, struct feeder *feeder)
+{
+    const struct op *op = &opts->op;
+    MPI_Datatype type = dtype_mpi(op->dtype);
+    int rank, size;
+    MPI_Check(MPI_Comm_rank(workers, &rank));
+    MPI_Check(MPI_Comm_size(workers, &size));
+
+    /* No share of a window is larger than this. */
+    size_t share = (opts->window + (size_t)size - 1) / (size_t)size;
+    size_t share_size = share * dtype_size(op->dtype);
+
+    struct hc_config config = reduction_config(opts, 1);
+    struct hc_ctx *ctx = open_reduction(workers, &config);
+    void *bufs[2] = { malloc(share_size), malloc(share_size) };
+    void *result = malloc(op->size);
+    if (!bufs[0] || !bufs[1] || !result)
+        fatal("out of memory");
+
+    MPI_Request req;
+    MPI_Check(MPI_Irecv(bufs[0], (int)share, type, DISTRIB_RANK, MPI_ANY_TAG,
+        MPI_COMM_WORLD, &req));
+    for (int turn = 0, feeding = feeder != NULL;; turn ^= 1) {
+        if (feeding)
+            feeding = feed_window(feeder);
+
+        MPI_Status status;
+        int count;
+        TRACED(TRACE_INPUT, -1, 0, MPI_Check(MPI_Wait(&req, &status)));
+        if (status.MPI_TAG == TAG_STREAM_END)
+            break;
+        MPI_Check(MPI_Get_count(&status, type, &count));
+        MPI_Check(MPI_Irecv(bufs[turn ^ 1], (int)share, type, DISTRIB_RANK,
+            MPI_ANY_TAG, MPI_COMM_WORLD, &req));
+
+        /* Global index of our first record within the window. */
+        long long first = 0, len = count;
+        MPI_Check(
+            MPI_Exscan(&len, &first, 1, MPI_LONG_LONG, MPI_SUM, workers));
+        if (rank == 0)
+            first = 0;
+
+        check_reduction(
+            hc_reduce_block(ctx, bufs[turn], (size_t)count, first, result));
+        if (hc_rank(ctx) == 0) {
+            op_print(op, stdout, result);
+            putchar('\n');
+            fflush(stdout);
+        }
+    }
+
+    free(result);
+    free(bufs[0]);
+    free(bufs[1]);
+    check_reduction(hc_free(ctx));
+}
+
+/* Runs the benchmark over every backend, or the one asked for, and every
+ * operator of the operator specification taken on its own.
+ * @opts: Settings given on the command line
+ * @workers: Communicator containing all the workers
+ */
+static void run_bench(const struct options *opts, MPI_Comm workers)
+{
+    struct op ops[OP_MAX_FUSED];
+    int num_ops = 1;
+    if (opts->op.kind == OP_FUSED) {
+        num_ops = opts->op.num_children;
+        for (int i = 0; i < num_ops; i++) {
+            ops[i] = opts->op.children[i];
+            ops[i].offset = 0;
+            op_init(&ops[i]);
+        }
+    } else {
+        ops[0] = opts->op;
+    }
+
+    enum cube_backend backends[CUBE_NUM_BACKENDS];
+    int num_backends = 1;
+    backends[0] = opts->cube.backend;
+    if (opts->all_backends) {
+        for (num_backends = 0; num_backends < CUBE_NUM_BACKENDS;
+             num_backends++)
+            backends[num_backends] = (enum cube_backend)num_backends;
+    }
+
+    /* Every size gets a tenth of its iterations as warm-up. */
+    struct bench_config config = {
+        .format = opts->bench_format,
+        .min_size = opts->bench_min,
+        .max_size = opts->bench_max,
+        .warmup = opts->repeat / 10 + 1,
+        .iterations = opts->repeat,
+        .ops = ops,
+        .num_ops = num_ops,
+        .backends = backends,
+        .num_backends = num_backends,
+        .hc = reduction_config(opts, 1),
+    };
+    bench_run(workers, &config, stdout);
+
+    if (opts->op.kind == OP_FUSED) {
+        for (int i = 0; i < num_ops; i++)
+            op_free(&ops[i]);
+    }
+}
+
+static void print_usage(void)
+{
+    printf("usage: " PROGNAME " [OPTIONS] [DIMENSION] INPUT_FILE\n"
+           "       " PROGNAME " --bench=FORMAT [OPTIONS] [DIMENSION]\n\n"
+           "options:\n"
+           "  -o, --op=NAME[,NAME...]  reduction operator: max (default),\n"
+           "                           min, sum, prod, argmax, argmin, mean,\n"
+           "                           var or topk:K; several operators are\n"
+           "                           fused into a single exchange and\n"
+           "                           their results separated by `;'\n"
+           "  -b, --backend=NAME       how the reduction is carried out:\n"
+           "                           hypercube (default), reduce,\n"
+           "                           allreduce, cart, neighbor, halving\n"
+           "                           or rma\n"
+           "  -p, --parallel-io        every worker reads its own share of\n"
+           "                           the input file through MPI-IO\n"
+           "  -n, --no-distributor     run the hypercube on ranks 0 to\n"
+           "                           2^DIMENSION - 1, with no dedicated\n"
+           "                           distributor process\n"
+           "  -r, --root=RANK          rank printing the result (default 0)\n"
+           "  -v, --vector             reduce the blocks of the workers\n"
+           "                           element-wise instead of to a single\n"
+           "                           value\n"
+           "  -s, --segment-size=SIZE  pipeline hypercube rounds in\n"
+           "                           segments of SIZE bytes (k, m or g\n"
+           "                           suffixes allowed)\n"
+           "  -k, --pipeline-depth=K   segments in flight when pipelining\n"
+           "                           (default 2)\n"
+           "  -H, --hierarchical       reduce within every node first, and\n"
+           "                           run the hypercube across node\n"
+           "                           leaders only\n"
+           "  -m, --shared-memory      hypercube backend: exchange partials\n"
+           "                           with partners on the same node\n"
+           "                           through shared memory\n"
+           "  -c, --compress=CODEC[:DIMS]\n"
+           "                           hypercube backend: encode the\n"
+           "                           partials sent in the dimensions of\n"
+           "                           the comma-separated list DIMS, or\n"
+           "                           else in those leaving the node, with\n"
+           "                           xor or lz4 (if built with `make\n"
+           "                           LZ4=1'), which are lossless, or with\n"
+           "                           the lossy f16 or bf16 for max, min,\n"
+           "                           sum or prod of f32 or f64 values\n"
+           "  -W, --timeout=MS         hypercube backend: give up on a\n"
+           "                           partner not answering within MS\n"
+           "                           milliseconds instead of hanging\n"
+           "  -E, --resilient          hypercube backend: go on without\n"
+           "                           the workers that fail during the\n"
+           "                           reduction (if built with `make\n"
+           "                           ULFM=1'); the values of failed\n"
+           "                           workers are left out, but may\n"
+           "                           still be part of a max or a min\n"
+           "  -t, --threads=N          reduce the local block of every\n"
+           "                           worker with N threads (default 1)\n"
+           "  -K, --kernels=ISA        instruction set of the combine\n"
+           "                           kernels: avx512, avx2, sse2 or neon\n"
+           "                           (default: the widest supported)\n"
+           "  -d, --dtype=TYPE         type of the values: f64 (default),\n"
+           "                           f32, i32 or i64; binary input files\n"
+           "                           carry their own\n"
+           "  -A, --arena=KIND         memory of the reduction buffers: heap\n"
+           "                           (default), hugepages, mpi, for\n"
+           "                           MPI_Alloc_mem, or device (if built\n"
+           "                           with `make CUDA=1'), to reduce max,\n"
+           "                           min, sum or prod on the GPU and hand\n"
+           "                           device buffers to a CUDA-aware MPI\n"
+           "  -R, --repeat=N           carry out the reduction N times\n"
+           "                           (default 1)\n"
+           "  -P, --persistent         set up the transfers of the\n"
+           "                           reduction once, as persistent\n"
+           "                           requests reused by every repetition\n"
+           "  -w, --window=N           streaming mode: read records until\n"
+           "                           the end of INPUT_FILE (`-' for the\n"
+           "                           standard input) and print a result\n"
+           "                           for every window of N records\n"
+           "  -S, --slide=M            start a window every M records,\n"
+           "                           holding the last N (default N)\n"
+           "  -T, --window-time=MS     close a window after MS milliseconds\n"
+           "                           with fewer records if need be\n"
+           "  -F, --follow             wait for more data at the end of\n"
+           "                           INPUT_FILE, as tail -f does\n"
+           "  -B, --bench=FORMAT       measure reductions of synthetic data\n"
+           "                           on every process instead, and report\n"
+           "                           them as csv or json; every backend\n"
+           "                           unless --backend is given, every\n"
+           "                           operator of --op on its own, and\n"
+           "                           --repeat timed iterations per size\n"
+           "                           (default 100)\n"
+           "  -z, --sizes=MIN:MAX      bytes of partials per process swept\n"
+           "                           by --bench (default 8:64m)\n"
+           "  -x, --scan=KIND          print the inclusive or exclusive\n"
+           "                           prefix reduction of every value of\n"
+           "                           the input instead, one per line, or\n"
+           "                           in vector mode that of the block of\n"
+           "                           every worker, one line per worker;\n"
+           "                           exclusive ones start out empty;\n"
+           "                           scans go through MPI_Scan() with the\n"
+           "                           reduce and allreduce backends and\n"
+           "                           through a butterfly with the others,\n"
+           "                           without pipelining, shared memory or\n"
+           "                           compression\n"
+           "  -O, --sort=OUTPUT        write the values of the input to\n"
+           "                           OUTPUT in increasing order, one per\n"
+           "                           line, instead of reducing them\n"
+           "  -q, --quantile=P[,P...]  print the quantiles P of the values\n"
+           "                           of the input, between 0 and 1, one\n"
+           "                           per line, instead of reducing them;\n"
+           "                           the value of rank ceil(P * N) among\n"
+           "                           the N values in increasing order\n"
+           "  -X, --trace=FILE         time every phase on every process,\n"
+           "                           write the timeline to FILE for\n"
+           "                           chrome://tracing or Perfetto, and\n"
+           "                           print a summary to standard error\n\n"
+           "Without a DIMENSION, every process takes part: process counts\n"
+           "that are not a power of two are folded into the largest\n"
+           "hypercube that fits.\n\n"
+           "Binary input files (see tools/convert_input.py) are detected\n"
+           "automatically and mapped by every worker. Without a\n"
+           "distributor, text input files are read by rank 0 and\n"
+           "scattered, unless --parallel-io is given.\n\n");
 }
 
 int main(int argc, char **argv)
 {
-    if (argc != 3) {
-        printf("usage: mpi_hypercube DIMENSION INPUT_FILE\n\n");
-        return EXIT_SUCCESS;
+    static const struct option long_options[] = {
+        { "op", required_argument, NULL, 'o' },
+        { "backend", required_argument, NULL, 'b' },
+        { "parallel-io", no_argument, NULL, 'p' },
+        { "no-distributor", no_argument, NULL, 'n' },
+        { "root", required_argument, NULL, 'r' },
+        { "vector", no_argument, NULL, 'v' },
+        { "segment-size", required_argument, NULL, 's' },
+        { "pipeline-depth", required_argument, NULL, 'k' },
+        { "hierarchical", no_argument, NULL, 'H' },
+        { "shared-memory", no_argument, NULL, 'm' },
+        { "compress", required_argument, NULL, 'c' },
+        { "timeout", required_argument, NULL, 'W' },
+        { "resilient", no_argument, NULL, 'E' },
+        { "threads", required_argument, NULL, 't' },
+        { "kernels", required_argument, NULL, 'K' },
+        { "dtype", required_argument, NULL, 'd' },
+        { "arena", required_argument, NULL, 'A' },
+        { "repeat", required_argument, NULL, 'R' },
+        { "persistent", no_argument, NULL, 'P' },
+        { "window", required_argument, NULL, 'w' },
+        { "slide", required_argument, NULL, 'S' },
+        { "window-time", required_argument, NULL, 'T' },
+        { "follow", no_argument, NULL, 'F' },
+        { "bench", required_argument, NULL, 'B' },
+        { "sizes", required_argument, NULL, 'z' },
+        { "trace", required_argument, NULL, 'X' },
+        { "scan", required_argument, NULL, 'x' },
+        { "sort", required_argument, NULL, 'O' },
+        { "quantile", required_argument, NULL, 'q' },
+        { NULL, 0, NULL, 0 },
+    };
+    struct options opts = { .root = DISTRIB_RANK, .threads = 1, .repeat = -1,
+        .bench_min = 8, .bench_max = 64 << 20, .all_backends = 1,
+        .cube = CUBE_CONFIG_INIT };
+    int backend, arena, codec, format, opt, window_ms, timeout_ms;
+    int dtype = -1;
+    char *colon, *end;
+
+    opts.op_spec = "max";
+    op_parse(opts.op_spec, &opts.op);
+    while ((opt = getopt_long(argc, argv,
+                "o:b:pnr:vs:k:Hmc:W:Et:K:d:A:R:Pw:S:T:FB:z:X:x:O:q:",
+                long_options, NULL))
+        != -1) {
+        switch (opt) {
+        case 'o':
+            if (op_parse(optarg, &opts.op) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown operator `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.op_spec = optarg;
+            break;
+        case 'b':
+            if ((backend = cube_parse_backend(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown backend `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.cube.backend = (enum cube_backend)backend;
+            opts.all_backends = 0;
+            break;
+        case 'p':
+            opts.parallel_io = 1;
+            break;
+        case 'n':
+            opts.no_distributor = 1;
+            break;
+        case 'r':
+            if ((opts.root = parse_dimensions(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: invalid rank `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            opts.vector = 1;
+            break;
+        case 's':
+            if (parse_size(optarg, &opts.cube.segment_size) < 0) {
+                fprintf(stderr, PROGNAME ": error: invalid size `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'k':
+            opts.cube.pipeline_depth = parse_dimensions(optarg);
+            if (opts.cube.pipeline_depth < 1
+                || opts.cube.pipeline_depth > CUBE_MAX_PIPELINE_DEPTH) {
+                fprintf(stderr,
+                    PROGNAME ": error: pipeline depth must be between 1 and "
+                             "%d\n",
+                    CUBE_MAX_PIPELINE_DEPTH);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            opts.cube.hierarchical = 1;
+            break;
+        case 'm':
+            opts.cube.shared_memory = 1;
+            break;
+        case 'c':
+            if ((colon = strchr(optarg, ':')))
+                *colon = '\0';
+            if ((codec = codec_parse(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown codec `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.cube.codec = (enum codec_kind)codec;
+            opts.cube.codec_dims = 0;
+            for (char *p = colon; p; p = strchr(p, ',')) {
+                char *end;
+                long i = strtol(++p, &end, 10);
+                if (end == p || (*end && *end != ',') || i < 0
+                    || i >= CUBE_MAX_DIM) {
+                    fprintf(stderr,
+                        PROGNAME ": error: invalid dimensions `%s'\n",
+                        colon + 1);
+                    return EXIT_FAILURE;
+                }
+                opts.cube.codec_dims |= (uint32_t)1 << i;
+            }
+            break;
+        case 't':
+            if ((opts.threads = parse_dimensions(optarg)) < 1) {
+                fprintf(stderr,
+                    PROGNAME ": error: invalid number of threads `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+#ifndef _OPENMP
+            if (opts.threads > 1) {
+                fprintf(stderr,
+                    PROGNAME ": error: built without OpenMP, --threads is "
+                             "not available\n");
+                return EXIT_FAILURE;
+            }
+#endif
+            break;
+        case 'K':
+            opts.kernels = optarg;
+            break;
+        case 'd':
+            if ((dtype = dtype_parse(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown data type `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'A':
+            if ((arena = arena_parse_kind(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown arena `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.arena = (enum arena_kind)arena;
+            break;
+        case 'R':
+            if ((opts.repeat = parse_dimensions(optarg)) < 1) {
+                fprintf(stderr,
+                    PROGNAME ": error: invalid number of repetitions `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'P':
+            opts.persistent = 1;
+            break;
+        case 'w':
+        case 'S':
+            if (parse_size(optarg, opt == 'w' ? &opts.window : &opts.slide) < 0
+                || (opt == 'w' ? opts.window : opts.slide) - 1 >= INT_MAX) {
+                fprintf(stderr,
+                    PROGNAME ": error: invalid number of records `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            if ((window_ms = parse_dimensions(optarg)) < 1) {
+                fprintf(stderr, PROGNAME ": error: invalid period `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.window_time = window_ms / 1e3;
+            break;
+        case 'F':
+            opts.follow = 1;
+            break;
+        case 'W':
+            if ((timeout_ms = parse_dimensions(optarg)) < 1) {
+                fprintf(stderr, PROGNAME ": error: invalid timeout `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.cube.timeout = timeout_ms / 1e3;
+            break;
+        case 'E':
+            opts.cube.resilient = 1;
+            break;
+        case 'B':
+            if ((format = bench_parse_format(optarg)) < 0) {
+                fprintf(stderr, PROGNAME ": error: unknown format `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            opts.bench = 1;
+            opts.bench_format = (enum bench_format)format;
+            break;
+        case 'X':
+            opts.trace = optarg;
+            break;
+        case 'O':
+            opts.sort = optarg;
+            break;
+        case 'q':
+            opts.num_quantiles = 0;
+            for (char *p = optarg;; p = end + 1) {
+                double q = strtod(p, &end);
+                if (end == p || (*end != ',' && *end != '\0') || !(q >= 0)
+                    || q > 1 || opts.num_quantiles == MAX_QUANTILES) {
+                    fprintf(stderr,
+                        PROGNAME ": error: invalid quantiles `%s'\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                opts.quantiles[opts.num_quantiles++] = q;
+                if (*end == '\0')
+                    break;
+            }
+            break;
+        case 'x':
+            if (!strcmp(optarg, "inclusive")) {
+                opts.scan = SCAN_INCLUSIVE;
+            } else if (!strcmp(optarg, "exclusive")) {
+                opts.scan = SCAN_EXCLUSIVE;
+            } else {
+                fprintf(stderr, PROGNAME ": error: unknown scan `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'z':
+            /* MIN:MAX, or a single size. */
+            if ((colon = strchr(optarg, ':')))
+                *colon = '\0';
+            if (parse_size(optarg, &opts.bench_min) < 0
+                || parse_size(colon ? colon + 1 : optarg, &opts.bench_max) < 0
+                || opts.bench_min == 0 || opts.bench_min > opts.bench_max) {
+                fprintf(stderr, PROGNAME ": error: invalid sizes `%s'\n",
+                    optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            print_usage();
+            return EXIT_FAILURE;
+        }
     }
 
-    if (MPI_Init(&argc, &argv) != MPI_SUCCESS) {
+    /* Benchmarks run on synthetic data, and take no input file. */
+    int num_args = argc - optind + opts.bench;
+    if (num_args != 1 && num_args != 2) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+    const char *dim_arg = num_args == 2 ? argv[optind] : NULL;
+    opts.path = opts.bench ? NULL : argv[argc - 1];
+    if (opts.bench && opts.window) {
+        fprintf(stderr,
+            PROGNAME ": error: --bench cannot be combined with --window\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.scan || opts.sort || opts.num_quantiles)
+        && (opts.window || opts.bench || opts.repeat > 1)) {
+        fprintf(stderr, PROGNAME ": error: --scan, --sort and --quantile "
+                                 "cannot be combined with --window, "
+                                 "--bench or --repeat\n");
+        return EXIT_FAILURE;
+    }
+    if (!!opts.scan + !!opts.sort + !!opts.num_quantiles > 1) {
+        fprintf(stderr, PROGNAME ": error: --scan, --sort and --quantile "
+                                 "cannot be combined\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.sort || opts.num_quantiles) && opts.vector) {
+        fprintf(stderr, PROGNAME ": error: --sort and --quantile cannot be "
+                                 "combined with --vector\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.cube.timeout > 0 || opts.cube.resilient) && opts.bench) {
+        fprintf(stderr, PROGNAME ": error: --timeout and --resilient cannot "
+                                 "be combined with --bench\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.cube.timeout > 0 && (opts.scan || opts.sort)) {
+        fprintf(stderr, PROGNAME ": error: --timeout cannot be combined "
+                                 "with --scan or --sort\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.cube.resilient
+        && (opts.scan || opts.sort || opts.num_quantiles || opts.window)) {
+        fprintf(stderr, PROGNAME ": error: --resilient cannot be combined "
+                                 "with --scan, --sort, --quantile or "
+                                 "--window\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.arena == ARENA_DEVICE
+        && (opts.vector || opts.window || opts.bench || opts.scan
+            || opts.sort || opts.num_quantiles)) {
+        fprintf(stderr, PROGNAME ": error: --arena=device cannot be "
+                                 "combined with --vector, --window, "
+                                 "--bench, --scan, --sort or --quantile\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.bench)
+        opts.no_distributor = 1;
+    if (opts.repeat < 0)
+        opts.repeat = opts.bench ? 100 : 1;
+    if ((opts.slide || opts.window_time > 0 || opts.follow) && !opts.window) {
+        fprintf(stderr, PROGNAME ": error: --slide, --window-time and "
+                                 "--follow need --window\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.slide > opts.window) {
+        fprintf(stderr, PROGNAME ": error: windows cannot slide by more "
+                                 "records than they hold\n");
+        return EXIT_FAILURE;
+    }
+    /* Streaming mode reduces every window to a single value, printed by the
+     * first worker as soon as it is ready. */
+    if (opts.window
+        && (opts.vector || opts.parallel_io || opts.repeat > 1
+            || opts.root != DISTRIB_RANK)) {
+        fprintf(stderr, PROGNAME ": error: --window cannot be combined with "
+                                 "--vector, --parallel-io, --repeat or "
+                                 "--root\n");
+        return EXIT_FAILURE;
+    }
+    /* Only the main thread of a process ever makes MPI calls. */
+    int provided;
+    if (MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided)
+        != MPI_SUCCESS) {
         fprintf(stderr, PROGNAME ": error: MPI initialization failed\n");
         return EXIT_FAILURE;
     }
@@ -235,9 +1668,55 @@ int main(int argc, char **argv)
     MPI_Check(MPI_Comm_rank(MPI_COMM_WORLD, &g_rank));
     MPI_Check(MPI_Comm_size(MPI_COMM_WORLD, &g_size));
 
+    /* Binary input files are always mapped by the workers themselves, and
+     * tell the type of their values. */
+    struct binfile_header hdr;
+    enum input_source source
+        = opts.no_distributor ? INPUT_SCATTER : INPUT_DISTRIBUTOR;
+    if (opts.path && !opts.window && binfile_probe(opts.path, &hdr)) {
+        source = INPUT_BINARY;
+        if (dtype >= 0 && dtype != hdr.dtype)
+            fatal("`%s' holds values of type %s, not %s", opts.path,
+                dtype_name(hdr.dtype), dtype_name(dtype));
+        dtype = hdr.dtype;
+    } else if (opts.parallel_io) {
+        source = INPUT_PARALLEL_TEXT;
+    }
+    opts.op.dtype = dtype < 0 ? DTYPE_F64 : (enum dtype)dtype;
+    opts.op.kernels = kernels_find(opts.kernels);
+    op_init(&opts.op);
+
+    /* The settings of the reductions are those of libhypercube. */
+    struct hc_config config = reduction_config(&opts, 1);
+    if (hc_check_config(&config)) {
+        if (g_rank == 0)
+            fprintf(stderr, PROGNAME ": error: %s\n", hc_last_error());
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+#ifdef HAVE_CUDA
+    /* Every process takes a device of its node. */
+    if (opts.arena == ARENA_DEVICE) {
+        MPI_Comm node;
+        int node_rank;
+        MPI_Check(MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED,
+            g_rank, MPI_INFO_NULL, &node));
+        MPI_Check(MPI_Comm_rank(node, &node_rank));
+        MPI_Check(MPI_Comm_free(&node));
+        device_select(node_rank);
+        opts.op.device = 1;
+    }
+#endif
+
+    /* Failures of processes are reported to us rather than fatal, so that
+     * the reduction can go on without them. */
+    if (opts.cube.resilient)
+        MPI_Check(MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN));
+
     /* Parse and check dimension for the hypercube topology. */
-    int dim = parse_dimensions(argv[1]);
-    if (dim < 2) {
+    int dim = opts.dim = dim_arg ? parse_dimensions((char *)dim_arg) : -1;
+    if (dim_arg && (dim < 2 || dim > CUBE_MAX_DIM)) {
         fprintf(stderr, PROGNAME "(%d): error: invalid dimension (%d)\n",
             g_rank, dim);
         MPI_Check(MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE));
@@ -246,7 +1725,9 @@ int main(int argc, char **argv)
     }
 
     /* Are there enough processes for this topology? */
-    int num_expected_slots = 1 + (int)powl(2L, dim);
+    int num_expected_slots = dim < 0
+        ? max(g_size, 1 + !opts.no_distributor)
+        : !opts.no_distributor + (int)powl(2L, dim);
     if (g_size < num_expected_slots) {
         fprintf(stderr,
             PROGNAME "(%d): error: no enough slots for hypercube topology. "
@@ -257,12 +1738,72 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    /* Is this the distributor process? */
-    if (g_rank == DISTRIB_RANK)
-        perform_distribution(argv[2]);
-    else
-        do_work(dim);
+    if (opts.root >= g_size) {
+        fprintf(stderr, PROGNAME "(%d): error: invalid root rank (%d)\n",
+            g_rank, opts.root);
+        MPI_Check(MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE));
+        MPI_Check(MPI_Finalize());
+        return EXIT_FAILURE;
+    }
+
+    /* Gather the workers into their own communicator. Processes beyond the
+     * hypercube stay idle. */
+    int is_worker = g_rank < num_expected_slots
+        && (opts.no_distributor || g_rank != DISTRIB_RANK);
+    MPI_Comm workers;
+    MPI_Check(MPI_Comm_split(MPI_COMM_WORLD, is_worker ? 0 : MPI_UNDEFINED,
+        g_rank, &workers));
+    if (opts.trace)
+        trace_init(MPI_COMM_WORLD, TRACE_DEFAULT_EVENTS);
 
+    if (opts.bench) {
+        if (is_worker) {
+            run_bench(&opts, workers);
+            MPI_Check(MPI_Comm_free(&workers));
+        }
+    } else if (opts.window) {
+        /* Rank 0 reads the input, whether it is a worker or not. */
+        struct feeder feeder;
+        int num_workers = num_expected_slots - !opts.no_distributor;
+        if (g_rank == DISTRIB_RANK)
+            feeder_open(&feeder, &opts, num_workers);
+        if (g_rank == DISTRIB_RANK && !opts.no_distributor) {
+            while (feed_window(&feeder))
+                ;
+        }
+        if (is_worker) {
+            stream_work(
+                &opts, workers, g_rank == DISTRIB_RANK ? &feeder : NULL);
+            MPI_Check(MPI_Comm_free(&workers));
+        }
+        if (g_rank == DISTRIB_RANK)
+            feeder_close(&feeder);
+    } else {
+        /* Is this the distributor process? */
+        if (g_rank == DISTRIB_RANK && !opts.no_distributor
+            && source == INPUT_DISTRIBUTOR)
+            perform_distribution(
+                opts.path, num_expected_slots - 1, opts.op.dtype);
+        if (is_worker) {
+            do_work(&opts, source, workers);
+            MPI_Check(MPI_Comm_free(&workers));
+        }
+        if (g_rank == opts.root && opts.scan)
+            receive_scan(&opts.op, !opts.no_distributor,
+                num_expected_slots - !opts.no_distributor, opts.vector);
+        else if (g_rank == opts.root && opts.num_quantiles)
+            receive_quantiles(opts.op.dtype);
+        else if (g_rank == opts.root && !opts.sort)
+            receive_result(&opts.op);
+    }
+
+    if (opts.trace) {
+        trace_write(MPI_COMM_WORLD, opts.trace);
+        trace_summary(MPI_COMM_WORLD, stderr);
+        trace_free();
+    }
+    release_bsend_buffer();
+    op_free(&opts.op);
     MPI_Check(MPI_Finalize());
     return EXIT_SUCCESS;
 }
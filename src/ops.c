@@ -0,0 +1,800 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "arena.h"
+#include "common.h"
+#include "device.h"
+#include "kernels.h"
+#include "ops.h"
+
+static const char *const op_names[] = {
+    [OP_MAX] = "max",
+    [OP_MIN] = "min",
+    [OP_SUM] = "sum",
+    [OP_PROD] = "prod",
+    [OP_ARGMAX] = "argmax",
+    [OP_ARGMIN] = "argmin",
+    [OP_MEAN] = "mean",
+    [OP_VAR] = "var",
+    [OP_TOPK] = "topk",
+    [OP_FUSED] = "fused",
+};
+
+/* The user-defined MPI operator shared by all operators. MPI user functions
+ * take no context argument, so every operator is attached to the datatype
+ * of its partials under this attribute key. */
+static int g_op_keyval = MPI_KEYVAL_INVALID;
+static MPI_Op g_user_op = MPI_OP_NULL;
+static int g_user_refs;
+
+/* Per-thread partials are kept on cache lines of their own, so that threads
+ * do not false-share them. Arena allocations are cache-line aligned. */
+#define THREAD_STRIDE(op) ARENA_ROUND((op)->size)
+
+/* Blocks smaller than this many values per thread are reduced by a single
+ * thread, as spawning the others would cost more than it saves. */
+#define THREAD_MIN_VALUES 4096
+#define USE_THREADS(n, threads)                                               \
+    ((threads) > 1 && (n) / (size_t)(threads) >= THREAD_MIN_VALUES)
+
+/* Fused local reductions, which take several passes over their block, walk
+ * it in chunks of this many values, so that every pass after the first
+ * finds the chunk in cache. */
+#define BLOCK_CHUNK 4096
+
+/* Parses the specification of a single operator: its name, followed by ":K"
+ * for topk.
+ * Returns 0 on success, -1 on failure
+ * @spec: Operator specification
+ * @len: Length of the specification
+ * @op: Receives the operator
+ */
+static int parse_single(const char *spec, size_t len, struct op *op)
+{
+    size_t name_len = strcspn(spec, ":,"), i;
+    if (name_len > len)
+        name_len = len;
+
+    memset(op, 0, sizeof *op);
+    for (i = 0; i < OP_FUSED; i++) {
+        if (strlen(op_names[i]) == name_len
+            && !strncmp(spec, op_names[i], name_len))
+            break;
+    }
+    if (i == OP_FUSED)
+        return -1;
+    op->kind = (enum op_kind)i;
+
+    if (op->kind != OP_TOPK)
+        return name_len == len ? 0 : -1;
+    if (name_len == len || spec[name_len] != ':')
+        return -1;
+
+    errno = 0;
+    char *endptr;
+    long k = strtol(spec + name_len + 1, &endptr, 10);
+    if (endptr == spec + name_len + 1 || endptr != spec + len
+        || errno == ERANGE || k < 1 || k > OP_MAX_TOPK)
+        return -1;
+    op->k = (int)k;
+    return 0;
+}
+
+/* Returns the name of the kind of an operator, without the k of topk.
+ * @op: Operator
+ */
+const char *op_name(const struct op *op)
+{
+    return op_names[op->kind];
+}
+
+/* Parses an operator specification: a comma-separated list of operators,
+ * each given by its name, followed by ":K" for topk. Several operators are
+ * fused into a single one.
+ * Returns 0 on success, -1 on failure
+ * @spec: Operator specification
+ * @op: Receives the operator, to be set up later with op_init()
+ */
+int op_parse(const char *spec, struct op *op)
+{
+    struct op children[OP_MAX_FUSED];
+    int n = 0;
+
+    for (const char *p = spec;; p++) {
+        size_t len = strcspn(p, ",");
+        if (n == OP_MAX_FUSED || parse_single(p, len, &children[n++]) < 0)
+            return -1;
+        p += len;
+        if (*p == '\0')
+            break;
+    }
+
+    if (n == 1) {
+        *op = children[0];
+        return 0;
+    }
+
+    memset(op, 0, sizeof *op);
+    op->kind = OP_FUSED;
+    op->num_children = n;
+    if (!(op->children = malloc((size_t)n * sizeof *op->children)))
+        return -1;
+    memcpy(op->children, children, (size_t)n * sizeof *op->children);
+    return 0;
+}
+
+static void user_fn(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    struct op *op;
+    int flag;
+    MPI_Type_get_attr(*type, g_op_keyval, &op, &flag);
+    op_combine(op, inout, in, (size_t)*len);
+}
+
+/* Computes the size of the partials of an operator and, for fused
+ * operators, the offsets of the partials of its children.
+ * @op: Operator
+ */
+static void compute_size(struct op *op)
+{
+    switch (op->kind) {
+    case OP_MAX:
+    case OP_MIN:
+    case OP_SUM:
+    case OP_PROD:
+        op->size = dtype_size(op->dtype);
+        break;
+    case OP_ARGMAX:
+    case OP_ARGMIN:
+        op->size = sizeof(struct op_arg_partial);
+        break;
+    case OP_MEAN:
+    case OP_VAR:
+        op->size = sizeof(struct op_moments_partial);
+        break;
+    case OP_TOPK:
+        op->size = sizeof(struct op_topk_partial)
+            + (size_t)op->k * sizeof(union op_value);
+        break;
+    case OP_FUSED:
+        /* Children start on eight-byte boundaries, as partials of plain
+         * 32-bit values are only four bytes long. */
+        op->size = 0;
+        for (int i = 0; i < op->num_children; i++) {
+            op->children[i].dtype = op->dtype;
+            op->children[i].kernels = op->kernels;
+            compute_size(&op->children[i]);
+            op->children[i].offset = (op->size + 7) & ~(size_t)7;
+            op->size = op->children[i].offset + op->children[i].size;
+        }
+        op->size = (op->size + 7) & ~(size_t)7;
+        break;
+    }
+}
+
+/* Sets up the MPI datatype and operator of an operator. Built-in MPI
+ * operators are used where they match. The operator must not move in
+ * memory until op_free() is called on it.
+ * @op: Operator parsed by op_parse()
+ */
+void op_init(struct op *op)
+{
+    static const MPI_Op builtin[] = {
+        [OP_MAX] = MPI_MAX,
+        [OP_MIN] = MPI_MIN,
+        [OP_SUM] = MPI_SUM,
+        [OP_PROD] = MPI_PROD,
+    };
+
+    if (!op->kernels)
+        op->kernels = kernels_find(NULL);
+    compute_size(op);
+    if (op->kind <= OP_PROD) {
+        op->type = dtype_mpi(op->dtype);
+        op->mpi_op = builtin[op->kind];
+        return;
+    }
+
+    if (g_user_refs++ == 0) {
+        MPI_Check(MPI_Type_create_keyval(MPI_TYPE_NULL_COPY_FN,
+            MPI_TYPE_NULL_DELETE_FN, &g_op_keyval, NULL));
+        MPI_Check(MPI_Op_create(user_fn, 1, &g_user_op));
+    }
+    MPI_Check(MPI_Type_contiguous((int)op->size, MPI_BYTE, &op->type));
+    MPI_Check(MPI_Type_commit(&op->type));
+    MPI_Check(MPI_Type_set_attr(op->type, g_op_keyval, op));
+    op->mpi_op = g_user_op;
+}
+
+/* Returns 1 if combining a partial of @op with itself leaves it unchanged,
+ * so that partials may be combined more than once without changing the
+ * result, or 0 otherwise.
+ * @op: Operator
+ */
+int op_is_idempotent(const struct op *op)
+{
+    switch (op->kind) {
+    case OP_MAX:
+    case OP_MIN:
+    case OP_ARGMAX:
+    case OP_ARGMIN:
+        return 1;
+    case OP_FUSED:
+        for (int i = 0; i < op->num_children; i++) {
+            if (!op_is_idempotent(&op->children[i]))
+                return 0;
+        }
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Releases the MPI objects of an operator set up by op_init(), as well as
+ * the children of fused operators.
+ * @op: Operator
+ */
+void op_free(struct op *op)
+{
+    free(op->children);
+    op->children = NULL;
+    op->num_children = 0;
+    if (op->mpi_op != g_user_op)
+        return;
+
+    MPI_Check(MPI_Type_free(&op->type));
+    if (--g_user_refs == 0) {
+        MPI_Check(MPI_Op_free(&g_user_op));
+        MPI_Check(MPI_Type_free_keyval(&g_op_keyval));
+    }
+    op->mpi_op = MPI_OP_NULL;
+}
+
+/* Defines the reduction and combine functions of the operators whose
+ * partials are not a plain value, OP_ARGMAX to OP_TOPK, for one element
+ * type, so that their inner loops carry no test of the type. Values keep
+ * their type in the partials of argmax, argmin and topk; moments are kept
+ * in double precision whatever the type. NaN wins argmax and argmin, as it
+ * does max and min, while topk skips it.
+ * @tn: Name of the type, and of its member of union op_value
+ * @T: Element type
+ * @dt: Element type, as an enum dtype
+ */
+#define DEFINE_TYPED_OPS(tn, T, dt)                                           \
+    static void local_arg_##tn(const struct op *op, void *partial,            \
+        const void *vals_, size_t n, int64_t first)                           \
+    {                                                                         \
+        const T *vals = vals_;                                                \
+        struct op_arg_partial *arg = partial;                                 \
+        T val;                                                                \
+                                                                              \
+        /* Find the extreme value with the vector kernels first, then the    \
+         * first element holding it. */                                       \
+        op->kernels->reduce[op->kind == OP_ARGMAX ? OP_MAX : OP_MIN][dt](     \
+            &val, vals, n);                                                   \
+        arg->val.tn = val;                                                    \
+        arg->idx = -1;                                                        \
+        for (size_t i = 0; i < n; i++) {                                      \
+            if (vals[i] == val || (val != val && vals[i] != vals[i])) {       \
+                arg->idx = first + (int64_t)i;                                \
+                break;                                                        \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    /* Returns 1 if @a beats @b for argmax (@max set) or argmin. Ties go to   \
+     * the lowest index, so that the result does not depend on the order in  \
+     * which partials are combined. */                                        \
+    static inline int arg_better_##tn(const struct op_arg_partial *a,         \
+        const struct op_arg_partial *b, int max)                              \
+    {                                                                         \
+        T x = a->val.tn, y = b->val.tn;                                       \
+        if (a->idx < 0)                                                       \
+            return 0;                                                         \
+        if (b->idx < 0)                                                       \
+            return 1;                                                         \
+        if (x != x || y != y)                                                 \
+            return x != x && (y == y || a->idx < b->idx);                     \
+        if (x == y)                                                           \
+            return a->idx < b->idx;                                           \
+        return max ? x > y : x < y;                                           \
+    }                                                                         \
+                                                                              \
+    static void combine_arg_##tn(                                             \
+        const struct op *op, void *inout, const void *in, size_t count)       \
+    {                                                                         \
+        struct op_arg_partial *x = inout;                                     \
+        const struct op_arg_partial *y = in;                                  \
+        int max = op->kind == OP_ARGMAX;                                      \
+        for (size_t i = 0; i < count; i++) {                                  \
+            if (arg_better_##tn(&y[i], &x[i], max))                           \
+                x[i] = y[i];                                                  \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    /* Two passes are as accurate as Welford's update and vectorize. */       \
+    static void local_moments_##tn(const struct op *op, void *partial,        \
+        const void *vals_, size_t n, int64_t first)                           \
+    {                                                                         \
+        const T *vals = vals_;                                                \
+        struct op_moments_partial *mom = partial;                             \
+        double sum = 0.0;                                                     \
+                                                                              \
+        (void)first;                                                          \
+        if (dt == DTYPE_F64)                                                  \
+            op->kernels->reduce[OP_SUM][DTYPE_F64](&sum, vals, n);            \
+        else {                                                                \
+            for (size_t i = 0; i < n; i++)                                    \
+                sum += (double)vals[i];                                       \
+        }                                                                     \
+        mom->n = (double)n;                                                   \
+        mom->mean = n ? sum / (double)n : 0.0;                                \
+        mom->m2 = 0.0;                                                        \
+        for (size_t i = 0; i < n; i++) {                                      \
+            double d = (double)vals[i] - mom->mean;                           \
+            mom->m2 += d * d;                                                 \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    /* Restores the min-heap property of the first @n values of @heap from   \
+     * position @i downwards. */                                              \
+    static void heap_sift_down_##tn(union op_value *heap, size_t n, size_t i) \
+    {                                                                         \
+        for (;;) {                                                            \
+            size_t l = 2 * i + 1, r = l + 1, m = i;                           \
+            if (l < n && heap[l].tn < heap[m].tn)                             \
+                m = l;                                                        \
+            if (r < n && heap[r].tn < heap[m].tn)                             \
+                m = r;                                                        \
+            if (m == i)                                                       \
+                return;                                                       \
+            union op_value t = heap[i];                                       \
+            heap[i] = heap[m];                                                \
+            heap[m] = t;                                                      \
+            i = m;                                                            \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    static int compare_desc_##tn(const void *a, const void *b)                \
+    {                                                                         \
+        T x = ((const union op_value *)a)->tn;                                \
+        T y = ((const union op_value *)b)->tn;                                \
+        return (x < y) - (x > y);                                             \
+    }                                                                         \
+                                                                              \
+    /* Keeps the k largest values seen so far in a min-heap. */               \
+    static void local_topk_##tn(const struct op *op, void *partial,           \
+        const void *vals_, size_t n, int64_t first)                           \
+    {                                                                         \
+        const T *vals = vals_;                                                \
+        struct op_topk_partial *topk = partial;                               \
+        union op_value *heap = topk->vals;                                    \
+                                                                              \
+        (void)first;                                                          \
+        topk->n = 0;                                                          \
+        for (size_t i = 0; i < n; i++) {                                      \
+            if (vals[i] != vals[i])                                           \
+                continue;                                                     \
+            if (topk->n < op->k) {                                            \
+                size_t j = (size_t)topk->n++;                                 \
+                heap[j].tn = vals[i];                                         \
+                while (j > 0 && heap[(j - 1) / 2].tn > heap[j].tn) {          \
+                    union op_value t = heap[j];                               \
+                    heap[j] = heap[(j - 1) / 2];                              \
+                    heap[(j - 1) / 2] = t;                                    \
+                    j = (j - 1) / 2;                                          \
+                }                                                             \
+            } else if (vals[i] > heap[0].tn) {                                \
+                heap[0].tn = vals[i];                                         \
+                heap_sift_down_##tn(heap, (size_t)op->k, 0);                  \
+            }                                                                 \
+        }                                                                     \
+        qsort(heap, (size_t)topk->n, sizeof *heap, compare_desc_##tn);        \
+    }                                                                         \
+                                                                              \
+    static void combine_topk_##tn(                                            \
+        const struct op *op, void *inout_, const void *in_, size_t count)     \
+    {                                                                         \
+        union op_value merged[OP_MAX_TOPK];                                   \
+        for (size_t c = 0; c < count; c++) {                                  \
+            struct op_topk_partial *inout                                     \
+                = (struct op_topk_partial *)((char *)inout_ + c * op->size);  \
+            const struct op_topk_partial *in                                  \
+                = (const struct op_topk_partial *)((const char *)in_          \
+                    + c * op->size);                                          \
+            int64_t i = 0, j = 0, n = 0;                                      \
+            while (n < op->k && (i < inout->n || j < in->n)) {                \
+                if (j == in->n                                                \
+                    || (i < inout->n                                          \
+                        && inout->vals[i].tn >= in->vals[j].tn))              \
+                    merged[n++] = inout->vals[i++];                           \
+                else                                                          \
+                    merged[n++] = in->vals[j++];                              \
+            }                                                                 \
+            memcpy(inout->vals, merged, (size_t)n * sizeof *merged);          \
+            inout->n = n;                                                     \
+        }                                                                     \
+    }
+
+DEFINE_TYPED_OPS(f64, double, DTYPE_F64)
+DEFINE_TYPED_OPS(f32, float, DTYPE_F32)
+DEFINE_TYPED_OPS(i32, int32_t, DTYPE_I32)
+DEFINE_TYPED_OPS(i64, int64_t, DTYPE_I64)
+
+/* Combines moments partials with the update of Chan et al. The operands
+ * of every pair are put in a canonical order first, so that both partners
+ * of a hypercube round get bit-identical results. */
+static void combine_moments(
+    const struct op *op, void *inout_, const void *in_, size_t count)
+{
+    struct op_moments_partial *inout = inout_;
+    const struct op_moments_partial *in = in_;
+
+    (void)op;
+    for (size_t i = 0; i < count; i++) {
+        struct op_moments_partial a = inout[i], b = in[i];
+        if (b.n > a.n || (b.n == a.n && b.mean > a.mean)) {
+            a = in[i];
+            b = inout[i];
+        }
+        double n = a.n + b.n;
+        if (n == 0)
+            continue;
+        double delta = b.mean - a.mean;
+        inout[i].n = n;
+        inout[i].mean = a.mean + delta * (b.n / n);
+        inout[i].m2 = a.m2 + b.m2 + delta * delta * (a.n * b.n / n);
+    }
+}
+
+#define TYPED_ROW(fn)                                                         \
+    {                                                                         \
+        [DTYPE_F64] = fn##_f64,                                              \
+        [DTYPE_F32] = fn##_f32,                                              \
+        [DTYPE_I32] = fn##_i32,                                              \
+        [DTYPE_I64] = fn##_i64,                                              \
+    }
+
+#define MOMENTS_ROW                                                           \
+    {                                                                         \
+        combine_moments, combine_moments, combine_moments, combine_moments    \
+    }
+
+typedef void (*local_fn)(const struct op *op, void *partial,
+    const void *vals, size_t n, int64_t first);
+typedef void (*combine_fn)(
+    const struct op *op, void *inout, const void *in, size_t count);
+
+/* Reduction and combine functions of OP_ARGMAX to OP_TOPK for every element
+ * type. */
+static const local_fn local_fns[OP_TOPK + 1][DTYPE_COUNT] = {
+    [OP_ARGMAX] = TYPED_ROW(local_arg),
+    [OP_ARGMIN] = TYPED_ROW(local_arg),
+    [OP_MEAN] = TYPED_ROW(local_moments),
+    [OP_VAR] = TYPED_ROW(local_moments),
+    [OP_TOPK] = TYPED_ROW(local_topk),
+};
+
+static const combine_fn combine_fns[OP_TOPK + 1][DTYPE_COUNT] = {
+    [OP_ARGMAX] = TYPED_ROW(combine_arg),
+    [OP_ARGMIN] = TYPED_ROW(combine_arg),
+    [OP_MEAN] = MOMENTS_ROW,
+    [OP_VAR] = MOMENTS_ROW,
+    [OP_TOPK] = TYPED_ROW(combine_topk),
+};
+
+/* Reduces a block of values into a single partial. An empty block yields the
+ * identity of the operator.
+ * @op: Operator
+ * @partial: Receives the partial
+ * @vals: Values to reduce, of the element type of the operator
+ * @n: Number of values
+ * @first: Global index of the first value, for argmax and argmin
+ */
+void op_local(const struct op *op, void *partial, const void *vals, size_t n,
+    int64_t first)
+{
+    size_t size = dtype_size(op->dtype);
+
+    if (op->kind <= OP_PROD) {
+        op->kernels->reduce[op->kind][op->dtype](partial, vals, n);
+        return;
+    }
+
+    if (op->kind == OP_FUSED) {
+        /* Single pass over memory: every chunk of the block is reduced by
+         * all the operators while it is still in cache. */
+        union op_value tmp[1 + OP_MAX_TOPK];
+        size_t len = n < BLOCK_CHUNK ? n : BLOCK_CHUNK;
+        for (int c = 0; c < op->num_children; c++) {
+            const struct op *child = &op->children[c];
+            op_local(child, (char *)partial + child->offset, vals, len, first);
+        }
+        for (size_t i = len; i < n; i += len) {
+            len = n - i < BLOCK_CHUNK ? n - i : BLOCK_CHUNK;
+            for (int c = 0; c < op->num_children; c++) {
+                const struct op *child = &op->children[c];
+                op_local(child, tmp, (const char *)vals + i * size, len,
+                    first + (int64_t)i);
+                op_combine(child, (char *)partial + child->offset, tmp, 1);
+            }
+        }
+        return;
+    }
+
+    local_fns[op->kind][op->dtype](op, partial, vals, n, first);
+}
+
+/* Turns every value of a block into a partial of its own, for element-wise
+ * reductions.
+ * @op: Operator
+ * @partials: Receives @n partials
+ * @vals: Values, of the element type of the operator
+ * @n: Number of values
+ * @first: Global index of the first value, for argmax and argmin
+ */
+void op_lift(const struct op *op, void *partials, const void *vals, size_t n,
+    int64_t first)
+{
+    size_t size = dtype_size(op->dtype);
+    if (op->kind <= OP_PROD) {
+        memcpy(partials, vals, n * size);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        op_local(op, (char *)partials + i * op->size,
+            (const char *)vals + i * size, 1, first + (int64_t)i);
+}
+
+/* Returns the bytes of g_arena that op_local_parallel() takes while it runs.
+ * @op: Operator
+ * @n: Number of values of the block
+ * @threads: Largest number of threads to use
+ */
+size_t op_scratch_size(const struct op *op, size_t n, int threads)
+{
+#ifdef _OPENMP
+    if (USE_THREADS(n, threads))
+        return ARENA_ROUND((size_t)threads * THREAD_STRIDE(op));
+#else
+    (void)op;
+    (void)n;
+    (void)threads;
+#endif
+    return 0;
+}
+
+/* Reduces a block of values to a single partial like op_local(), splitting
+ * the block across up to @threads threads. Every thread reduces a contiguous
+ * share of the block into a partial of its own, and the partials are then
+ * combined in thread order, so the result does not depend on the number of
+ * threads for order-insensitive operators. The partials of the threads live
+ * in g_arena, see op_scratch_size(). Blocks in device memory are reduced
+ * on the device instead, see device_local().
+ * @op: Operator
+ * @partial: Receives the partial
+ * @vals: Values to be reduced
+ * @n: Number of values
+ * @first: Global index of the first value
+ * @threads: Largest number of threads to use
+ */
+void op_local_parallel(const struct op *op, void *partial, const void *vals,
+    size_t n, int64_t first, int threads)
+{
+#ifdef HAVE_CUDA
+    if (op->device) {
+        device_local(op, partial, vals, n);
+        return;
+    }
+#endif
+#ifdef _OPENMP
+    if (USE_THREADS(n, threads)) {
+        size_t stride = THREAD_STRIDE(op), mark = arena_mark(&g_arena);
+        char *partials = arena_alloc(&g_arena, (size_t)threads * stride);
+        int spawned = 1;
+
+#pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num(), nt = omp_get_num_threads();
+            size_t lo, len;
+            block_range(n, (size_t)nt, (size_t)t, &lo, &len);
+            op_local(op, partials + (size_t)t * stride,
+                (const char *)vals + lo * dtype_size(op->dtype), len,
+                first + (int64_t)lo);
+            if (t == 0)
+                spawned = nt;
+        }
+
+        memcpy(partial, partials, op->size);
+        for (int t = 1; t < spawned; t++)
+            op_combine(op, partial, partials + (size_t)t * stride, 1);
+        arena_release(&g_arena, mark);
+        return;
+    }
+#else
+    (void)threads;
+#endif
+    op_local(op, partial, vals, n, first);
+}
+
+/* Lifts a block of values into partials like op_lift(), splitting the block
+ * across up to @threads threads.
+ * @op: Operator
+ * @partials: Receives @n partials
+ * @vals: Values to be lifted
+ * @n: Number of values
+ * @first: Global index of the first value
+ * @threads: Largest number of threads to use
+ */
+void op_lift_parallel(const struct op *op, void *partials, const void *vals,
+    size_t n, int64_t first, int threads)
+{
+#ifdef _OPENMP
+    if (USE_THREADS(n, threads)) {
+#pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num(), nt = omp_get_num_threads();
+            size_t lo, len;
+            block_range(n, (size_t)nt, (size_t)t, &lo, &len);
+            op_lift(op, (char *)partials + lo * op->size,
+                (const char *)vals + lo * dtype_size(op->dtype), len,
+                first + (int64_t)lo);
+        }
+        return;
+    }
+#else
+    (void)threads;
+#endif
+    op_lift(op, partials, vals, n, first);
+}
+
+/* Combines two buffers of partials element-wise. Combining is commutative,
+ * and both partners of a hypercube round end up with the same result.
+ * Partials in device memory are combined on the device.
+ * @op: Operator
+ * @inout: First operand, receives the result
+ * @in: Second operand
+ * @count: Number of partials in each buffer
+ */
+void op_combine(const struct op *op, void *inout, const void *in, size_t count)
+{
+#ifdef HAVE_CUDA
+    if (op->device) {
+        device_combine(op, inout, in, count);
+        return;
+    }
+#endif
+    switch (op->kind) {
+    case OP_MAX:
+    case OP_MIN:
+    case OP_SUM:
+    case OP_PROD:
+        op->kernels->combine[op->kind][op->dtype](inout, in, count);
+        break;
+    case OP_ARGMAX:
+    case OP_ARGMIN:
+    case OP_MEAN:
+    case OP_VAR:
+    case OP_TOPK:
+        combine_fns[op->kind][op->dtype](op, inout, in, count);
+        break;
+    case OP_FUSED:
+        for (size_t i = 0; i < count; i++) {
+            for (int c = 0; c < op->num_children; c++) {
+                const struct op *child = &op->children[c];
+                size_t offset = i * op->size + child->offset;
+                op_combine(child, (char *)inout + offset,
+                    (const char *)in + offset, 1);
+            }
+        }
+        break;
+    }
+}
+
+/* Turns a buffer of partials into its running combination, so that partial
+ * @i ends up combining partials 0 to @i, as for an inclusive prefix scan.
+ * @op: Operator
+ * @partials: Buffer of partials, combined in place
+ * @n: Number of partials in the buffer
+ */
+void op_prefix(const struct op *op, void *partials, size_t n)
+{
+    char *p = partials;
+    for (size_t i = 1; i < n; i++)
+        op_combine(op, p + i * op->size, p + (i - 1) * op->size, 1);
+}
+
+/* Prints a value of the element type of an operator held by a partial. */
+static void print_value(const struct op *op, FILE *fp, const void *val)
+{
+    switch (op->dtype) {
+    case DTYPE_F64:
+        fprintf(fp, "%lf", *(const double *)val);
+        break;
+    case DTYPE_F32:
+        fprintf(fp, "%lf", (double)*(const float *)val);
+        break;
+    case DTYPE_I32:
+        fprintf(fp, "%" PRId32, *(const int32_t *)val);
+        break;
+    case DTYPE_I64:
+        fprintf(fp, "%" PRId64, *(const int64_t *)val);
+        break;
+    }
+}
+
+/* Prints the final value of a partial. Partials made of several values, such
+ * as argmax or topk, are printed as space-separated values. The results of
+ * fused operators are separated by semicolons, in the order they were
+ * given.
+ * @op: Operator
+ * @fp: Stream to print to
+ * @partial: Partial to be printed
+ */
+void op_print(const struct op *op, FILE *fp, const void *partial)
+{
+    const struct op_arg_partial *arg = partial;
+    const struct op_moments_partial *mom = partial;
+    const struct op_topk_partial *topk = partial;
+
+    switch (op->kind) {
+    case OP_MAX:
+    case OP_MIN:
+    case OP_SUM:
+    case OP_PROD:
+        print_value(op, fp, partial);
+        break;
+    case OP_ARGMAX:
+    case OP_ARGMIN:
+        print_value(op, fp, &arg->val);
+        fprintf(fp, " %lld", (long long)arg->idx);
+        break;
+    case OP_MEAN:
+        fprintf(fp, "%lf", mom->n ? mom->mean : NAN);
+        break;
+    case OP_VAR:
+        fprintf(fp, "%lf", mom->n ? mom->m2 / mom->n : NAN);
+        break;
+    case OP_TOPK:
+        for (int64_t i = 0; i < topk->n; i++) {
+            if (i)
+                fputc(' ', fp);
+            print_value(op, fp, &topk->vals[i]);
+        }
+        break;
+    case OP_FUSED:
+        for (int c = 0; c < op->num_children; c++) {
+            const struct op *child = &op->children[c];
+            if (c)
+                fputc(';', fp);
+            op_print(child, fp, (const char *)partial + child->offset);
+        }
+        break;
+    }
+}
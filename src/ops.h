@@ -0,0 +1,116 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_OPS_H
+#define MPI_HYPERCUBE_OPS_H
+
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dtype.h"
+
+/* Reduction operators. Every operator reduces values into partials, which
+ * are what travels across the hypercube, and knows how to combine two
+ * buffers of partials element-wise. */
+enum op_kind {
+    OP_MAX,
+    OP_MIN,
+    OP_SUM,
+    OP_PROD,
+    OP_ARGMAX, /* maximum and index of the first element holding it */
+    OP_ARGMIN, /* minimum and index of the first element holding it */
+    OP_MEAN,
+    OP_VAR, /* population variance */
+    OP_TOPK, /* k largest values, in decreasing order */
+    OP_FUSED, /* several of the above, reduced in a single exchange */
+};
+
+/* Largest k accepted by OP_TOPK. */
+#define OP_MAX_TOPK 1024
+
+/* Largest number of operators fused into one. */
+#define OP_MAX_FUSED 16
+
+/* Value of the element type of an operator, as held by the partials of
+ * OP_ARGMAX, OP_ARGMIN and OP_TOPK. */
+union op_value {
+    double f64;
+    float f32;
+    int32_t i32;
+    int64_t i64;
+};
+
+/* Partial of OP_ARGMAX and OP_ARGMIN. An index of -1 marks an empty
+ * partial. */
+struct op_arg_partial {
+    union op_value val;
+    int64_t idx;
+};
+
+/* Partial of OP_MEAN and OP_VAR: count, mean and sum of squared
+ * differences from the mean, as in Welford's algorithm. They are kept in
+ * double precision for every element type. */
+struct op_moments_partial {
+    double n, mean, m2;
+};
+
+/* Partial of OP_TOPK: number of valid values, followed by up to k values in
+ * decreasing order. Partials of OP_FUSED are the partials of its children
+ * laid out one after the other. */
+struct op_topk_partial {
+    int64_t n;
+    union op_value vals[];
+};
+
+struct op {
+    enum op_kind kind;
+    enum dtype dtype; /* element type of the values, set before op_init() */
+    const struct kernel_set *kernels; /* set before op_init(), or NULL for
+                                       * the widest ones, see
+                                       * kernels_find() */
+    int k; /* OP_TOPK */
+    struct op *children; /* OP_FUSED */
+    int num_children; /* OP_FUSED */
+    size_t offset; /* offset of the partial within the fused parent */
+    size_t size; /* bytes per partial */
+    MPI_Datatype type; /* one partial */
+    MPI_Op mpi_op; /* combines partials of @type */
+    int device; /* blocks and partials live in device memory, see device.h */
+};
+
+int op_parse(const char *spec, struct op *op);
+const char *op_name(const struct op *op);
+void op_init(struct op *op);
+void op_free(struct op *op);
+int op_is_idempotent(const struct op *op);
+
+void op_local(const struct op *op, void *partial, const void *vals, size_t n,
+    int64_t first);
+void op_lift(const struct op *op, void *partials, const void *vals, size_t n,
+    int64_t first);
+void op_local_parallel(const struct op *op, void *partial, const void *vals,
+    size_t n, int64_t first, int threads);
+void op_lift_parallel(const struct op *op, void *partials, const void *vals,
+    size_t n, int64_t first, int threads);
+size_t op_scratch_size(const struct op *op, size_t n, int threads);
+void op_combine(
+    const struct op *op, void *inout, const void *in, size_t count);
+void op_prefix(const struct op *op, void *partials, size_t n);
+void op_print(const struct op *op, FILE *fp, const void *partial);
+
+#endif /* MPI_HYPERCUBE_OPS_H */
@@ -0,0 +1,507 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "common.h"
+#include "parse.h"
+#include "pow5_table.h"
+
+/* Size of the buffer used when the input cannot be mapped into memory. */
+#define READ_CHUNK_SIZE (1 << 20)
+
+/* Significant decimal digits that always fit in a 64-bit mantissa. */
+#define MAX_MANTISSA_DIGITS 19
+
+void value_list_grow(struct value_list *list)
+{
+    size_t cap = list->cap ? 2 * list->cap : BUFSIZ;
+    void *data = realloc(list->data, cap * dtype_size(list->dtype));
+    if (!data)
+        fatal("out of memory");
+    list->data = data;
+    list->cap = cap;
+}
+
+/* Returns a mask with bit i set if @p[i] is part of a numeric entity, for
+ * the 64 bytes starting at @p.
+ * @p: Bytes to be classified
+ */
+static inline uint64_t numeric_mask(const char *p)
+{
+#if defined(__AVX2__)
+    uint64_t mask = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+        __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        __m256i m = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+')));
+        m = _mm256_or_si256(m,
+            _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                _mm256_set1_epi8('e')));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << (32 * i);
+    }
+    return mask;
+#elif defined(__SSE2__)
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('+')));
+        m = _mm_or_si128(m,
+            _mm_cmpeq_epi8(
+                _mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('e')));
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (16 * i);
+    }
+    return mask;
+#elif defined(__ARM_NEON)
+    static const uint8_t weights[16]
+        = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t w = vld1q_u8(weights);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p + 16 * i);
+        uint8x16_t m = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('.')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('-')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('+')));
+        m = vorrq_u8(m,
+            vceqq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('e')));
+        /* Collapse the byte mask into 16 bits. */
+        uint8x16_t bits = vandq_u8(m, w);
+        uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        mask |= (uint64_t)vget_lane_u16(vreinterpret_u16_u8(sum), 0)
+            << (16 * i);
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++)
+        mask |= (uint64_t)is_numeric_char(p[i]) << i;
+    return mask;
+#endif
+}
+
+/* Returns 1 if the eight bytes loaded little-endian into @v are all decimal
+ * digits.
+ * @v: Eight bytes of input
+ */
+static inline int is_eight_digits(uint64_t v)
+{
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL)
+               | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        == 0x3333333333333333ULL;
+}
+
+/* Converts eight decimal digits loaded little-endian into @v to their value.
+ * @v: Eight bytes of input, all of them digits
+ */
+static inline uint32_t parse_eight_digits(uint64_t v)
+{
+    v -= 0x3030303030303030ULL;
+    v = v * 10 + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL)
+            + (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL))
+        >> 32;
+    return (uint32_t)v;
+}
+
+static inline uint64_t load_u64(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/* Computes w * 10^q correctly rounded with the Eisel-Lemire algorithm.
+ * Returns 0 and leaves @out untouched in the rare cases where the algorithm
+ * cannot decide the rounding, or the result is subnormal.
+ * @q: Decimal exponent
+ * @w: Decimal mantissa, non-zero
+ * @neg: Whether the value is negative
+ * @out: Receives the value
+ */
+static int eisel_lemire(int64_t q, uint64_t w, int neg, double *out)
+{
+    uint64_t bits;
+
+    if (q < POW5_SMALLEST_POWER) {
+        bits = 0;
+    } else if (q > POW5_LARGEST_POWER) {
+        bits = (uint64_t)0x7FF << 52;
+    } else {
+        int lz = __builtin_clzll(w);
+        w <<= lz;
+
+        /* Multiply by the truncated 128-bit power of five, refining with its
+         * lower half only when the upper product leaves the rounding open. */
+        const uint64_t *pow5 = pow5_table[q - POW5_SMALLEST_POWER];
+        unsigned __int128 first = (unsigned __int128)w * pow5[0];
+        uint64_t hi = (uint64_t)(first >> 64), lo = (uint64_t)first;
+        const uint64_t precision_mask = UINT64_MAX >> 55;
+        if ((hi & precision_mask) == precision_mask) {
+            uint64_t second_hi
+                = (uint64_t)(((unsigned __int128)w * pow5[1]) >> 64);
+            lo += second_hi;
+            if (second_hi > lo)
+                hi++;
+        }
+        if (lo == UINT64_MAX && (q < -27 || q > 55))
+            return 0;
+
+        int upperbit = (int)(hi >> 63);
+        int shift = upperbit + 64 - 52 - 3;
+        uint64_t mantissa = hi >> shift;
+        int32_t power2 = (int32_t)((((152170 + 65536) * q) >> 16) + 63
+            + upperbit - lz + 1023);
+        if (power2 <= 0)
+            return 0;
+
+        /* Round to nearest, ties to even. */
+        if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+            && (mantissa << shift) == hi)
+            mantissa &= ~(uint64_t)1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        if (mantissa >= (uint64_t)2 << 52) {
+            mantissa = (uint64_t)1 << 52;
+            power2++;
+        }
+        mantissa &= ~((uint64_t)1 << 52);
+        if (power2 >= 0x7FF) {
+            power2 = 0x7FF;
+            mantissa = 0;
+        }
+        bits = mantissa | (uint64_t)power2 << 52;
+    }
+
+    bits |= (uint64_t)neg << 63;
+    memcpy(out, &bits, sizeof bits);
+    return 1;
+}
+
+/* Converts a numeric entity through strtod(). Used for the inputs the fast
+ * path does not handle, such as mantissas with more than 19 digits.
+ * Returns 1 on success, 0 if the entity is not a valid number.
+ * @p: Start of the entity
+ * @len: Length of the entity
+ * @out: Receives the value
+ */
+static int parse_slow(const char *p, size_t len, double *out)
+{
+    char local[128], *buf = local, *endptr;
+
+    if (len >= sizeof local && !(buf = malloc(len + 1)))
+        fatal("out of memory");
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    *out = strtod(buf, &endptr);
+    int ok = endptr == buf + len;
+    if (buf != local)
+        free(buf);
+    return ok;
+}
+
+/* Parses the numeric entity [@p, @end), where @end is the first non-numeric
+ * character after @p. Accepts an optional sign, a decimal mantissa with an
+ * optional fraction and an optional exponent.
+ * Returns 1 on success, 0 if the entity is not a valid number.
+ * @p: Start of the entity
+ * @end: End of the entity
+ * @out: Receives the value
+ */
+static int parse_number(const char *p, const char *end, double *out)
+{
+    static const double exact_pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+        1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        1e19, 1e20, 1e21, 1e22 };
+    const char *start = p;
+    int neg = 0, any_digit = 0, num_digits = 0;
+    uint64_t w = 0;
+    int64_t exp10 = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    /* Leading zeros are not significant. */
+    while (p < end && *p == '0') {
+        any_digit = 1;
+        p++;
+    }
+    while (end - p >= 8 && is_eight_digits(load_u64(p))) {
+        w = w * 100000000 + parse_eight_digits(load_u64(p));
+        num_digits += 8;
+        p += 8;
+    }
+    for (; p < end && (unsigned char)(*p - '0') < 10; p++, num_digits++)
+        w = w * 10 + (uint64_t)(*p - '0');
+
+    if (p < end && *p == '.') {
+        const char *frac = ++p;
+        if (num_digits == 0) {
+            while (p < end && *p == '0')
+                p++;
+        }
+        while (end - p >= 8 && is_eight_digits(load_u64(p))) {
+            w = w * 100000000 + parse_eight_digits(load_u64(p));
+            num_digits += 8;
+            p += 8;
+        }
+        for (; p < end && (unsigned char)(*p - '0') < 10; p++, num_digits++)
+            w = w * 10 + (uint64_t)(*p - '0');
+        exp10 = -(int64_t)(p - frac);
+        any_digit |= p != frac;
+    }
+    any_digit |= num_digits > 0;
+    if (!any_digit)
+        return 0;
+
+    if (p < end && (*p | 0x20) == 'e') {
+        int exp_neg = 0;
+        int64_t e = 0;
+        if (++p < end && (*p == '-' || *p == '+'))
+            exp_neg = *p++ == '-';
+        if (p == end || (unsigned char)(*p - '0') >= 10)
+            return 0;
+        for (; p < end && (unsigned char)(*p - '0') < 10; p++) {
+            if (e < 0x10000)
+                e = e * 10 + (*p - '0');
+        }
+        exp10 += exp_neg ? -e : e;
+    }
+    if (p != end)
+        return 0;
+
+    if (num_digits > MAX_MANTISSA_DIGITS)
+        return parse_slow(start, (size_t)(end - start), out);
+
+    if (w == 0) {
+        *out = neg ? -0.0 : 0.0;
+        return 1;
+    }
+
+    /* Clinger's fast path: both operands are exact doubles, so a single
+     * rounding gives the correctly rounded result. */
+    if (exp10 >= -22 && exp10 <= 22 && w <= (uint64_t)1 << 53) {
+        double v = (double)w;
+        v = exp10 < 0 ? v / exact_pow10[-exp10] : v * exact_pow10[exp10];
+        *out = neg ? -v : v;
+        return 1;
+    }
+
+    if (eisel_lemire(exp10, w, neg, out))
+        return 1;
+    return parse_slow(start, (size_t)(end - start), out);
+}
+
+/* Parses the numeric entity [@p, @end) as a decimal integer with an optional
+ * sign, exactly, for lists of integers.
+ * Returns 1 on success, 0 if the entity is not an integer or is out of range
+ * for @dtype.
+ * @p: Start of the entity
+ * @end: End of the entity
+ * @dtype: Integer element type the value must fit in
+ * @out: Receives the value
+ */
+static int parse_integer(
+    const char *p, const char *end, enum dtype dtype, int64_t *out)
+{
+    uint64_t limit = dtype == DTYPE_I32 ? INT32_MAX : INT64_MAX, w = 0;
+    int neg = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    if (p == end)
+        return 0;
+    for (; p < end; p++) {
+        unsigned d = (unsigned char)(*p - '0');
+        if (d >= 10 || w > (limit + neg - d) / 10)
+            return 0;
+        w = w * 10 + d;
+    }
+
+    /* The negation of the magnitude cannot overflow, as the magnitude of the
+     * most negative value is one more than the largest value. */
+    *out = neg ? (int64_t)(0 - w) : (int64_t)w;
+    return 1;
+}
+
+/* Scans an in-memory buffer for numeric entities and appends their values to
+ * the list. Entities are separated by any non-numeric character, and runs
+ * of numeric characters starting with e or E are skipped silently. Runs of
+ * numeric characters are located 64 bytes at a time with SIMD compares, and
+ * every run is converted without going through strtod() in the common case.
+ * Values are converted to the element type of the list; lists of integers
+ * only accept integer entities, which are parsed exactly.
+ * Returns the number of bytes consumed. Unless @final is set, an entity
+ * touching the end of the buffer is not parsed, since it may continue in the
+ * next buffer; the returned offset then points to its first byte.
+ * @buf: Buffer to be scanned
+ * @len: Length of the buffer in bytes
+ * @final: Whether the buffer ends the input
+ * @list: List receiving the values
+ */
+size_t parse_values(
+    const char *buf, size_t len, int final, struct value_list *list)
+{
+    uint64_t carry = 0;
+
+    for (size_t base = 0; base < len; base += 64) {
+        uint64_t mask;
+        if (len - base >= 64) {
+            mask = numeric_mask(buf + base);
+        } else {
+            char tail[64] = { 0 };
+            memcpy(tail, buf + base, len - base);
+            mask = numeric_mask(tail);
+        }
+
+        /* Only the first byte of every run of numeric characters starts an
+         * entity. */
+        uint64_t starts = mask & ~(mask << 1 | carry);
+        carry = mask >> 63;
+        while (starts) {
+            int idx = __builtin_ctzll(starts);
+            starts &= starts - 1;
+
+            /* The run ends at the next clear bit of the mask, unless it
+             * crosses into the next block. */
+            uint64_t rest = ~mask >> idx;
+            const char *p = buf + base + idx;
+            const char *end = p + (rest ? __builtin_ctzll(rest) : 64 - idx);
+            if (!rest) {
+                while (end < buf + len && is_numeric_char(*end))
+                    end++;
+            }
+            if (end > buf + len)
+                end = buf + len;
+            if (end == buf + len && !final)
+                return (size_t)(p - buf);
+
+            /* Entities start at a digit, a sign or a dot: runs starting
+             * with an exponent marker are the letters of some word. */
+            if ((*p | 0x20) == 'e')
+                continue;
+
+            double val;
+            int64_t ival;
+            if (dtype_is_integer(list->dtype)) {
+                if (parse_integer(p, end, list->dtype, &ival)) {
+                    value_list_push_int(list, ival);
+                    continue;
+                }
+            } else if (parse_number(p, end, &val)) {
+                value_list_push(list, val);
+                continue;
+            }
+            logf("warning: skipping invalid entity (`%.*s')",
+                (int)(end - p > 64 ? 64 : end - p), p);
+        }
+    }
+
+    return len;
+}
+
+/* Reads a whole input file and parses its numeric entities. Regular files
+ * are mapped into memory and parsed in place; anything else, such as a pipe,
+ * is read in large chunks. This function does not return on failure.
+ * @path: Path to the file containing the data
+ * @list: List receiving the values
+ */
+void parse_file(const char *path, struct value_list *list)
+{
+    errno = 0;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+        fatal("could not open file `%s' for reading: %s", path,
+            strerror(errno));
+
+    if (S_ISREG(st.st_mode)) {
+        size_t len = (size_t)st.st_size;
+        if (len > 0) {
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= MAP_POPULATE;
+#endif
+            char *map = mmap(NULL, len, PROT_READ, flags, fd, 0);
+            if (map == MAP_FAILED)
+                fatal("could not map `%s': %s", path, strerror(errno));
+            madvise(map, len, MADV_SEQUENTIAL);
+            parse_values(map, len, 1, list);
+            munmap(map, len);
+        }
+        close(fd);
+        return;
+    }
+
+    /* Keep the unparsed tail of every chunk in front of the next one. */
+    size_t cap = READ_CHUNK_SIZE, pending = 0;
+    char *buf = malloc(cap);
+    if (!buf)
+        fatal("out of memory");
+    for (;;) {
+        if (pending == cap) {
+            char *grown = realloc(buf, cap *= 2);
+            if (!grown)
+                fatal("out of memory");
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + pending, cap - pending);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            fatal("could not read `%s': %s", path, strerror(errno));
+        if (n == 0) {
+            parse_values(buf, pending, 1, list);
+            break;
+        }
+        size_t len = pending + (size_t)n;
+        size_t used = parse_values(buf, len, 0, list);
+        pending = len - used;
+        memmove(buf, buf + used, pending);
+    }
+    free(buf);
+    close(fd);
+}
@@ -0,0 +1,88 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_PARSE_H
+#define MPI_HYPERCUBE_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dtype.h"
+
+/* Growable list of values read from the input file, stored as elements of
+ * @dtype. */
+struct value_list {
+    void *data;
+    size_t len, cap;
+    enum dtype dtype;
+};
+
+void value_list_grow(struct value_list *list);
+
+/* Appends a value to the list, converted to the element type of the list,
+ * growing its storage if needed. This function does not return on
+ * allocation failure.
+ * @list: List to be appended to
+ * @val: Value to append
+ */
+static inline void value_list_push(struct value_list *list, double val)
+{
+    if (list->len == list->cap)
+        value_list_grow(list);
+    if (list->dtype == DTYPE_F32)
+        ((float *)list->data)[list->len++] = (float)val;
+    else
+        ((double *)list->data)[list->len++] = val;
+}
+
+/* Appends an integer to a list of integers, growing its storage if needed.
+ * This function does not return on allocation failure.
+ * @list: List to be appended to
+ * @val: Value to append, in range for the element type of the list
+ */
+static inline void value_list_push_int(struct value_list *list, int64_t val)
+{
+    if (list->len == list->cap)
+        value_list_grow(list);
+    if (list->dtype == DTYPE_I32)
+        ((int32_t *)list->data)[list->len++] = (int32_t)val;
+    else
+        ((int64_t *)list->data)[list->len++] = val;
+}
+
+/* Returns the address of the value at index @i of the list. */
+static inline void *value_list_at(const struct value_list *list, size_t i)
+{
+    return (char *)list->data + i * dtype_size(list->dtype);
+}
+
+/* Returns 1 if the given character may be part of a floating-point numeric
+ * entity. Entities never start with e or E, see parse_values().
+ * @c: Character to be checked
+ */
+static inline int __attribute__((always_inline)) is_numeric_char(char c)
+{
+    return (unsigned char)(c - '0') < 10 || c == '.' || c == '-' || c == '+'
+        || (c | 0x20) == 'e';
+}
+
+size_t parse_values(
+    const char *buf, size_t len, int final, struct value_list *list);
+void parse_file(const char *path, struct value_list *list);
+
+#endif /* MPI_HYPERCUBE_PARSE_H */
@@ -0,0 +1,402 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <mpi.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "sort.h"
+#include "trace.h"
+
+/* Tag of the messages folding processes into the hypercube proper. */
+#define TAG_FOLD 1
+
+#define SIGN64 ((uint64_t)1 << 63)
+#define SIGN32 ((uint32_t)1 << 31)
+
+/* Turns values into unsigned keys ordered as the values are, so that they
+ * can be radix-sorted and compared as integers: the sign bit of integers is
+ * flipped, and so is every bit of negative floating-point numbers. Keys of
+ * 32-bit values fit in their lower half.
+ * @t: Element type of the values
+ * @keys: Receives @n keys
+ * @vals: Values
+ * @n: Number of values
+ */
+void sort_to_keys(enum dtype t, uint64_t *keys, const void *vals, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t x = 0;
+        uint32_t y = 0;
+        switch (t) {
+        case DTYPE_F64:
+            memcpy(&x, (const double *)vals + i, sizeof x);
+            keys[i] = x & SIGN64 ? ~x : x ^ SIGN64;
+            break;
+        case DTYPE_I64:
+            memcpy(&x, (const int64_t *)vals + i, sizeof x);
+            keys[i] = x ^ SIGN64;
+            break;
+        case DTYPE_F32:
+            memcpy(&y, (const float *)vals + i, sizeof y);
+            keys[i] = y & SIGN32 ? ~y : y ^ SIGN32;
+            break;
+        case DTYPE_I32:
+            memcpy(&y, (const int32_t *)vals + i, sizeof y);
+            keys[i] = y ^ SIGN32;
+            break;
+        }
+    }
+}
+
+/* Turns keys made by sort_to_keys() back into values.
+ * @t: Element type of the values
+ * @vals: Receives @n values
+ * @keys: Keys
+ * @n: Number of keys
+ */
+void sort_from_keys(enum dtype t, void *vals, const uint64_t *keys, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t x = keys[i];
+        uint32_t y = (uint32_t)x;
+        switch (t) {
+        case DTYPE_F64:
+            x = x & SIGN64 ? x ^ SIGN64 : ~x;
+            memcpy((double *)vals + i, &x, sizeof x);
+            break;
+        case DTYPE_I64:
+            x ^= SIGN64;
+            memcpy((int64_t *)vals + i, &x, sizeof x);
+            break;
+        case DTYPE_F32:
+            y = y & SIGN32 ? y ^ SIGN32 : ~y;
+            memcpy((float *)vals + i, &y, sizeof y);
+            break;
+        case DTYPE_I32:
+            y ^= SIGN32;
+            memcpy((int32_t *)vals + i, &y, sizeof y);
+            break;
+        }
+    }
+}
+
+/* Sorts keys in increasing order with a least-significant-digit radix sort
+ * over bytes. Passes over a byte that all keys share are skipped.
+ * @keys: Keys, sorted in place
+ * @n: Number of keys
+ * @bytes: Number of significant bytes of the keys
+ */
+void sort_radix(uint64_t *keys, size_t n, size_t bytes)
+{
+    uint64_t *tmp = malloc((n ? n : 1) * sizeof *tmp), *src = keys;
+    if (!tmp)
+        fatal("out of memory");
+
+    for (size_t b = 0; b < bytes && n > 1; b++) {
+        size_t counts[256] = { 0 }, shift = 8 * b;
+        for (size_t i = 0; i < n; i++)
+            counts[(src[i] >> shift) & 0xff]++;
+        if (counts[(src[0] >> shift) & 0xff] == n)
+            continue;
+        for (size_t d = 0, sum = 0; d < 256; d++) {
+            size_t c = counts[d];
+            counts[d] = sum;
+            sum += c;
+        }
+        uint64_t *dst = src == keys ? tmp : keys;
+        for (size_t i = 0; i < n; i++)
+            dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+        src = dst;
+    }
+    if (src != keys)
+        memcpy(keys, src, n * sizeof *keys);
+    free(tmp);
+}
+
+/* Returns the number of keys of a sorted run that are not greater than
+ * @pivot. */
+static size_t upper_bound(const uint64_t *keys, size_t n, uint64_t pivot)
+{
+    size_t lo = 0;
+    while (lo < n) {
+        size_t mid = lo + (n - lo) / 2;
+        if (keys[mid] <= pivot)
+            lo = mid + 1;
+        else
+            n = mid;
+    }
+    return lo;
+}
+
+/* Merges two sorted runs into a new one, which the caller frees. */
+static uint64_t *merge(
+    const uint64_t *a, size_t na, const uint64_t *b, size_t nb)
+{
+    uint64_t *out = malloc((na + nb ? na + nb : 1) * sizeof *out), *p = out;
+    if (!out)
+        fatal("out of memory");
+    while (na && nb) {
+        if (*b < *a) {
+            *p++ = *b++;
+            nb--;
+        } else {
+            *p++ = *a++;
+            na--;
+        }
+    }
+    memcpy(p, a, na * sizeof *a);
+    memcpy(p + na, b, nb * sizeof *b);
+    return out;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Picks the pivot of a subcube: the median of the medians of the blocks of
+ * its processes, leaving empty blocks out. */
+static uint64_t pick_pivot(MPI_Comm sub, const uint64_t *keys, size_t n)
+{
+    int size;
+    MPI_Check(MPI_Comm_size(sub, &size));
+    uint64_t mine[2] = { n > 0, n ? keys[n / 2] : 0 };
+    uint64_t *all = malloc(2 * (size_t)size * sizeof *all);
+    if (!all)
+        fatal("out of memory");
+    MPI_Check(MPI_Allgather(
+        mine, 2, MPI_UINT64_T, all, 2, MPI_UINT64_T, sub));
+
+    int num = 0;
+    for (int i = 0; i < size; i++) {
+        if (all[2 * i])
+            all[num++] = all[2 * i + 1];
+    }
+    qsort(all, (size_t)num, sizeof *all, compare_keys);
+    uint64_t pivot = num ? all[(num - 1) / 2] : 0;
+    free(all);
+    return pivot;
+}
+
+/* Sorts keys across the processes of a hypercube with hyperquicksort. Every
+ * round, from the highest dimension down, splits every subcube around a
+ * pivot: the lower half of every pair of partners keeps the keys up to the
+ * pivot and hands over the rest, and the upper half the other way around,
+ * so only the keys that change sides move. Runs stay sorted throughout, and
+ * are merged on arrival. Folded processes hand their keys to their partner
+ * beforehand and end up with none, so that on return the runs of the
+ * processes of the hypercube, in rank order, make the sorted sequence.
+ * @cube: Hypercube
+ * @keys: Sorted run of keys of this process, replaced on return
+ * @n: Number of keys, updated on return
+ */
+void sort_hypercube(struct cube *cube, uint64_t **keys, size_t *n)
+{
+    int core_size = 1 << cube->dim;
+    int folded = cube->rank >= core_size;
+    if (*n > INT_MAX)
+        fatal("run of %zu keys is too large to sort", *n);
+
+    /* Fold the processes beyond the hypercube proper. */
+    if (folded) {
+        TRACED(TRACE_FOLD, -1, *n * sizeof **keys,
+            MPI_Check(MPI_Send(*keys, (int)*n, MPI_UINT64_T,
+                cube->rank - core_size, TAG_FOLD, cube->comm)));
+        *n = 0;
+    } else if (cube->rank + core_size < cube->size) {
+        MPI_Status status;
+        int count;
+        int peer = cube->rank + core_size;
+        MPI_Check(MPI_Probe(peer, TAG_FOLD, cube->comm, &status));
+        MPI_Check(MPI_Get_count(&status, MPI_UINT64_T, &count));
+        uint64_t *in = malloc((count ? (size_t)count : 1) * sizeof *in);
+        if (!in)
+            fatal("out of memory");
+        TRACED(TRACE_FOLD, -1, 0,
+            MPI_Check(MPI_Recv(in, count, MPI_UINT64_T, peer, TAG_FOLD,
+                cube->comm, MPI_STATUS_IGNORE)));
+        uint64_t *out = merge(*keys, *n, in, (size_t)count);
+        free(in);
+        free(*keys);
+        *keys = out;
+        *n += (size_t)count;
+    }
+
+    MPI_Comm core;
+    MPI_Check(MPI_Comm_split(
+        cube->comm, folded ? MPI_UNDEFINED : 0, cube->rank, &core));
+    if (folded)
+        return;
+
+    for (int i = cube->dim - 1; i >= 0; i--) {
+        MPI_Comm sub;
+        MPI_Check(MPI_Comm_split(core, cube->rank >> (i + 1), cube->rank,
+            &sub));
+        uint64_t pivot = pick_pivot(sub, *keys, *n);
+        MPI_Check(MPI_Comm_free(&sub));
+
+        int upper = cube->rank >> i & 1, partner = cube->rank ^ 1 << i;
+        size_t split = upper_bound(*keys, *n, pivot);
+        const uint64_t *keep = upper ? *keys + split : *keys;
+        const uint64_t *send = upper ? *keys : *keys + split;
+        size_t num_keep = upper ? *n - split : split;
+        unsigned long long num_send = *n - num_keep, num_recv;
+
+        MPI_Check(MPI_Sendrecv(&num_send, 1, MPI_UNSIGNED_LONG_LONG, partner,
+            0, &num_recv, 1, MPI_UNSIGNED_LONG_LONG, partner, 0, core,
+            MPI_STATUS_IGNORE));
+        if (num_keep + num_recv > INT_MAX)
+            fatal("run of %llu keys is too large to sort",
+                num_keep + num_recv);
+        uint64_t *in = malloc((num_recv ? num_recv : 1) * sizeof *in);
+        if (!in)
+            fatal("out of memory");
+        TRACED(TRACE_WAIT, i, num_send * sizeof *send,
+            MPI_Check(MPI_Sendrecv(send, (int)num_send, MPI_UINT64_T,
+                partner, 0, in, (int)num_recv, MPI_UINT64_T, partner, 0, core,
+                MPI_STATUS_IGNORE)));
+        uint64_t *out;
+        TRACED(TRACE_COMBINE, i, 0,
+            out = merge(keep, num_keep, in, (size_t)num_recv));
+        free(in);
+        free(*keys);
+        *keys = out;
+        *n = num_keep + (size_t)num_recv;
+    }
+    MPI_Check(MPI_Comm_free(&core));
+}
+
+/* Sets up the reduction agreeing on the next key range of a selection: the
+ * sum of a count, the maximum of a key and the minimum of a key. Keys go
+ * through it as 64-bit integers with the sign bit flipped, which keeps
+ * their order. */
+static void bounds_op_init(struct op *op)
+{
+    if (op_parse("sum,max,min", op) < 0)
+        fatal("out of memory");
+    op->dtype = DTYPE_I64;
+    op_init(op);
+}
+
+/* Returns the bytes of g_arena that sort_select() takes while it runs.
+ * @cube: Hypercube
+ */
+size_t sort_select_scratch_size(const struct cube *cube)
+{
+    struct op op;
+    bounds_op_init(&op);
+    size_t size = cube_scratch_size(cube, 1, &op);
+    op_free(&op);
+    return size;
+}
+
+/* Sums @count and takes the maximum of @hi and the minimum of @lo across
+ * the processes of a hypercube, in a single reduction.
+ * @cube: Hypercube
+ * @op: Operator set up by bounds_op_init()
+ */
+static void agree_bounds(struct cube *cube, const struct op *op,
+    int64_t *count, uint64_t *hi, uint64_t *lo)
+{
+    int64_t vals[3] = { *count, (int64_t)(*hi ^ SIGN64),
+        (int64_t)(*lo ^ SIGN64) };
+    int64_t partial[3];
+    for (int i = 0; i < 3; i++)
+        memcpy((char *)partial + op->children[i].offset, &vals[i],
+            sizeof *vals);
+    cube_reduce(cube, partial, 1, op);
+    for (int i = 0; i < 3; i++)
+        memcpy(&vals[i], (char *)partial + op->children[i].offset,
+            sizeof *vals);
+    *count = vals[0];
+    *hi = (uint64_t)vals[1] ^ SIGN64;
+    *lo = (uint64_t)vals[2] ^ SIGN64;
+}
+
+/* Selects the quantile @p of the keys of all the processes of a hypercube
+ * without sorting them: the key of rank ceil(@p * N) - 1 among the N keys
+ * in increasing order, or the smallest one for @p = 0. Every round splits
+ * the range of keys still in the running at its middle, counts the keys up
+ * to that pivot across the processes, and discards locally the side the
+ * quantile is not on. The counts and the bounds of both sides travel in
+ * the same reduction, so that ranges shrink to the keys actually left, and
+ * no key ever moves: rounds are bounded by the width of the keys. Every
+ * process gets the quantile, for backends leaving the result on every
+ * process.
+ * @cube: Hypercube
+ * @keys: Keys of this process, in any order, reordered on return
+ * @n: Number of keys
+ * @p: Quantile, between 0 and 1
+ */
+uint64_t sort_select(struct cube *cube, uint64_t *keys, size_t n, double p)
+{
+    struct op op;
+    bounds_op_init(&op);
+
+    int64_t count = (int64_t)n;
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (size_t i = 0; i < n; i++) {
+        lo = keys[i] < lo ? keys[i] : lo;
+        hi = keys[i] > hi ? keys[i] : hi;
+    }
+    agree_bounds(cube, &op, &count, &hi, &lo);
+    if (count == 0)
+        fatal("no values to select a quantile from");
+    double r = ceil(p * (double)count);
+    uint64_t k = r > 1 ? (uint64_t)r - 1 : 0;
+
+    /* Keys of this process still in the running, all within [lo, hi]. */
+    uint64_t *first = keys;
+    size_t len = n;
+    while (lo < hi) {
+        uint64_t pivot = lo + (hi - lo) / 2, hi_le = 0, lo_gt = UINT64_MAX;
+        size_t split = 0;
+        double start = trace_begin();
+        for (size_t i = 0; i < len; i++) {
+            uint64_t x = first[i];
+            if (x <= pivot) {
+                first[i] = first[split];
+                first[split++] = x;
+                hi_le = x > hi_le ? x : hi_le;
+            } else {
+                lo_gt = x < lo_gt ? x : lo_gt;
+            }
+        }
+        trace_end(TRACE_LOCAL, -1, 0, start);
+
+        count = (int64_t)split;
+        agree_bounds(cube, &op, &count, &hi_le, &lo_gt);
+        if (k < (uint64_t)count) {
+            len = split;
+            hi = hi_le;
+        } else {
+            k -= (uint64_t)count;
+            first += split;
+            len -= split;
+            lo = lo_gt;
+        }
+    }
+    op_free(&op);
+    return lo;
+}
@@ -0,0 +1,34 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_SORT_H
+#define MPI_HYPERCUBE_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cube.h"
+#include "dtype.h"
+
+void sort_to_keys(enum dtype t, uint64_t *keys, const void *vals, size_t n);
+void sort_from_keys(enum dtype t, void *vals, const uint64_t *keys, size_t n);
+void sort_radix(uint64_t *keys, size_t n, size_t bytes);
+void sort_hypercube(struct cube *cube, uint64_t **keys, size_t *n);
+size_t sort_select_scratch_size(const struct cube *cube);
+uint64_t sort_select(struct cube *cube, uint64_t *keys, size_t n, double p);
+
+#endif /* MPI_HYPERCUBE_SORT_H */
@@ -0,0 +1,171 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mpi.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "stream.h"
+
+/* Bytes asked for on every read. */
+#define STREAM_CHUNK_SIZE (64 << 10)
+
+/* Milliseconds between checks for new data at the end of a followed file. */
+#define FOLLOW_INTERVAL_MS 100
+
+/* Opens a stream of records. This function does not return on failure.
+ * @stream: Stream to be opened
+ * @path: Path to the input, or `-' for standard input
+ * @follow: Whether to wait for more data at the end of a regular file, as
+ * `tail -f' does
+ * @dtype: Element type of the records
+ */
+void stream_open(
+    struct stream *stream, const char *path, int follow, enum dtype dtype)
+{
+    memset(stream, 0, sizeof *stream);
+    stream->path = path;
+    stream->follow = follow;
+    stream->records.dtype = dtype;
+
+    errno = 0;
+    stream->fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    struct stat st;
+    if (stream->fd < 0 || fstat(stream->fd, &st) < 0)
+        fatal("could not open file `%s' for reading: %s", path,
+            strerror(errno));
+    /* Only regular files can grow after their end has been reached. */
+    if (!S_ISREG(st.st_mode))
+        stream->follow = 0;
+
+    stream->cap = STREAM_CHUNK_SIZE;
+    if (!(stream->buf = malloc(stream->cap)))
+        fatal("out of memory");
+}
+
+/* Waits for the input of a stream to become readable, then reads and parses
+ * whatever is available. Returns 0 if @until passed first.
+ * @stream: Stream
+ * @until: Time, as given by MPI_Wtime(), to give up at, or a negative value
+ * to wait for as long as it takes
+ */
+static int fill(struct stream *stream, double until)
+{
+    for (;;) {
+        int timeout = -1;
+        if (until >= 0) {
+            double left = until - MPI_Wtime();
+            if (left <= 0)
+                return 0;
+            timeout = (int)(left * 1e3) + 1;
+        }
+
+        struct pollfd pfd = { .fd = stream->fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+            fatal("could not poll `%s': %s", stream->path, strerror(errno));
+        if (ready == 0)
+            return 0;
+
+        if (stream->pending == stream->cap) {
+            char *grown = realloc(stream->buf, stream->cap *= 2);
+            if (!grown)
+                fatal("out of memory");
+            stream->buf = grown;
+        }
+        ssize_t n = read(stream->fd, stream->buf + stream->pending,
+            stream->cap - stream->pending);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n < 0)
+            fatal("could not read `%s': %s", stream->path, strerror(errno));
+        if (n == 0 && stream->follow) {
+            /* Regular files are always readable, so sleep in between. */
+            int wait = FOLLOW_INTERVAL_MS;
+            if (until >= 0 && (until - MPI_Wtime()) * 1e3 < wait)
+                wait = (int)((until - MPI_Wtime()) * 1e3) + 1;
+            poll(NULL, 0, wait > 0 ? wait : 0);
+            continue;
+        }
+
+        /* The unparsed tail of an entity waits for the rest of it. */
+        size_t len = stream->pending + (size_t)n;
+        size_t used = parse_values(stream->buf, len, n == 0, &stream->records);
+        stream->pending = len - used;
+        memmove(stream->buf, stream->buf + used, stream->pending);
+        stream->eof = n == 0;
+        return 1;
+    }
+}
+
+/* Appends up to @max records of a stream to a list. Returns once @max
+ * records were appended, @until passed, or the input ended, with the number
+ * of records appended.
+ * @stream: Stream
+ * @list: List receiving the records, of the element type of the stream
+ * @max: Largest number of records to append
+ * @until: Time, as given by MPI_Wtime(), to return at, or a negative value
+ * to wait for @max records
+ */
+size_t stream_read(
+    struct stream *stream, struct value_list *list, size_t max, double until)
+{
+    size_t size = dtype_size(list->dtype), done = 0;
+
+    while (done < max) {
+        struct value_list *records = &stream->records;
+        if (stream->head == records->len) {
+            records->len = stream->head = 0;
+            if (stream->eof || !fill(stream, until))
+                break;
+            continue;
+        }
+
+        size_t n = records->len - stream->head;
+        if (n > max - done)
+            n = max - done;
+        while (list->cap < list->len + n)
+            value_list_grow(list);
+        memcpy(value_list_at(list, list->len),
+            value_list_at(records, stream->head), n * size);
+        list->len += n;
+        stream->head += n;
+        done += n;
+    }
+    return done;
+}
+
+/* Closes a stream opened by stream_open().
+ * @stream: Stream
+ */
+void stream_close(struct stream *stream)
+{
+    if (stream->fd != STDIN_FILENO)
+        close(stream->fd);
+    free(stream->buf);
+    free(stream->records.data);
+}
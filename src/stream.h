@@ -0,0 +1,51 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_STREAM_H
+#define MPI_HYPERCUBE_STREAM_H
+
+#include <stddef.h>
+
+#include "parse.h"
+
+/* Unbounded source of records for streaming mode: a file, standard input
+ * (which may be a pipe or a socket), or a file that keeps being appended
+ * to. Records are the numeric entities of the input, as for input files. */
+struct stream {
+    int fd;
+    const char *path;
+    int follow; /* wait for more data at the end of a regular file */
+    int eof; /* no more bytes will come */
+    char *buf; /* bytes read but not parsed yet */
+    size_t cap, pending;
+    struct value_list records; /* parsed but not handed out yet */
+    size_t head; /* first record of @records not handed out */
+};
+
+void stream_open(
+    struct stream *stream, const char *path, int follow, enum dtype dtype);
+size_t stream_read(
+    struct stream *stream, struct value_list *list, size_t max, double until);
+void stream_close(struct stream *stream);
+
+/* Returns 1 once every record of a stream has been handed out. */
+static inline int stream_done(const struct stream *stream)
+{
+    return stream->eof && stream->head == stream->records.len;
+}
+
+#endif /* MPI_HYPERCUBE_STREAM_H */
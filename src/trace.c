@@ -0,0 +1,213 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "trace.h"
+
+static const char *phase_names[] = {
+    [TRACE_PARSE] = "parse",
+    [TRACE_DISTRIBUTE] = "distribute",
+    [TRACE_INPUT] = "input",
+    [TRACE_LOCAL] = "local",
+    [TRACE_FOLD] = "fold",
+    [TRACE_WAIT] = "wait",
+    [TRACE_COMBINE] = "combine",
+    [TRACE_CODEC] = "codec",
+    [TRACE_COLLECTIVE] = "collective",
+    [TRACE_GATHER] = "gather",
+};
+
+/* Starts tracing on every process of @comm. Processes agree on the epoch of
+ * their traces through a barrier, which is as good as MPI_Wtime() clocks
+ * get unless MPI_WTIME_IS_GLOBAL holds.
+ * @comm: Communicator of the processes being traced
+ * @cap: Events kept in the ring buffer; only the last @cap are exported
+ */
+void trace_init(MPI_Comm comm, size_t cap)
+{
+    memset(&g_trace, 0, sizeof g_trace);
+    g_trace.cap = cap;
+    g_trace.events = malloc(cap * sizeof *g_trace.events);
+    if (!g_trace.events)
+        fatal("out of memory");
+    MPI_Check(MPI_Barrier(comm));
+    g_trace.epoch = MPI_Wtime();
+}
+
+/* Writes the events of every process of @comm to @path in the trace event
+ * format read by chrome://tracing and Perfetto, as one thread per process.
+ * Every process of the communicator must call this function.
+ * @comm: Communicator of the processes being traced
+ * @path: Path of the file written by the first process
+ */
+void trace_write(MPI_Comm comm, const char *path)
+{
+    int rank, size;
+    MPI_Check(MPI_Comm_rank(comm, &rank));
+    MPI_Check(MPI_Comm_size(comm, &size));
+
+    /* Lay out the ring buffer oldest event first. */
+    size_t num = g_trace.len < g_trace.cap ? g_trace.len : g_trace.cap;
+    size_t head = g_trace.len - num;
+    struct trace_event *events = malloc((num ? num : 1) * sizeof *events);
+    if (!events)
+        fatal("out of memory");
+    for (size_t i = 0; i < num; i++)
+        events[i] = g_trace.events[(head + i) % g_trace.cap];
+
+    int len = (int)(num * sizeof *events), *lens = NULL, *displs = NULL;
+    struct trace_event *all = NULL;
+    if (rank == 0) {
+        lens = malloc((size_t)size * sizeof *lens);
+        displs = malloc((size_t)size * sizeof *displs);
+        if (!lens || !displs)
+            fatal("out of memory");
+    }
+    MPI_Check(MPI_Gather(&len, 1, MPI_INT, lens, 1, MPI_INT, 0, comm));
+    if (rank == 0) {
+        size_t total = 0;
+        for (int i = 0; i < size; i++) {
+            displs[i] = (int)total;
+            total += (size_t)lens[i];
+        }
+        if (total > INT_MAX)
+            fatal("too many events to export a trace");
+        if (!(all = malloc(total ? total : 1)))
+            fatal("out of memory");
+    }
+    MPI_Check(MPI_Gatherv(events, len, MPI_BYTE, all, lens, displs,
+        MPI_BYTE, 0, comm));
+    free(events);
+
+    unsigned long long dropped = g_trace.len - num, all_dropped = 0;
+    MPI_Check(MPI_Reduce(&dropped, &all_dropped, 1, MPI_UNSIGNED_LONG_LONG,
+        MPI_SUM, 0, comm));
+    if (rank != 0)
+        return;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        fatal("could not open `%s' for writing", path);
+    fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n", fp);
+    for (int i = 0; i < size; i++) {
+        fprintf(fp,
+            "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+            i, i);
+        const struct trace_event *event
+            = (const void *)((const char *)all + displs[i]);
+        for (size_t j = 0; j < (size_t)lens[i] / sizeof *event; j++, event++) {
+            fprintf(fp,
+                ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": "
+                "{\"dim\": %d, \"bytes\": %llu}}",
+                phase_names[event->phase], i, event->start * 1e6,
+                (event->end - event->start) * 1e6, (int)event->dim,
+                (unsigned long long)event->bytes);
+        }
+        fputs(i + 1 < size ? ",\n" : "\n", fp);
+    }
+    fputs("]}\n", fp);
+    if (fclose(fp))
+        fatal("could not write `%s'", path);
+    if (all_dropped)
+        fprintf(stderr,
+            PROGNAME ": warning: %llu oldest events did not fit in the "
+                     "trace\n",
+            all_dropped);
+    free(all);
+    free(lens);
+    free(displs);
+}
+
+/* Prints the time every phase took on the processes of @comm, and the time
+ * waited on and the bytes sent to the partners of every dimension. Uneven
+ * phase times point at load imbalance, and a dimension waiting much longer
+ * than the others for as many bytes at a slow link. Every process of the
+ * communicator must call this function.
+ * @comm: Communicator of the processes being traced
+ * @fp: Stream the first process prints the summary to
+ */
+void trace_summary(MPI_Comm comm, FILE *fp)
+{
+    enum { N = TRACE_NUM_PHASES + TRACE_MAX_DIM };
+    double times[N], min_times[N], max_times[N], sum_times[N];
+    int active[N], num_active[N];
+    unsigned long long bytes[TRACE_MAX_DIM], sum_bytes[TRACE_MAX_DIM];
+    int rank;
+    MPI_Check(MPI_Comm_rank(comm, &rank));
+
+    /* Processes that never went through a phase are left out of it. */
+    memcpy(times, g_trace.phase_time, sizeof g_trace.phase_time);
+    memcpy(times + TRACE_NUM_PHASES, g_trace.dim_wait,
+        sizeof g_trace.dim_wait);
+    for (int i = 0; i < N; i++) {
+        active[i] = times[i] > 0;
+        min_times[i] = active[i] ? times[i] : HUGE_VAL;
+    }
+    for (int i = 0; i < TRACE_MAX_DIM; i++)
+        bytes[i] = g_trace.dim_bytes[i];
+    MPI_Check(MPI_Reduce(
+        rank == 0 ? MPI_IN_PLACE : min_times, min_times, N, MPI_DOUBLE,
+        MPI_MIN, 0, comm));
+    MPI_Check(MPI_Reduce(times, max_times, N, MPI_DOUBLE, MPI_MAX, 0, comm));
+    MPI_Check(MPI_Reduce(times, sum_times, N, MPI_DOUBLE, MPI_SUM, 0, comm));
+    MPI_Check(MPI_Reduce(active, num_active, N, MPI_INT, MPI_SUM, 0, comm));
+    MPI_Check(MPI_Reduce(bytes, sum_bytes, TRACE_MAX_DIM,
+        MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, comm));
+    if (rank != 0)
+        return;
+
+    fprintf(fp, "%-12s %6s %12s %12s %12s %9s\n", "phase", "procs",
+        "min_ms", "mean_ms", "max_ms", "max/mean");
+    for (int i = 0; i < TRACE_NUM_PHASES; i++) {
+        if (!num_active[i])
+            continue;
+        double mean = sum_times[i] / num_active[i];
+        fprintf(fp, "%-12s %6d %12.3f %12.3f %12.3f %9.2f\n", phase_names[i],
+            num_active[i], min_times[i] * 1e3, mean * 1e3,
+            max_times[i] * 1e3, max_times[i] / mean);
+    }
+
+    fprintf(fp, "\n%-12s %6s %12s %12s %12s %14s\n", "dimension", "procs",
+        "wait_min_ms", "wait_mean_ms", "wait_max_ms", "bytes_sent");
+    for (int i = 0; i < TRACE_MAX_DIM; i++) {
+        int j = TRACE_NUM_PHASES + i;
+        if (!num_active[j] && !sum_bytes[i])
+            continue;
+        double mean = num_active[j] ? sum_times[j] / num_active[j] : 0;
+        fprintf(fp, "%-12d %6d %12.3f %12.3f %12.3f %14llu\n", i,
+            num_active[j], num_active[j] ? min_times[j] * 1e3 : 0, mean * 1e3,
+            max_times[j] * 1e3, sum_bytes[i]);
+    }
+}
+
+/* Stops tracing and releases the ring buffer. */
+void trace_free(void)
+{
+    free(g_trace.events);
+    g_trace.events = NULL;
+}
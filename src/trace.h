@@ -0,0 +1,115 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPI_HYPERCUBE_TRACE_H
+#define MPI_HYPERCUBE_TRACE_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Dimensions whose rounds are told apart in the summary, as CUBE_MAX_DIM. */
+#define TRACE_MAX_DIM 30
+
+/* Events kept by default in the ring buffer of every process. */
+#define TRACE_DEFAULT_EVENTS 65536
+
+/* What a process is busy with during a traced span of time. */
+enum trace_phase {
+    TRACE_PARSE, /* parsing the input file */
+    TRACE_DISTRIBUTE, /* sending blocks out to the workers */
+    TRACE_INPUT, /* getting this worker's block of values */
+    TRACE_LOCAL, /* reducing the local block */
+    TRACE_FOLD, /* handing partials to or from a folded process */
+    TRACE_WAIT, /* waiting on the partner of a round */
+    TRACE_COMBINE, /* combining the partner's partials with ours */
+    TRACE_CODEC, /* encoding our partials, or decoding the partner's */
+    TRACE_COLLECTIVE, /* a collective reduction of the MPI library */
+    TRACE_GATHER, /* getting the result to the root */
+    TRACE_NUM_PHASES,
+};
+
+/* Span of time spent in one phase. */
+struct trace_event {
+    double start, end; /* seconds since the epoch of the trace */
+    uint64_t bytes; /* bytes sent, 0 if none */
+    int32_t phase;
+    int32_t dim; /* dimension of the round, -1 if none */
+};
+
+/* Ring buffer of events of this process, along with totals that also
+ * account for the events overwritten in it. Tracing is off while @events
+ * is NULL, and then costs a single test per traced span. */
+struct trace {
+    struct trace_event *events;
+    size_t cap, len; /* @len counts every event ever recorded */
+    double epoch; /* MPI_Wtime() when tracing started */
+    double phase_time[TRACE_NUM_PHASES];
+    double dim_wait[TRACE_MAX_DIM];
+    uint64_t dim_bytes[TRACE_MAX_DIM];
+};
+
+/* Trace of this process. */
+extern struct trace g_trace;
+
+void trace_init(MPI_Comm comm, size_t cap);
+void trace_write(MPI_Comm comm, const char *path);
+void trace_summary(MPI_Comm comm, FILE *fp);
+void trace_free(void);
+
+/* Returns the start of a span of time to be recorded by trace_end(). */
+static inline double trace_begin(void)
+{
+    return g_trace.events ? MPI_Wtime() : 0;
+}
+
+/* Records a span of time started by trace_begin().
+ * @phase: Phase the span was spent in
+ * @dim: Dimension of the round, -1 if none
+ * @bytes: Bytes sent during the span
+ * @start: Value returned by trace_begin()
+ */
+static inline void trace_end(
+    enum trace_phase phase, int dim, size_t bytes, double start)
+{
+    if (!g_trace.events)
+        return;
+    double end = MPI_Wtime();
+    struct trace_event *event = &g_trace.events[g_trace.len++ % g_trace.cap];
+    event->start = start - g_trace.epoch;
+    event->end = end - g_trace.epoch;
+    event->bytes = bytes;
+    event->phase = phase;
+    event->dim = dim;
+    g_trace.phase_time[phase] += end - start;
+    if (dim >= 0 && dim < TRACE_MAX_DIM) {
+        if (phase == TRACE_WAIT)
+            g_trace.dim_wait[dim] += end - start;
+        g_trace.dim_bytes[dim] += bytes;
+    }
+}
+
+/* Runs @stmt as a span of time spent in @phase. */
+#define TRACED(phase, dim, bytes, stmt)                                       \
+    do {                                                                      \
+        double _trace_start = trace_begin();                                  \
+        stmt;                                                                 \
+        trace_end(phase, dim, bytes, _trace_start);                           \
+    } while (0)
+
+#endif /* MPI_HYPERCUBE_TRACE_H */
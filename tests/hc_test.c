@@ -0,0 +1,529 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the reductions of libhypercube against those of the MPI library,
+ * through nothing but its public header: element-wise reductions and
+ * scans, blocking and not, and reductions and scans of blocks of uneven
+ * length, with every backend, with and without persistent transfers;
+ * codecs and pipelining; every element type, and operators whose partials
+ * are more than a value; and the errors returned when a context is
+ * misused. Run under mpirun, with any number of processes. */
+
+#include <math.h>
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hypercube.h"
+
+/* Values per process of the element-wise reductions, and most values of a
+ * block. */
+#define COUNT 37
+
+static int rank, size, failures;
+
+#define CHECK(cond, ...)                                                      \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%d: ", rank);                                    \
+            fprintf(stderr, __VA_ARGS__);                                     \
+            fputc('\n', stderr);                                              \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static const char *const backend_names[] = {
+    [HC_BACKEND_HYPERCUBE] = "hypercube",
+    [HC_BACKEND_REDUCE] = "reduce",
+    [HC_BACKEND_ALLREDUCE] = "allreduce",
+    [HC_BACKEND_CART] = "cart",
+    [HC_BACKEND_NEIGHBOR] = "neighbor",
+    [HC_BACKEND_HALVING] = "halving",
+    [HC_BACKEND_RMA] = "rma",
+};
+
+/* Checks the results of a context reducing int64 sums, which are the
+ * partials themselves. Only the first process gets the result of the
+ * reduce backend, and contexts whose rounds need waiting cannot start
+ * reductions with hc_ireduce(). */
+static void check_sums(const struct hc_config *config)
+{
+    const char *name = backend_names[config->backend];
+    struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, config);
+    CHECK(ctx, "%s: no context", name);
+    if (!ctx)
+        return;
+    CHECK(hc_partial_size(ctx) == sizeof(int64_t), "%s: partial size",
+        name);
+    CHECK(hc_rank(ctx) == rank, "%s: rank", name);
+    int has_result = config->backend != HC_BACKEND_REDUCE || rank == 0;
+    int can_ireduce = !config->hierarchical && !config->shared_memory
+        && config->codec == HC_CODEC_NONE;
+
+    int64_t vals[COUNT], out[COUNT], ref[COUNT];
+    for (int count = 1; count <= COUNT; count += COUNT - 1) {
+        for (int i = 0; i < count; i++)
+            vals[i] = (int64_t)rank * 1000 + i - (INT64_C(1) << 40);
+        MPI_Allreduce(vals, ref, count, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+        CHECK(!hc_reduce(ctx, vals, out, count), "%s: hc_reduce failed",
+            name);
+        for (int i = 0; has_result && i < count; i++)
+            CHECK(out[i] == ref[i], "%s: hc_reduce of %d, element %d", name,
+                count, i);
+
+        struct hc_request *req;
+        int done = 0;
+        if (!can_ireduce) {
+            CHECK(hc_ireduce(ctx, vals, out, count, &req) == HC_ERR_ARG,
+                "%s: hc_ireduce accepted", name);
+        } else {
+            CHECK(!hc_ireduce(ctx, vals, out, count, &req),
+                "%s: hc_ireduce failed", name);
+            while (!done)
+                CHECK(!hc_test(req, &done), "%s: hc_test failed", name);
+            for (int i = 0; has_result && i < count; i++)
+                CHECK(out[i] == ref[i], "%s: hc_ireduce of %d, element %d",
+                    name, count, i);
+            CHECK(!hc_ireduce(ctx, vals, out, count, &req) && !hc_wait(req),
+                "%s: hc_wait failed", name);
+            for (int i = 0; has_result && i < count; i++)
+                CHECK(out[i] == ref[i], "%s: hc_wait of %d, element %d",
+                    name, count, i);
+        }
+
+        MPI_Scan(vals, ref, count, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        CHECK(!hc_scan(ctx, vals, out, count, 0), "%s: hc_scan failed",
+            name);
+        for (int i = 0; i < count; i++)
+            CHECK(out[i] == ref[i], "%s: hc_scan of %d, element %d", name,
+                count, i);
+        MPI_Exscan(vals, ref, count, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        CHECK(!hc_scan(ctx, vals, out, count, 1), "%s: hc_scan failed",
+            name);
+        for (int i = 0; rank > 0 && i < count; i++)
+            CHECK(out[i] == ref[i], "%s: exclusive hc_scan of %d, element %d",
+                name, count, i);
+    }
+
+    /* Blocks of every length up to COUNT, the first one empty, numbered
+     * across the processes. */
+    int64_t n = (rank * 7) % (COUNT + 1), first, total = 0, sum;
+    MPI_Exscan(&n, &first, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        first = 0;
+    for (int64_t i = 0; i < n; i++)
+        total += vals[i] = first + i;
+    MPI_Allreduce(&total, &sum, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    CHECK(!hc_reduce_block(ctx, vals, (size_t)n, first, out),
+        "%s: hc_reduce_block failed", name);
+    CHECK(!has_result || out[0] == sum, "%s: hc_reduce_block", name);
+    for (int exclusive = 0; exclusive < 2; exclusive++) {
+        CHECK(!hc_scan_block(ctx, vals, (size_t)n, first, out, exclusive),
+            "%s: hc_scan_block failed", name);
+        for (int64_t i = 0; i < n; i++) {
+            int64_t j = first + i + !exclusive;
+            CHECK(out[i] == j * (j - 1) / 2, "%s: %shc_scan_block, value %d",
+                name, exclusive ? "exclusive " : "", (int)i);
+        }
+    }
+    CHECK(!hc_free(ctx), "%s: hc_free failed", name);
+}
+
+/* Checks a context reducing f64 maxima, whose order across the processes
+ * and within blocks does not matter. */
+static void check_max(const struct hc_config *config)
+{
+    const char *name = backend_names[config->backend];
+    struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, config);
+    CHECK(ctx, "%s: no max context", name);
+    if (!ctx)
+        return;
+    int has_result = config->backend != HC_BACKEND_REDUCE || rank == 0;
+
+    double vals[COUNT], out[COUNT], ref[COUNT];
+    for (int i = 0; i < COUNT; i++)
+        vals[i] = ((rank + 3) * (i + 5) % 23) * 0.25 - 2;
+    MPI_Allreduce(vals, ref, COUNT, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    CHECK(!hc_reduce(ctx, vals, out, COUNT), "%s: max failed", name);
+    for (int i = 0; has_result && i < COUNT; i++)
+        CHECK(out[i] == ref[i], "%s: max, element %d", name, i);
+    struct hc_request *req;
+    CHECK(!hc_ireduce(ctx, vals, out, COUNT, &req) && !hc_wait(req),
+        "%s: imax failed", name);
+    for (int i = 0; has_result && i < COUNT; i++)
+        CHECK(out[i] == ref[i], "%s: imax, element %d", name, i);
+
+    double local = vals[0], global;
+    for (int i = 1; i < COUNT; i++)
+        local = vals[i] > local ? vals[i] : local;
+    MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    CHECK(!hc_reduce_block(ctx, vals, COUNT, (int64_t)rank * COUNT, out),
+        "%s: max of blocks failed", name);
+    CHECK(!has_result || out[0] == global, "%s: max of blocks", name);
+    CHECK(!hc_free(ctx), "%s: hc_free failed", name);
+}
+
+/* Value @i of the block of process @r, a small integer so that every type
+ * holds it, and sums of them, exactly. */
+static int block_value(int r, int i)
+{
+    return (r * 7 + i * 5) % 19 - 9;
+}
+
+/* Buffer of values of any type. */
+union values {
+    double f64[COUNT];
+    float f32[COUNT];
+    int32_t i32[COUNT];
+    int64_t i64[COUNT];
+};
+
+/* Stores a value as an element of type @dtype. */
+static void store(enum hc_dtype dtype, union values *buf, int i, double v)
+{
+    switch (dtype) {
+    case HC_F64:
+        buf->f64[i] = v;
+        break;
+    case HC_F32:
+        buf->f32[i] = (float)v;
+        break;
+    case HC_I32:
+        buf->i32[i] = (int32_t)v;
+        break;
+    case HC_I64:
+        buf->i64[i] = (int64_t)v;
+        break;
+    }
+}
+
+/* Appends a value the way hc_print() writes one of type @dtype. */
+static void append(char *out, size_t size, enum hc_dtype dtype, double v)
+{
+    size_t len = strlen(out);
+    if (dtype == HC_F64 || dtype == HC_F32)
+        snprintf(out + len, size - len, "%lf", v);
+    else
+        snprintf(out + len, size - len, "%lld", (long long)v);
+}
+
+/* Checks what a context prints for the result of reducing the blocks of
+ * block_value() of every process, COUNT values each, with an operator
+ * whose partials are more than a value: argmax, topk, and a fused
+ * operator made of both and of a sum. */
+static void check_printed(const struct hc_config *config)
+{
+    static const char *const dtype_names[]
+        = { [HC_F64] = "f64", [HC_F32] = "f32", [HC_I32] = "i32",
+              [HC_I64] = "i64" };
+    const char *name = dtype_names[config->dtype];
+
+    /* Every process works out the result on its own. */
+    int total = size * COUNT, argmax = 0, top[3] = { -100, -100, -100 };
+    long long sum = 0;
+    for (int j = 0; j < total; j++) {
+        int v = block_value(j / COUNT, j % COUNT);
+        sum += v;
+        if (v > block_value(argmax / COUNT, argmax % COUNT))
+            argmax = j;
+        for (int t = 0; t < 3; t++) {
+            if (v > top[t]) {
+                memmove(top + t + 1, top + t, (size_t)(2 - t) * sizeof *top);
+                top[t] = v;
+                break;
+            }
+        }
+    }
+    char want_argmax[64] = "", want_topk[128] = "", want[256] = "";
+    append(want_argmax, sizeof want_argmax, config->dtype,
+        block_value(argmax / COUNT, argmax % COUNT));
+    snprintf(want_argmax + strlen(want_argmax),
+        sizeof want_argmax - strlen(want_argmax), " %d", argmax);
+    for (int t = 0; t < 3; t++) {
+        if (t)
+            strcat(want_topk, " ");
+        append(want_topk, sizeof want_topk, config->dtype, top[t]);
+    }
+
+    union values vals;
+    for (int i = 0; i < COUNT; i++)
+        store(config->dtype, &vals, i, block_value(rank, i));
+    const char *const ops[] = { "argmax", "topk:3", "sum,argmax,topk:3" };
+    for (int o = 0; o < 3; o++) {
+        struct hc_config settings = *config;
+        settings.op = ops[o];
+        struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, &settings);
+        CHECK(ctx, "%s of %s: no context: %s", ops[o], name,
+            hc_last_error());
+        if (!ctx)
+            continue;
+        char *partial = malloc(hc_partial_size(ctx));
+        CHECK(!hc_reduce_block(
+                  ctx, &vals, COUNT, (int64_t)rank * COUNT, partial),
+            "%s of %s failed", ops[o], name);
+
+        char got[256] = "";
+        FILE *fp = tmpfile();
+        hc_print(ctx, fp, partial);
+        rewind(fp);
+        if (!fgets(got, sizeof got, fp))
+            got[0] = '\0';
+        fclose(fp);
+        free(partial);
+        CHECK(!hc_free(ctx), "%s of %s: hc_free failed", ops[o], name);
+
+        if (o == 0) {
+            strcpy(want, want_argmax);
+        } else if (o == 1) {
+            strcpy(want, want_topk);
+        } else {
+            want[0] = '\0';
+            append(want, sizeof want, config->dtype, (double)sum);
+            snprintf(want + strlen(want), sizeof want - strlen(want),
+                ";%s;%s", want_argmax, want_topk);
+        }
+        CHECK(!strcmp(got, want), "%s of %s: `%s', not `%s'", ops[o], name,
+            got, want);
+    }
+}
+
+/* Checks element-wise sums and maxima of f32 or i32 values, whose
+ * partials are the values themselves, against those of the MPI library.
+ */
+static void check_narrow(const struct hc_config *config)
+{
+    MPI_Datatype type = config->dtype == HC_F32 ? MPI_FLOAT : MPI_INT32_T;
+    const char *const ops[] = { "sum", "max" };
+    const MPI_Op mpi_ops[] = { MPI_SUM, MPI_MAX };
+    for (int o = 0; o < 2; o++) {
+        struct hc_config settings = *config;
+        settings.op = ops[o];
+        struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, &settings);
+        CHECK(ctx, "%s: no context: %s", ops[o], hc_last_error());
+        if (!ctx)
+            continue;
+        CHECK(hc_partial_size(ctx) == 4, "%s: partial size", ops[o]);
+
+        union values vals, out, ref;
+        for (int i = 0; i < COUNT; i++)
+            store(config->dtype, &vals, i, block_value(rank, i));
+        MPI_Allreduce(&vals, &ref, COUNT, type, mpi_ops[o], MPI_COMM_WORLD);
+        CHECK(!hc_reduce(ctx, &vals, &out, COUNT), "%s failed", ops[o]);
+        CHECK(!memcmp(out.i32, ref.i32, sizeof out.i32), "%s of %s values",
+            ops[o], config->dtype == HC_F32 ? "f32" : "i32");
+        CHECK(!hc_free(ctx), "%s: hc_free failed", ops[o]);
+    }
+}
+
+/* Checks element-wise maxima and sums of f64 values going through a lossy
+ * codec in every dimension, which may only be off by the precision of the
+ * codec, @tolerance relative to the value, once per process at most, and
+ * must be the same on every process. */
+static void check_lossy(const struct hc_config *config, double tolerance)
+{
+    const char *const ops[] = { "max", "sum" };
+    const MPI_Op mpi_ops[] = { MPI_MAX, MPI_SUM };
+    for (int o = 0; o < 2; o++) {
+        struct hc_config settings = *config;
+        settings.op = ops[o];
+        settings.dtype = HC_F64;
+        struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, &settings);
+        CHECK(ctx, "lossy %s: no context: %s", ops[o], hc_last_error());
+        if (!ctx)
+            continue;
+
+        double vals[COUNT], out[COUNT], ref[COUNT], lo[COUNT], hi[COUNT];
+        for (int i = 0; i < COUNT; i++)
+            vals[i] = 1 + rank * 1e-4 + i * 0.37;
+        MPI_Allreduce(vals, ref, COUNT, MPI_DOUBLE, mpi_ops[o],
+            MPI_COMM_WORLD);
+        CHECK(!hc_reduce(ctx, vals, out, COUNT), "lossy %s failed", ops[o]);
+        for (int i = 0; i < COUNT; i++)
+            CHECK(fabs(out[i] - ref[i]) <= size * tolerance * fabs(ref[i]),
+                "lossy %s, element %d: %g, not %g", ops[o], i, out[i],
+                ref[i]);
+        MPI_Allreduce(out, lo, COUNT, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(out, hi, COUNT, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        for (int i = 0; i < COUNT; i++)
+            CHECK(lo[i] == hi[i], "lossy %s, element %d: %.17g to %.17g",
+                ops[o], i, lo[i], hi[i]);
+        CHECK(!hc_free(ctx), "lossy %s: hc_free failed", ops[o]);
+    }
+}
+
+/* Checks that misusing a context gets errors back, and leaves the context
+ * as it was. */
+static void check_errors(void)
+{
+    struct hc_config config = HC_CONFIG_INIT;
+    config.op = "sum";
+    config.dtype = HC_I64;
+    config.count = COUNT;
+    struct hc_ctx *ctx = hc_init(MPI_COMM_WORLD, &config);
+    CHECK(ctx, "no context: %s", hc_last_error());
+    if (!ctx)
+        return;
+
+    int64_t vals[COUNT + 1] = { 0 }, out[COUNT + 1];
+    CHECK(hc_reduce(ctx, vals, out, COUNT + 1) == HC_ERR_ARG,
+        "reduction of too many values accepted");
+    CHECK(hc_scan(ctx, vals, out, -1, 0) == HC_ERR_ARG,
+        "scan of -1 values accepted");
+    struct hc_request *req;
+    CHECK(!hc_ireduce(ctx, vals, out, COUNT, &req), "hc_ireduce failed");
+    CHECK(hc_reduce(ctx, vals, out, COUNT) == HC_ERR_BUSY,
+        "reduction accepted with another one in flight");
+    CHECK(hc_free(ctx) == HC_ERR_BUSY,
+        "context released with a reduction in flight");
+    CHECK(!hc_wait(req), "hc_wait failed");
+    vals[0] = 1;
+    CHECK(!hc_reduce(ctx, vals, out, 1) && out[0] == size,
+        "context unusable after misuse");
+    CHECK(!hc_free(ctx), "hc_free failed");
+
+    /* Scans have no timeout. */
+    config.timeout = 10;
+    ctx = hc_init(MPI_COMM_WORLD, &config);
+    CHECK(ctx, "no context with a timeout: %s", hc_last_error());
+    if (!ctx)
+        return;
+    CHECK(hc_scan(ctx, vals, out, 1, 0) == HC_ERR_ARG,
+        "scan with a timeout accepted");
+    CHECK(hc_scan_block(ctx, vals, 1, 0, out, 0) == HC_ERR_ARG,
+        "scan of blocks with a timeout accepted");
+    CHECK(!hc_reduce(ctx, vals, out, 1) && out[0] == size,
+        "reduction with a timeout failed");
+    CHECK(hc_size(ctx) == size, "size with a timeout");
+    CHECK(!hc_free(ctx), "hc_free failed");
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    /* Settings that cannot be carried out get no context. */
+    struct hc_config config = HC_CONFIG_INIT;
+    config.op = "nonsense";
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "unknown operator accepted");
+    config.op = "sum";
+    config.kernels = "nonsense";
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "unknown kernels accepted");
+    config.kernels = NULL;
+    config.count = 0;
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "empty context accepted");
+    config.count = COUNT;
+    config.backend = HC_BACKEND_REDUCE;
+    config.codec = HC_CODEC_XOR;
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "codec of reduce accepted");
+    config.codec = HC_CODEC_NONE;
+    config.timeout = 1;
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "timeout of reduce accepted");
+    config.backend = HC_BACKEND_HYPERCUBE;
+    config.shared_memory = 1;
+    CHECK(hc_check_config(&config) == HC_ERR_ARG,
+        "timeout through shared memory accepted");
+    config.shared_memory = 0;
+    config.segment_size = 64;
+    CHECK(hc_check_config(&config) == HC_ERR_ARG,
+        "pipelined timeout accepted");
+    config.segment_size = 0;
+    config.timeout = 0;
+#ifndef HAVE_LZ4
+    config.codec = HC_CODEC_LZ4;
+    CHECK(!hc_init(MPI_COMM_WORLD, &config), "lz4 accepted without LZ4");
+    config.codec = HC_CODEC_NONE;
+#endif
+    check_errors();
+
+    for (int b = HC_BACKEND_HYPERCUBE; b <= HC_BACKEND_RMA; b++) {
+        config.backend = (enum hc_backend)b;
+        for (config.persistent = 0; config.persistent < 2;
+             config.persistent++) {
+            config.op = "sum";
+            config.dtype = HC_I64;
+            check_sums(&config);
+            config.op = "max";
+            config.dtype = HC_F64;
+            check_max(&config);
+        }
+    }
+
+    /* Codecs, pipelining, nodes, shared memory and several threads only
+     * change how partials get about. Processes launched together share a
+     * node, so that codecs have to be asked for in every dimension. */
+    config.backend = HC_BACKEND_HYPERCUBE;
+    config.persistent = 0;
+    config.op = "sum";
+    config.dtype = HC_I64;
+    config.codec = HC_CODEC_XOR;
+    config.codec_dims = ~0u;
+    check_sums(&config);
+#ifdef HAVE_LZ4
+    config.codec = HC_CODEC_LZ4;
+    check_sums(&config);
+#endif
+    config.codec = HC_CODEC_F16;
+    check_lossy(&config, 0x1p-10);
+    config.codec = HC_CODEC_BF16;
+    check_lossy(&config, 0x1p-7);
+    config.codec = HC_CODEC_NONE;
+    config.codec_dims = 0;
+    config.segment_size = 8 * sizeof(int64_t);
+    check_sums(&config);
+    config.pipeline_depth = 3;
+    check_sums(&config);
+    config.persistent = 1;
+    check_sums(&config);
+    config.persistent = 0;
+    config.pipeline_depth = 2;
+    config.segment_size = 0;
+    config.hierarchical = 1;
+    check_sums(&config);
+    config.hierarchical = 0;
+    config.shared_memory = 1;
+    check_sums(&config);
+    config.shared_memory = 0;
+    config.threads = 4;
+    check_sums(&config);
+    config.threads = 1;
+
+    /* Other element types, and operators whose partials are more than a
+     * value. */
+    for (int d = HC_F64; d <= HC_I64; d++) {
+        config.dtype = (enum hc_dtype)d;
+        check_printed(&config);
+        if (d == HC_F32 || d == HC_I32)
+            check_narrow(&config);
+    }
+
+    int total;
+    MPI_Allreduce(&failures, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (total)
+            fprintf(stderr, "%d checks failed\n", total);
+        else
+            printf("%d processes: checked\n", size);
+    }
+    MPI_Finalize();
+    return total ? 1 : 0;
+}
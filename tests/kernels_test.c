@@ -0,0 +1,135 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that the max and min kernels of every instruction set the
+ * processor supports agree with the scalar definitions, and that NaN in any
+ * position of a block, or of either operand of a combine, yields NaN
+ * whichever order the operands come in. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "kernels.h"
+
+/* Longest block checked, enough for the peeled, vector and tail loops of
+ * the widest kernels. */
+#define MAX_LEN 80
+
+/* Largest misalignment of the blocks, in elements. */
+#define MAX_SHIFT 4
+
+static int failures;
+
+#define CHECK(cond, ...)                                                      \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, __VA_ARGS__);                                     \
+            fputc('\n', stderr);                                              \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+/* Defines the checks of the max and min kernels for one type.
+ * @tn: Name of the type
+ * @T: Element type
+ * @dt: Element type, as an enum dtype
+ * @has_nan: Whether the type has NaN
+ */
+#define DEFINE_CHECKS(tn, T, dt, has_nan)                                     \
+    static T ref_##tn(int op, T a, T b)                                       \
+    {                                                                         \
+        if (a != a || b != b)                                                 \
+            return a != a ? a : b;                                            \
+        return op == OP_MAX ? (b > a ? b : a) : (b < a ? b : a);              \
+    }                                                                         \
+                                                                              \
+    static int same_##tn(T a, T b)                                            \
+    {                                                                         \
+        return (a != a && b != b) || a == b;                                  \
+    }                                                                         \
+                                                                              \
+    static void check_##tn(const struct kernel_set *set, int op)              \
+    {                                                                         \
+        const char *isa = set->name;                                          \
+        kernel_reduce_fn reduce = set->reduce[op][dt];                        \
+        kernel_combine_fn combine = set->combine[op][dt];                     \
+        T a_[MAX_LEN + MAX_SHIFT], b_[MAX_LEN + MAX_SHIFT];                   \
+        T x_[MAX_LEN + MAX_SHIFT], y_[MAX_LEN + MAX_SHIFT];                   \
+                                                                              \
+        for (int shift = 0; shift < MAX_SHIFT; shift++) {                     \
+            T *a = a_ + shift, *b = b_ + shift;                               \
+            T *x = x_ + shift, *y = y_ + shift;                               \
+            for (int n = 1; n <= MAX_LEN; n++) {                              \
+                for (int nan = -1; nan < (has_nan ? n : 0); nan++) {          \
+                    for (int i = 0; i < n; i++) {                             \
+                        a[i] = (T)((i * 37 + n * 11) % 53 - 26);              \
+                        b[i] = (T)((i * 29 + n * 7) % 47 - 23);               \
+                    }                                                         \
+                    if (nan >= 0)                                             \
+                        a[nan] = (T)NAN;                                      \
+                                                                              \
+                    T want = a[0], got;                                       \
+                    for (int i = 1; i < n; i++)                               \
+                        want = ref_##tn(op, want, a[i]);                      \
+                    reduce(&got, a, (size_t)n);                               \
+                    CHECK(same_##tn(got, want),                               \
+                        "%s: reduce %d of %s, %d values, NaN at %d",         \
+                        isa, op, #tn, n, nan);                                \
+                                                                              \
+                    memcpy(x, a, (size_t)n * sizeof(T));                      \
+                    memcpy(y, b, (size_t)n * sizeof(T));                      \
+                    combine(x, b, (size_t)n);                                 \
+                    combine(y, a, (size_t)n);                                 \
+                    for (int i = 0; i < n; i++) {                             \
+                        CHECK(same_##tn(x[i], ref_##tn(op, a[i], b[i]))       \
+                                && same_##tn(x[i], y[i]),                     \
+                            "%s: combine %d of %s, %d values, NaN at %d, "    \
+                            "element %d",                                     \
+                            isa, op, #tn, n, nan, i);                         \
+                    }                                                         \
+                }                                                             \
+            }                                                                 \
+        }                                                                     \
+    }
+
+DEFINE_CHECKS(f64, double, DTYPE_F64, 1)
+DEFINE_CHECKS(f32, float, DTYPE_F32, 1)
+DEFINE_CHECKS(i32, int32_t, DTYPE_I32, 0)
+DEFINE_CHECKS(i64, int64_t, DTYPE_I64, 0)
+
+int main(void)
+{
+    const char *const isas[] = { "avx512", "avx2", "sse2", "neon", "generic" };
+
+    for (size_t i = 0; i < sizeof isas / sizeof *isas; i++) {
+        const struct kernel_set *set = kernels_find(isas[i]);
+        if (!set)
+            continue;
+        for (int op = OP_MAX; op <= OP_MIN; op++) {
+            check_f64(set, op);
+            check_f32(set, op);
+            check_i32(set, op);
+            check_i64(set, op);
+        }
+        printf("%s: checked\n", isas[i]);
+    }
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * mpi_hypercube -- Implements a hypercube-interconnect network topology using
+ * OpenMPi Copyright (c) 2021 Ángel Pérez <angel@ttm.sh>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that the parser converts numbers to the same doubles as strtod(),
+ * whether they go through Clinger's fast path, Eisel-Lemire or strtod()
+ * itself, that integers are parsed exactly, that words are not taken for
+ * numbers nor warned about, and that entities touching the end of a buffer
+ * are left for the next one. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parse.h"
+
+/* Random numbers printed and parsed back, at every precision. */
+#define NUM_RANDOM 20000
+
+static int failures;
+
+#define CHECK(cond, ...)                                                      \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, __VA_ARGS__);                                     \
+            fputc('\n', stderr);                                              \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+/* Parses a whole string into a fresh list of @dtype, with the warnings of
+ * the parser going to @log rather than to the standard output. Returns the
+ * number of bytes of warnings. */
+static long parse(
+    const char *str, enum dtype dtype, struct value_list *list, FILE *log)
+{
+    long start = ftell(log);
+    int out = dup(STDOUT_FILENO);
+
+    memset(list, 0, sizeof *list);
+    list->dtype = dtype;
+    fflush(stdout);
+    dup2(fileno(log), STDOUT_FILENO);
+    parse_values(str, strlen(str), 1, list);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    fseek(log, 0, SEEK_END);
+    return ftell(log) - start;
+}
+
+/* Checks that @str parses to the single double strtod() gives, bit for
+ * bit. */
+static void check_double(const char *str, FILE *log)
+{
+    struct value_list list;
+    double ref = strtod(str, NULL), val;
+
+    parse(str, DTYPE_F64, &list, log);
+    CHECK(list.len == 1, "`%s': %zu values", str, list.len);
+    if (list.len == 1) {
+        memcpy(&val, list.data, sizeof val);
+        CHECK(!memcmp(&val, &ref, sizeof val), "`%s': %.17g, not %.17g", str,
+            val, ref);
+    }
+    free(list.data);
+}
+
+/* Checks that @str parses to the @n doubles of @vals exactly, with @warn
+ * set if the parser is to warn about some entity. */
+static void check_values(
+    const char *str, const double *vals, size_t n, int warn, FILE *log)
+{
+    struct value_list list;
+    long logged = parse(str, DTYPE_F64, &list, log);
+
+    CHECK(list.len == n, "`%s': %zu values, not %zu", str, list.len, n);
+    for (size_t i = 0; i < n && i < list.len; i++)
+        CHECK(((double *)list.data)[i] == vals[i], "`%s', value %zu: %g",
+            str, i, ((double *)list.data)[i]);
+    CHECK(!logged == !warn, "`%s': %s", str,
+        warn ? "no warning" : "warning");
+    free(list.data);
+}
+
+/* Checks that @str parses to the single integer @ref of @dtype, or to
+ * nothing if @valid is clear. */
+static void check_integer(
+    const char *str, enum dtype dtype, int64_t ref, int valid, FILE *log)
+{
+    struct value_list list;
+
+    parse(str, dtype, &list, log);
+    CHECK(list.len == (size_t)valid, "`%s': %zu values", str, list.len);
+    if (valid && list.len == 1) {
+        int64_t val = dtype == DTYPE_I32 ? ((int32_t *)list.data)[0]
+                                         : ((int64_t *)list.data)[0];
+        CHECK(val == ref, "`%s': %" PRId64, str, val);
+    }
+    free(list.data);
+}
+
+/* Checks that a buffer that does not end the input is consumed up to the
+ * entity touching its end, @consumed bytes in, after @n values. */
+static void check_partial(const char *str, size_t consumed, size_t n)
+{
+    struct value_list list = { .dtype = DTYPE_F64 };
+    size_t len = parse_values(str, strlen(str), 0, &list);
+
+    CHECK(len == consumed, "`%s': %zu bytes consumed, not %zu", str, len,
+        consumed);
+    CHECK(list.len == n, "`%s': %zu values, not %zu", str, list.len, n);
+    free(list.data);
+}
+
+int main(void)
+{
+    /* Fast path, Eisel-Lemire, and the cases left to strtod(): long
+     * mantissas, halfway cases, subnormals, overflow and underflow. */
+    static const char *const doubles[] = { "0", "-0", "+0.000", "1", "-1",
+        ".5", "5.", "0.1", "3.14159", "1e22", "1e23", "9007199254740992",
+        "9007199254740993", "9007199254740993.0000000001", "123456789e-30",
+        "1.7976931348623157e308", "1.7976931348623159e308", "1e309", "-1e400",
+        "2.2250738585072014e-308", "2.2250738585072011e-308", "4.9e-324",
+        "2.4703282292062327e-324", "1e-400", "0.000000000000000000001234",
+        "12345678901234567890123", "7.2057594037927933e16",
+        "8.98846567431158e307", "1E+2", "1e-2", "00000000000000000000000012.5",
+        "2.5E-0", "1234567890123456789012345678901234567890e-20" };
+    char str[64];
+    FILE *log = tmpfile();
+    if (!log) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof doubles / sizeof *doubles; i++)
+        check_double(doubles[i], log);
+    srand(1);
+    for (int i = 0; i < NUM_RANDOM; i++) {
+        uint64_t bits = 0;
+        for (int j = 0; j < 4; j++)
+            bits = bits << 16 | (uint64_t)(rand() & 0xFFFF);
+        double d;
+        memcpy(&d, &bits, sizeof d);
+        if (d != d || d - d != 0)
+            continue;
+        snprintf(str, sizeof str, "%.*e", 1 + i % 17, d);
+        check_double(str, log);
+        snprintf(str, sizeof str, "%.*g", 1 + i % 17, d);
+        check_double(str, log);
+    }
+
+    /* Words are skipped, and only malformed numbers are warned about. */
+    static const double words[] = { 25, 300, -5, 0.5 };
+    check_values("temperature 25, Exponent E e 3e2 then -5 and .5", words,
+        4, 0, log);
+    check_values("e5 E-3 ee", NULL, 0, 0, log);
+    check_values("1e 1e+ 1.2.3 - . 4e2x", (const double[]) { 400 }, 1, 1,
+        log);
+
+    check_integer("-2147483648", DTYPE_I32, INT32_MIN, 1, log);
+    check_integer("2147483648", DTYPE_I32, 0, 0, log);
+    check_integer("-9223372036854775808", DTYPE_I64, INT64_MIN, 1, log);
+    check_integer("9223372036854775807", DTYPE_I64, INT64_MAX, 1, log);
+    check_integer("9223372036854775808", DTYPE_I64, 0, 0, log);
+    check_integer("1.5", DTYPE_I64, 0, 0, log);
+    check_integer("exit 7", DTYPE_I64, 7, 1, log);
+
+    check_partial("12 34", 3, 1);
+    check_partial("12 e", 3, 1);
+    check_partial("12 ", 3, 1);
+
+    fclose(log);
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("parser: checked\n");
+    return 0;
+}
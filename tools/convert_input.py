@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""Converts mpi_hypercube input files between text and binary formats.
+
+usage: convert_input.py [--to-text] [--dtype=TYPE] INPUT OUTPUT
+
+TYPE is the type of the values of the binary file: f64 (default), f32, i32
+or i64.
+"""
+import re
+import sys
+
+import hcbin
+
+NUMBER = re.compile(rb'[-+0-9.eE]+')
+
+
+def main(argv):
+    to_text = '--to-text' in argv
+    dtype = 'f64'
+    args = []
+    for a in argv:
+        if a.startswith('--dtype='):
+            dtype = a[len('--dtype='):]
+        elif a != '--to-text':
+            args.append(a)
+    if len(args) != 2 or dtype not in hcbin.DTYPES:
+        sys.exit(__doc__.strip())
+
+    src, dst = args
+    with open(src, 'rb') as fp:
+        if to_text:
+            values = hcbin.read(fp)
+        else:
+            parse = float if dtype.startswith('f') else int
+            values = [parse(m) for m in NUMBER.findall(fp.read())]
+
+    if to_text:
+        with open(dst, 'w') as fp:
+            fp.write(','.join(repr(v) for v in values) + '\n')
+    else:
+        with open(dst, 'wb') as fp:
+            hcbin.write(fp, values, dtype)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Generates src/pow5_table.h, the table of 128-bit truncated powers of five
+used by the Eisel-Lemire float parser in src/parse.c.
+
+usage: gen_pow5_table.py > src/pow5_table.h
+"""
+
+SMALLEST_POWER = -342
+LARGEST_POWER = 308
+
+
+def powers():
+    for q in range(SMALLEST_POWER, 0):
+        power5 = 5 ** -q
+        z = power5.bit_length()
+        if q >= -27:
+            c = 2 ** (z + 127) // power5 + 1
+        else:
+            c = 2 ** (2 * z + 2 * 64) // power5 + 1
+            while c >= 1 << 128:
+                c //= 2
+        yield q, c
+    for q in range(0, LARGEST_POWER + 1):
+        power5 = 5 ** q
+        while power5 < 1 << 127:
+            power5 *= 2
+        while power5 >= 1 << 128:
+            power5 //= 2
+        yield q, power5
+
+
+print('/* Generated by tools/gen_pow5_table.py -- do not edit. */')
+print()
+print('#ifndef MPI_HYPERCUBE_POW5_TABLE_H')
+print('#define MPI_HYPERCUBE_POW5_TABLE_H')
+print()
+print('#include <stdint.h>')
+print()
+print('#define POW5_SMALLEST_POWER (%d)' % SMALLEST_POWER)
+print('#define POW5_LARGEST_POWER %d' % LARGEST_POWER)
+print()
+print('/* 5^q normalized to 128 bits, as { high, low } pairs for q in')
+print(' * [POW5_SMALLEST_POWER, POW5_LARGEST_POWER]. */')
+print('static const uint64_t pow5_table[][2] = {')
+for q, c in powers():
+    print('    { 0x%016xULL, 0x%016xULL }, /* 5^%d */'
+          % (c >> 64, c & ((1 << 64) - 1), q))
+print('};')
+print()
+print('#endif /* MPI_HYPERCUBE_POW5_TABLE_H */')
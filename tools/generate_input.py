@@ -2,4 +2,23 @@
 import random
 import sys
 
-print(','.join([str(random.uniform(-1e6, 1e6)) for _ in range(0, 1 if len(sys.argv) < 2 else int(sys.argv[1]))]))
+import hcbin
+
+binary = '--binary' in sys.argv[1:]
+dtype = 'f64'
+args = []
+for a in sys.argv[1:]:
+    if a.startswith('--dtype='):
+        dtype = a[len('--dtype='):]
+    elif a != '--binary':
+        args.append(a)
+count = 1 if len(args) < 1 else int(args[0])
+if dtype.startswith('i'):
+    values = [random.randint(-1000000, 1000000) for _ in range(0, count)]
+else:
+    values = [random.uniform(-1e6, 1e6) for _ in range(0, count)]
+
+if binary:
+    hcbin.write(sys.stdout.buffer, values, dtype)
+else:
+    print(','.join([str(v) for v in values]))
@@ -0,0 +1,42 @@
+"""Reader and writer for the binary input container of mpi_hypercube.
+
+See src/binfile.h for the layout of the header.
+"""
+import array
+import struct
+import sys
+
+MAGIC = b'HCUB'
+VERSION = 1
+HEADER = struct.Struct('<4sBBBxQ16x')
+LITTLE_ENDIAN = 0
+
+# Data type codes of the header (enum dtype in src/dtype.h), and the array
+# type code holding each of them.
+DTYPES = {'f64': 0, 'f32': 1, 'i32': 2, 'i64': 3}
+TYPECODES = {0: 'd', 1: 'f', 2: 'i', 3: 'q'}
+
+
+def write(fp, values, dtype='f64'):
+    """Writes a sequence of numbers to a binary file object."""
+    code = DTYPES[dtype]
+    data = array.array(TYPECODES[code], values)
+    if sys.byteorder != 'little':
+        data.byteswap()
+    fp.write(HEADER.pack(MAGIC, VERSION, code, LITTLE_ENDIAN, len(data)))
+    fp.write(data.tobytes())
+
+
+def read(fp):
+    """Reads the values of a binary file object into a list of numbers."""
+    magic, version, code, endianness, count = HEADER.unpack(
+        fp.read(HEADER.size))
+    if magic != MAGIC or version != VERSION or code not in TYPECODES:
+        raise ValueError('not a supported binary input file')
+    data = array.array(TYPECODES[code])
+    data.frombytes(fp.read(count * data.itemsize))
+    if len(data) != count:
+        raise ValueError('truncated binary input file')
+    if (endianness == LITTLE_ENDIAN) != (sys.byteorder == 'little'):
+        data.byteswap()
+    return data.tolist()